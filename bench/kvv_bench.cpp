@@ -0,0 +1,253 @@
+#include <benchmark/benchmark.h>
+
+#include "cache/sharded_cache.h"
+#include "models/departure.h"
+#include "search/spatial_index.h"
+#include "search/stop_index.h"
+#include "services/departure_parser.h"
+#include "services/departures_service.h"
+#include "services/notifications_service.h"
+#include "services/stops_service.h"
+
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+
+// --- Fixtures ---
+// Payloads in bench/fixtures have the structure and size of real EFA
+// responses. KVV_FIXTURE_DIR overrides the compiled-in location.
+
+static std::string loadFixture(const std::string& name) {
+    const char* dirEnv = std::getenv("KVV_FIXTURE_DIR");
+    std::string path = std::string(dirEnv && dirEnv[0] != '\0' ? dirEnv : KVV_FIXTURE_DIR) + "/" + name;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Missing fixture " << path << std::endl;
+        std::exit(1);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static const std::string& departureFixture() {
+    static const std::string text = loadFixture("dm_marktplatz.json");
+    return text;
+}
+
+static const std::string& stopFinderFixture() {
+    static const std::string text = loadFixture("stopfinder_markt.json");
+    return text;
+}
+
+static const json& alertsFixture() {
+    static const json alerts = json::parse(loadFixture("addinfo_current.json"))["infos"]["current"];
+    return alerts;
+}
+
+// --- Departures ---
+static void BM_DepartureDomNormalize(benchmark::State& state) {
+    const std::string& text = departureFixture();
+    for (auto _ : state) {
+        json raw = json::parse(text);
+        benchmark::DoNotOptimize(normalizeResponse(raw, true, true));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_DepartureDomNormalize);
+
+static void BM_DepartureSaxExtract(benchmark::State& state) {
+    const std::string& text = departureFixture();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseDepartureList(text));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_DepartureSaxExtract);
+
+// Arg: 1 = detailed + delay, 0 = plain
+static void BM_DepartureSerialize(benchmark::State& state) {
+    std::vector<Departure> departures = parseDepartureList(departureFixture()).departures;
+    bool full = state.range(0) != 0;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        out += '[';
+        for (size_t i = 0; i < departures.size(); ++i) {
+            if (i > 0) out += ',';
+            appendDepartureJson(out, departures[i], full, full);
+        }
+        out += ']';
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * departures.size()));
+}
+BENCHMARK(BM_DepartureSerialize)->Arg(0)->Arg(1);
+
+// --- Input Validation and Hint Matching ---
+// The *Baseline benchmarks keep the replaced implementations for comparison.
+static const std::vector<std::string>& stopIdSamples() {
+    static const std::vector<std::string> ids = {"de:08212:1", "de:08212:89", "7000001", "de:08215:4711:1:2",
+                                                 "Karlsruhe Marktplatz", "de:08212:1;drop"};
+    return ids;
+}
+
+static void BM_IsValidStopId(benchmark::State& state) {
+    const auto& ids = stopIdSamples();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(isValidStopId(ids[i++ % ids.size()]));
+    }
+}
+BENCHMARK(BM_IsValidStopId);
+
+static void BM_IsValidStopIdRegexBaseline(benchmark::State& state) {
+    const auto& ids = stopIdSamples();
+    static const std::regex stopIdPattern("^[a-zA-Z0-9:_. -]+$");
+    size_t i = 0;
+    for (auto _ : state) {
+        const std::string& id = ids[i++ % ids.size()];
+        benchmark::DoNotOptimize(!id.empty() && id.size() <= MAX_STOPID_LENGTH && std::regex_match(id, stopIdPattern));
+    }
+}
+BENCHMARK(BM_IsValidStopIdRegexBaseline);
+
+static const std::vector<std::string>& hintSamples() {
+    static const std::vector<std::string> hints = {
+        "Niederflurwagen", "Linie fährt barrierefrei", "Rollstuhlgerechtes Fahrzeug",
+        "Fahrradmitnahme begrenzt möglich",
+        "Bitte beachten Sie die geänderte Linienführung während der Bauarbeiten am Hauptbahnhof",
+    };
+    return hints;
+}
+
+static void BM_ScanAccessibilityHint(benchmark::State& state) {
+    const auto& hints = hintSamples();
+    for (auto _ : state) {
+        for (const auto& hint : hints) benchmark::DoNotOptimize(scanAccessibilityHint(hint));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * hints.size()));
+}
+BENCHMARK(BM_ScanAccessibilityHint);
+
+static void BM_ScanAccessibilityHintFindBaseline(benchmark::State& state) {
+    const auto& hints = hintSamples();
+    for (auto _ : state) {
+        for (const auto& txt : hints) {
+            bool lowFloor = txt.find("Niederflur") != std::string::npos || txt.find("low floor") != std::string::npos ||
+                            txt.find("lowFloor") != std::string::npos;
+            bool wheelchair = txt.find("Rollstuhl") != std::string::npos || txt.find("wheelchair") != std::string::npos ||
+                              txt.find("barrierefrei") != std::string::npos ||
+                              txt.find("barrier-free") != std::string::npos;
+            benchmark::DoNotOptimize(lowFloor);
+            benchmark::DoNotOptimize(wheelchair);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * hints.size()));
+}
+BENCHMARK(BM_ScanAccessibilityHintFindBaseline);
+
+// --- Stop Search ---
+static void BM_ExtractStopRecords(benchmark::State& state) {
+    json parsed = json::parse(stopFinderFixture());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(extractStopRecords(parsed));
+    }
+}
+BENCHMARK(BM_ExtractStopRecords);
+
+static void BM_LocalStopSearch(benchmark::State& state) {
+    static const bool indexed = [] {
+        indexStops(extractStopRecords(json::parse(stopFinderFixture())));
+        return true;
+    }();
+    (void)indexed;
+    std::string query = normalizeSearchText("Karlsruhe Marktplatz");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(searchStopsLocally(query));
+    }
+}
+BENCHMARK(BM_LocalStopSearch);
+
+// Arg: radius in meters, over a 100 x 100 stop grid around Karlsruhe
+static void BM_NearbyIndex(benchmark::State& state) {
+    static const bool indexed = [] {
+        std::vector<StopRecord> records;
+        for (int i = 0; i < 100; ++i) {
+            for (int j = 0; j < 100; ++j) {
+                std::string id = "bench:" + std::to_string(i) + ":" + std::to_string(j);
+                records.push_back({id, std::nullopt, id, "Karlsruhe", std::nullopt,
+                                   48.95 + i * 0.002, 8.30 + j * 0.003});
+            }
+        }
+        replaceStopLocations(records);
+        return true;
+    }();
+    (void)indexed;
+    int radius = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(findNearbyStops(49.0094, 8.4037, radius, 10));
+    }
+}
+BENCHMARK(BM_NearbyIndex)->Arg(500)->Arg(2000);
+
+// --- Notifications ---
+// Scans the full current-alert set for one stop, as the per-request path does
+static void BM_IsStopAffected(benchmark::State& state) {
+    const json& alerts = alertsFixture();
+    std::string stopId = "de:08212:1";
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (const auto& info : alerts) {
+            if (isStopAffected(info, stopId)) ++matches;
+        }
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * alerts.size()));
+}
+BENCHMARK(BM_IsStopAffected);
+
+// --- Cache ---
+using BenchCache = ShardedCache<std::shared_ptr<const std::string>>;
+
+static std::string cacheKey(size_t i) {
+    return "de:08212:" + std::to_string(i % 1000);
+}
+
+// 1000 stops cached up front, so every thread starts on a warm cache
+static BenchCache& benchCache() {
+    static BenchCache cache(MAX_CACHE_ENTRIES, std::chrono::seconds(3600));
+    static const bool filled = [] {
+        auto value = std::make_shared<const std::string>(departureFixture().substr(0, 4096));
+        for (size_t i = 0; i < 1000; ++i) cache.put(cacheKey(i), value);
+        return true;
+    }();
+    (void)filled;
+    return cache;
+}
+
+static void BM_CacheGetHit(benchmark::State& state) {
+    BenchCache& cache = benchCache();
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 1000; ++i) keys.push_back(cacheKey(i * 7 + state.thread_index()));
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get(keys[i++ % keys.size()]));
+    }
+}
+BENCHMARK(BM_CacheGetHit)->Threads(1)->Threads(8);
+
+static void BM_CachePut(benchmark::State& state) {
+    BenchCache& cache = benchCache();
+    auto value = std::make_shared<const std::string>("[]");
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 1000; ++i) keys.push_back(cacheKey(i * 13 + state.thread_index()));
+    size_t i = 0;
+    for (auto _ : state) {
+        cache.put(keys[i++ % keys.size()], value);
+    }
+}
+BENCHMARK(BM_CachePut)->Threads(1)->Threads(8);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,308 @@
+#include "config/config.h"
+#include "models/departure.h"
+#include "services/departure_parser.h"
+#include "services/departures_service.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+
+// --- Differential Checks ---
+//   kvv_diffcheck [--iterations 100000] [--seed 42]
+// Runs the optimized hot paths against the implementations they replaced on
+// the DM fixture and on randomly generated inputs, and exits non-zero on the
+// first differences:
+//   - parseDepartureList + appendDepartureJson against json::parse +
+//     normalizeResponse, for all four detailed/delay variants, including the
+//     documents the reference path rejects
+//   - scanAccessibilityHint against the separate find calls
+//   - isValidStopId against the std::regex_match check
+// Failing inputs are printed so they can be added to a fixture.
+
+static std::mt19937 rng;
+
+static int pick(int n) {
+    return std::uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+static bool chance(int oneIn) {
+    return pick(oneIn) == 0;
+}
+
+// --- Random DM Documents ---
+// Mostly well-formed departure lists, with wrong value types, missing and
+// duplicate keys, provider errors and truncated text mixed in.
+
+static std::string sampleText() {
+    static const char* samples[] = {"", "1", "12", " 7", "x", "-3", "5.5", "999999999999", "true", "YES",
+                                    "Niederflur", "Rollstuhl ok", "barrier-free", "planLowFloorVehicle",
+                                    "PlanWheelchairAccess", "0", "Gleis 2", "lowFloor"};
+    return samples[pick(18)];
+}
+
+static json sampleScalar() {
+    switch (pick(7)) {
+        case 0: return nullptr;
+        case 1: return pick(2) == 0;
+        case 2: return pick(100);
+        case 3: return 1.5;
+        default: return sampleText();
+    }
+}
+
+static json sampleValue(int depth) {
+    if (depth <= 0 || pick(3) != 0) return sampleScalar();
+    if (pick(2) == 0) {
+        json object = json::object();
+        for (int i = pick(3); i > 0; --i) object[sampleText()] = sampleValue(depth - 1);
+        return object;
+    }
+    json array = json::array();
+    for (int i = pick(3); i > 0; --i) array.push_back(sampleValue(depth - 1));
+    return array;
+}
+
+static json sampleField() {
+    return chance(10) ? sampleScalar() : json(sampleText());
+}
+
+static json sampleHints() {
+    if (chance(8)) return sampleValue(1);
+    json hints = json::array();
+    for (int i = pick(4); i > 0; --i) {
+        if (chance(10)) {
+            hints.push_back(sampleScalar());
+            continue;
+        }
+        json hint = json::object();
+        if (pick(2) == 0) hint["hint"] = sampleField();
+        if (pick(2) == 0) hint["content"] = sampleField();
+        if (chance(3)) hint["x"] = sampleValue(1);
+        hints.push_back(hint);
+    }
+    return hints;
+}
+
+static json sampleAttrs() {
+    if (chance(6)) return sampleValue(1);
+    json attrs = json::array();
+    for (int i = pick(4); i > 0; --i) {
+        if (chance(12)) {
+            attrs.push_back(sampleScalar());
+            continue;
+        }
+        json attr = json::object();
+        if (!chance(4)) {
+            attr["name"] = chance(10) ? sampleScalar()
+                                      : json(pick(2) == 0 ? "planLowFloorVehicle" : "PLANWHEELCHAIRACCESS");
+        }
+        if (!chance(4)) attr["value"] = sampleField();
+        attrs.push_back(attr);
+    }
+    return attrs;
+}
+
+static json sampleServingLine() {
+    if (chance(15)) return sampleValue(1);
+    json line = json::object();
+    for (const char* key : {"number", "direction", "motType", "delay", "trainType", "trainLength",
+                            "trainComposition"}) {
+        if (pick(2) == 0) line[key] = sampleField();
+    }
+    if (pick(2) == 0) line["hints"] = sampleHints();
+    if (chance(3)) line["other"] = sampleValue(2);
+    return line;
+}
+
+static json sampleDeparture() {
+    if (chance(15)) return sampleValue(1);
+    json departure = json::object();
+    if (!chance(6)) departure["servingLine"] = sampleServingLine();
+    if (pick(2) == 0) departure["attrs"] = sampleAttrs();
+    for (const char* key : {"platform", "platformName", "countdown"}) {
+        if (pick(2) == 0) departure[key] = sampleField();
+    }
+    if (pick(2) == 0) departure["realDateTime"] = sampleValue(1);
+    if (pick(2) == 0) departure["hints"] = sampleHints();
+    if (chance(3)) departure["dateTime"] = sampleValue(2);
+    return departure;
+}
+
+static json sampleDocument() {
+    if (chance(30)) return sampleValue(2);
+    json document = json::object();
+    if (chance(40)) document["error"] = sampleValue(1);
+    if (!chance(12)) {
+        int shape = pick(12);
+        if (shape == 0) {
+            document["departureList"] = sampleScalar();
+        } else if (shape == 1) {
+            json list = json::object();
+            for (int i = pick(4); i > 0; --i) list[sampleText()] = sampleDeparture();
+            document["departureList"] = list;
+        } else {
+            json list = json::array();
+            for (int i = pick(6); i > 0; --i) list.push_back(sampleDeparture());
+            document["departureList"] = list;
+        }
+    }
+    if (pick(2) == 0) document["parameters"] = sampleValue(3);
+    return document;
+}
+
+// Duplicate keys and truncation cannot be expressed through json, so they are
+// spliced into the text
+static std::string sampleDocumentText() {
+    std::string text = sampleDocument().dump();
+    if (pick(3) == 0) {
+        const std::pair<const char*, const char*> duplicates[] = {
+            {"\"servingLine\":", "\"servingLine\":{\"number\":\"Z\"},"},
+            {"\"platform\":", "\"platform\":null,"},
+            {"\"departureList\":", "\"departureList\":[{\"countdown\":\"3\"}],"},
+            {"\"hint\":", "\"hint\":5,"},
+        };
+        for (const auto& [key, duplicate] : duplicates) {
+            size_t pos = text.find(key);
+            if (pos != std::string::npos && pick(2) == 0) text.insert(pos, duplicate);
+        }
+    }
+    if (chance(50)) text.resize(static_cast<size_t>(pick(static_cast<int>(text.size()) + 1)));
+    return text;
+}
+
+// --- Departure Paths ---
+// Both render each variant, or the name of the failure the server reports.
+// The cache holds one superset per stop, so whether a document fails is
+// decided by the detailed, delay-including normalization.
+
+static std::string referenceDepartures(const std::string& text, bool detailed, bool includeDelay) {
+    json raw;
+    try {
+        raw = json::parse(text);
+    } catch (...) {
+        return "<invalid json>";
+    }
+    if (raw.contains("error")) return "<provider error>";
+    try {
+        normalizeResponse(raw, true, true);
+        return normalizeResponse(raw, detailed, includeDelay).dump();
+    } catch (...) {
+        return "<normalize failed>";
+    }
+}
+
+static std::string streamedDepartures(const DepartureParseResult& parsed, bool detailed, bool includeDelay) {
+    switch (parsed.status) {
+        case DepartureParseStatus::InvalidJson: return "<invalid json>";
+        case DepartureParseStatus::ProviderError: return "<provider error>";
+        case DepartureParseStatus::NormalizeFailed: return "<normalize failed>";
+        case DepartureParseStatus::Ok: break;
+    }
+    std::string out = "[";
+    for (size_t i = 0; i < parsed.departures.size(); ++i) {
+        if (i > 0) out += ',';
+        appendDepartureJson(out, parsed.departures[i], detailed, includeDelay);
+    }
+    out += ']';
+    return out;
+}
+
+static size_t reported = 0;
+
+static void report(const char* check, const std::string& input, const std::string& expected,
+                   const std::string& actual) {
+    if (reported++ >= 5) return;
+    std::cout << "MISMATCH " << check << "\n  input:    " << input << "\n  expected: " << expected
+              << "\n  actual:   " << actual << "\n";
+}
+
+static void checkDepartures(const std::string& text) {
+    DepartureParseResult parsed = parseDepartureList(text);
+    for (int variant = 0; variant < 4; ++variant) {
+        bool detailed = (variant & 2) != 0;
+        bool includeDelay = (variant & 1) != 0;
+        std::string expected = referenceDepartures(text, detailed, includeDelay);
+        std::string actual = streamedDepartures(parsed, detailed, includeDelay);
+        if (expected != actual) report("departures", text, expected, actual);
+    }
+}
+
+// --- Accessibility Hints ---
+
+static std::string sampleHintText() {
+    static const char* pieces[] = {"Niederflur", "Niederflu", "niederflur", "low floor", "low  floor", "lowFloor",
+                                   "lowfloor", "Rollstuhl", "Rollstu", "wheelchair", "Wheelchair", "barrierefrei",
+                                   "barrier-free", "barrier free", "Fahrzeug", " ", ",", "\xC3\xA4", "\xC3",
+                                   "Linie", "l", "R", "b", "-", "w"};
+    std::string text;
+    for (int i = pick(8); i > 0; --i) text += pieces[pick(25)];
+    return text;
+}
+
+static void checkHint(const std::string& text) {
+    bool lowFloor = text.find("Niederflur") != std::string::npos || text.find("low floor") != std::string::npos ||
+                    text.find("lowFloor") != std::string::npos;
+    bool wheelchair = text.find("Rollstuhl") != std::string::npos || text.find("wheelchair") != std::string::npos ||
+                      text.find("barrierefrei") != std::string::npos ||
+                      text.find("barrier-free") != std::string::npos;
+    HintAccessibility scanned = scanAccessibilityHint(text);
+    if (scanned.lowFloor != lowFloor || scanned.wheelchair != wheelchair) {
+        report("hint", text, std::to_string(lowFloor) + std::to_string(wheelchair),
+               std::to_string(scanned.lowFloor) + std::to_string(scanned.wheelchair));
+    }
+}
+
+// --- Stop IDs ---
+
+static std::string sampleStopId() {
+    static const std::string alphabet = "abcXYZ0189:_. -;/'\"\\%\t\n\xC3\xA4";
+    std::string id;
+    int length = chance(20) ? static_cast<int>(MAX_STOPID_LENGTH) + pick(3) - 1 : pick(16);
+    for (int i = 0; i < length; ++i) id += alphabet[static_cast<size_t>(pick(static_cast<int>(alphabet.size())))];
+    return id;
+}
+
+static void checkStopId(const std::string& id) {
+    static const std::regex stopIdPattern("^[a-zA-Z0-9:_. -]+$");
+    bool expected = !id.empty() && id.size() <= MAX_STOPID_LENGTH && std::regex_match(id, stopIdPattern);
+    bool actual = isValidStopId(id);
+    if (expected != actual) report("stop id", id, std::to_string(expected), std::to_string(actual));
+}
+
+static std::string loadFixture(const std::string& name) {
+    const char* dirEnv = std::getenv("KVV_FIXTURE_DIR");
+    std::string path = std::string(dirEnv && dirEnv[0] != '\0' ? dirEnv : KVV_FIXTURE_DIR) + "/" + name;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Missing fixture " << path << std::endl;
+        std::exit(1);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+int main(int argc, char** argv) {
+    long iterations = 100000;
+    unsigned seed = 42;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--iterations") iterations = std::atol(argv[i + 1]);
+        else if (flag == "--seed") seed = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+    }
+    rng.seed(seed);
+
+    checkDepartures(loadFixture("dm_marktplatz.json"));
+    for (long i = 0; i < iterations; ++i) {
+        checkDepartures(sampleDocumentText());
+        checkHint(sampleHintText());
+        checkStopId(sampleStopId());
+    }
+
+    std::cout << iterations << " iterations (seed " << seed << "): " << reported << " mismatches" << std::endl;
+    return reported == 0 ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+#include "crow.h"
+#include <cpr/cpr.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Replay Load Generator ---
+//   kvv_loadgen mock [--port 9090] [--latency-ms 40] [--jitter-ms 10] [--error-rate 0] [--threads 128]
+//       Serves the bench/fixtures payloads as a stand-in EFA upstream.
+//   kvv_loadgen run [--target http://127.0.0.1:8080] [--concurrency 1,4,16,64] [--duration 10]
+//                   [--paths file] [--api-key KEY]
+//       Replays request paths against kvv_aggregator at each concurrency level
+//       and reports throughput and p50/p99/p999 latency.
+
+using Args = std::map<std::string, std::string>;
+
+static Args parseArgs(int argc, char** argv, int first) {
+    Args args;
+    for (int i = first; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key.rfind("--", 0) != 0 || i + 1 >= argc) {
+            std::cerr << "Unexpected argument " << key << std::endl;
+            std::exit(2);
+        }
+        args[key.substr(2)] = argv[++i];
+    }
+    return args;
+}
+
+static std::string argOr(const Args& args, const std::string& key, const std::string& fallback) {
+    auto it = args.find(key);
+    return it == args.end() ? fallback : it->second;
+}
+
+static long argLong(const Args& args, const std::string& key, long fallback) {
+    std::string value = argOr(args, key, "");
+    if (value.empty()) return fallback;
+    try {
+        return std::stol(value);
+    } catch (...) {
+        std::cerr << "Invalid --" << key << " value " << value << std::endl;
+        std::exit(2);
+    }
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot read " << path << std::endl;
+        std::exit(1);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// --- Mock Upstream ---
+static int runMock(const Args& args) {
+    std::string fixtures = argOr(args, "fixtures", KVV_FIXTURE_DIR);
+    int port = static_cast<int>(argLong(args, "port", 9090));
+    long latencyMs = argLong(args, "latency-ms", 40);
+    long jitterMs = argLong(args, "jitter-ms", 10);
+    long errorRate = argLong(args, "error-rate", 0);  // Percent of requests answered with 503
+    unsigned threads = static_cast<unsigned>(argLong(args, "threads", 128));
+
+    static std::string departures, stopFinder, addInfo;
+    departures = readFile(fixtures + "/dm_marktplatz.json");
+    stopFinder = readFile(fixtures + "/stopfinder_markt.json");
+    addInfo = readFile(fixtures + "/addinfo_current.json");
+
+    auto respond = [latencyMs, jitterMs, errorRate](const std::string& body) {
+        thread_local std::mt19937 rng(std::random_device{}());
+        long delay = latencyMs + (jitterMs > 0 ? std::uniform_int_distribution<long>(0, jitterMs)(rng) : 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        if (errorRate > 0 && std::uniform_int_distribution<long>(0, 99)(rng) < errorRate) {
+            return crow::response(503);
+        }
+        crow::response res(200, body);
+        res.set_header("Content-Type", "application/json");
+        return res;
+    };
+
+    crow::SimpleApp app;
+    CROW_ROUTE(app, "/sl3-alone/XSLT_DM_REQUEST")
+    ([respond](const crow::request&) { return respond(departures); });
+    CROW_ROUTE(app, "/sl3-alone/XSLT_STOPFINDER_REQUEST")
+    ([respond](const crow::request&) { return respond(stopFinder); });
+    CROW_ROUTE(app, "/addinfo/XML_ADDINFO_REQUEST")
+    ([respond](const crow::request&) { return respond(addInfo); });
+
+    std::string base = "http://127.0.0.1:" + std::to_string(port);
+    std::cout << "Mock upstream on " << base << " (latency " << latencyMs << "+" << jitterMs
+              << " ms, errors " << errorRate << "%). Start kvv_aggregator with:\n"
+              << "  PROVIDER_DM_URL=" << base << "/sl3-alone/XSLT_DM_REQUEST\n"
+              << "  PROVIDER_SEARCH_URL=" << base << "/sl3-alone/XSLT_STOPFINDER_REQUEST\n"
+              << "  NOTIFICATION_PROVIDER_URLS=" << base << "/addinfo/" << std::endl;
+    app.loglevel(crow::LogLevel::Warning);
+    app.port(port).concurrency(threads).run();
+    return 0;
+}
+
+// --- Load Run ---
+// Default mix: departure boards over 300 stops (cache misses and hits), plus
+// search, nearby and notification requests.
+static std::vector<std::string> defaultPaths() {
+    std::vector<std::string> paths;
+    for (int i = 1; i <= 300; ++i) {
+        std::string stop = "de:08212:" + std::to_string(i);
+        paths.push_back("/api/stops/" + stop);
+        if (i % 3 == 0) paths.push_back("/api/stops/" + stop + "?detailed=true&delay=true");
+        if (i % 10 == 0) paths.push_back("/api/current_notifs?stopID=" + stop);
+    }
+    for (const char* q : {"marktplatz", "durlach", "hauptbahnhof", "ettlingen", "europaplatz"}) {
+        paths.push_back(std::string("/api/stops/search?q=") + q);
+    }
+    for (int i = 0; i < 20; ++i) {
+        paths.push_back("/api/stops/nearby?lat=49." + std::to_string(i % 10) + "&long=8.40&distance=500");
+    }
+    std::shuffle(paths.begin(), paths.end(), std::mt19937(42));
+    return paths;
+}
+
+static std::vector<std::string> loadPaths(const std::string& file) {
+    std::vector<std::string> paths;
+    std::istringstream lines(readFile(file));
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line[0] == '/') paths.push_back(line);
+    }
+    return paths;
+}
+
+static std::vector<long> parseLevels(const std::string& list) {
+    std::vector<long> levels;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        try {
+            long level = std::stol(item);
+            if (level > 0) levels.push_back(level);
+        } catch (...) {
+            std::cerr << "Ignoring concurrency level " << item << std::endl;
+        }
+    }
+    return levels;
+}
+
+struct LevelResult {
+    uint64_t requests = 0;
+    uint64_t errors = 0;  // Transport failures and 5xx
+    double seconds = 0;
+    std::vector<uint32_t> latenciesMicros;
+};
+
+static LevelResult runLevel(const std::string& target, const std::vector<std::string>& paths,
+                            const std::string& apiKey, long concurrency, long durationSeconds) {
+    std::atomic<bool> stop{false};
+    std::vector<LevelResult> perWorker(static_cast<size_t>(concurrency));
+    std::vector<std::thread> workers;
+
+    auto started = std::chrono::steady_clock::now();
+    for (long w = 0; w < concurrency; ++w) {
+        workers.emplace_back([&, w] {
+            LevelResult& result = perWorker[static_cast<size_t>(w)];
+            cpr::Session session;  // One kept-alive connection per worker
+            if (!apiKey.empty()) session.SetHeader(cpr::Header{{"X-API-Key", apiKey}});
+            session.SetTimeout(cpr::Timeout{30000});
+            size_t next = static_cast<size_t>(w) * 7919 % paths.size();
+            while (!stop.load(std::memory_order_relaxed)) {
+                session.SetUrl(cpr::Url{target + paths[next]});
+                next = (next + 1) % paths.size();
+                auto t0 = std::chrono::steady_clock::now();
+                cpr::Response r = session.Get();
+                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+                result.requests++;
+                if (r.status_code == 0 || r.status_code >= 500) result.errors++;
+                result.latenciesMicros.push_back(static_cast<uint32_t>(std::min<long long>(micros, UINT32_MAX)));
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(durationSeconds));
+    stop = true;
+    for (auto& worker : workers) worker.join();
+
+    LevelResult total;
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    for (auto& result : perWorker) {
+        total.requests += result.requests;
+        total.errors += result.errors;
+        total.latenciesMicros.insert(total.latenciesMicros.end(),
+                                     result.latenciesMicros.begin(), result.latenciesMicros.end());
+    }
+    std::sort(total.latenciesMicros.begin(), total.latenciesMicros.end());
+    return total;
+}
+
+static double percentileMs(const std::vector<uint32_t>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+}
+
+static int runLoad(const Args& args) {
+    std::string target = argOr(args, "target", "http://127.0.0.1:8080");
+    std::vector<long> levels = parseLevels(argOr(args, "concurrency", "1,4,16,64"));
+    long duration = argLong(args, "duration", 10);
+    std::string apiKey = argOr(args, "api-key", "");
+    std::vector<std::string> paths = args.count("paths") ? loadPaths(args.at("paths")) : defaultPaths();
+    if (paths.empty() || levels.empty() || duration <= 0) {
+        std::cerr << "Nothing to run (no paths, concurrency levels or duration)." << std::endl;
+        return 2;
+    }
+
+    std::printf("target %s, %zu paths, %ld s per level\n", target.c_str(), paths.size(), duration);
+    std::printf("%11s %10s %10s %8s %9s %9s %9s\n", "concurrency", "requests", "req/s", "errors", "p50 ms", "p99 ms", "p999 ms");
+    for (long level : levels) {
+        LevelResult result = runLevel(target, paths, apiKey, level, duration);
+        std::printf("%11ld %10llu %10.1f %8llu %9.2f %9.2f %9.2f\n", level,
+                    static_cast<unsigned long long>(result.requests),
+                    static_cast<double>(result.requests) / result.seconds,
+                    static_cast<unsigned long long>(result.errors),
+                    percentileMs(result.latenciesMicros, 0.50),
+                    percentileMs(result.latenciesMicros, 0.99),
+                    percentileMs(result.latenciesMicros, 0.999));
+        std::fflush(stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "mock") return runMock(parseArgs(argc, argv, 2));
+    if (mode == "run") return runLoad(parseArgs(argc, argv, 2));
+    std::cerr << "Usage: kvv_loadgen mock|run [--option value ...] (see bench/loadgen.cpp)" << std::endl;
+    return 2;
+}
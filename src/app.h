@@ -0,0 +1,11 @@
+#pragma once
+
+#include "crow.h"
+#include "middleware/request_metrics.h"
+#include "middleware/request_tracing.h"
+#include "middleware/response_compression.h"
+
+// Application type shared by main() and the route registrars. after_handle
+// runs in reverse order, so the request latency includes compression and the
+// trace covers both.
+using App = crow::App<RequestTracing, RequestMetrics, ResponseCompression>;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "../http/compression.h"
+
+// --- Pre-serialized Response Body ---
+// Cached routes keep the exact bytes they send plus a strong ETag, so a cache
+// hit neither rebuilds a json DOM nor re-serializes it.
+struct CachedBody {
+    std::string data;
+    std::string etag;  // Quoted strong validator, e.g. "\"1f3a...-812\""
+
+    // Compressed variants live as long as the body (i.e. the cache entry): each
+    // is built by the first request that negotiates it. Empty when compressing
+    // did not help.
+    mutable std::once_flag encodedOnce[COMPRESSED_ENCODING_COUNT];
+    mutable std::string encoded[COMPRESSED_ENCODING_COUNT];
+
+    const std::string& compressed(ContentEncoding encoding) const {
+        size_t index = static_cast<size_t>(encoding) - 1;
+        std::call_once(encodedOnce[index], [&] { encoded[index] = compressBody(encoding, data); });
+        return encoded[index];
+    }
+};
+
+using CachedBodyPtr = std::shared_ptr<const CachedBody>;
+
+// --- Helper: Content Hash (FNV-1a, 64 bit) ---
+// Stable across processes and replicas, unlike std::hash.
+inline uint64_t fnv1a64(const std::string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline CachedBodyPtr makeCachedBody(std::string data) {
+    char etag[48];
+    std::snprintf(etag, sizeof(etag), "\"%016llx-%zx\"",
+                  static_cast<unsigned long long>(fnv1a64(data)), data.size());
+    auto body = std::make_shared<CachedBody>();
+    body->data = std::move(data);
+    body->etag = etag;
+    return body;
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --- Per-shard Cache Counters ---
+struct CacheShardStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;    // Dropped to make room (least recently used)
+    uint64_t expirations = 0;  // Dropped because they outlived maxAge
+    size_t size = 0;
+};
+
+// --- Sharded TTL + LRU Cache ---
+// Keys are spread over independently locked shards by hash. Each shard keeps
+// its nodes on two intrusive lists: recency order for LRU eviction, and write
+// order for expiry. All entries share one maxAge, so write order is expiry
+// order and purging expired entries only ever looks at the oldest node.
+template <typename Value>
+class ShardedCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Value value;
+        Clock::time_point timestamp;
+    };
+
+    ShardedCache(size_t capacity, std::chrono::seconds maxAge, size_t shardCount = 16)
+        : maxAge_(maxAge),
+          shards_(shardCount == 0 ? 1 : shardCount) {
+        shardCapacity_ = (capacity + shards_.size() - 1) / shards_.size();
+        if (shardCapacity_ == 0) shardCapacity_ = 1;
+    }
+
+    ShardedCache(const ShardedCache&) = delete;
+    ShardedCache& operator=(const ShardedCache&) = delete;
+
+    // Returns the entry if present and younger than maxAge. Freshness inside
+    // that window (e.g. stale-while-revalidate) is left to the caller.
+    std::optional<Entry> get(const std::string& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        purgeExpired(shard, Clock::now());
+
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            ++shard.misses;
+            return std::nullopt;
+        }
+        Node* node = &it->second;
+        if (Clock::now() - node->timestamp >= maxAge_) {
+            // Only reachable for entries inserted with a backdated timestamp.
+            ++shard.expirations;
+            ++shard.misses;
+            removeNode(shard, node);
+            return std::nullopt;
+        }
+        ++shard.hits;
+        lruUnlink(shard, node);
+        lruPushFront(shard, node);
+        return Entry{node->value, node->timestamp};
+    }
+
+    // Looks at an entry without touching recency or the hit/miss counters.
+    std::optional<Entry> peek(const std::string& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) return std::nullopt;
+        if (Clock::now() - it->second.timestamp >= maxAge_) return std::nullopt;
+        return Entry{it->second.value, it->second.timestamp};
+    }
+
+    void put(const std::string& key, Value value) {
+        put(key, std::move(value), Clock::now());
+    }
+
+    void put(const std::string& key, Value value, Clock::time_point timestamp) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        purgeExpired(shard, Clock::now());
+
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            Node* node = &it->second;
+            node->value = std::move(value);
+            node->timestamp = timestamp;
+            ageUnlink(shard, node);
+            agePushBack(shard, node);
+            lruUnlink(shard, node);
+            lruPushFront(shard, node);
+            return;
+        }
+
+        if (shard.entries.size() >= shardCapacity_ && shard.lruTail) {
+            ++shard.evictions;
+            removeNode(shard, shard.lruTail);
+        }
+
+        auto inserted = shard.entries.emplace(key, Node{});
+        Node* node = &inserted.first->second;
+        node->key = &inserted.first->first;
+        node->value = std::move(value);
+        node->timestamp = timestamp;
+        agePushBack(shard, node);
+        lruPushFront(shard, node);
+    }
+
+    void erase(const std::string& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) removeNode(shard, &it->second);
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries.clear();
+            shard.lruHead = shard.lruTail = nullptr;
+            shard.ageHead = shard.ageTail = nullptr;
+        }
+    }
+
+    // Visits every live entry, one shard lock at a time.
+    void forEach(const std::function<void(const std::string&, const Entry&)>& visit) {
+        auto now = Clock::now();
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            purgeExpired(shard, now);
+            for (Node* node = shard.ageHead; node; node = node->ageNext) {
+                visit(*node->key, Entry{node->value, node->timestamp});
+            }
+        }
+    }
+
+    std::vector<CacheShardStats> stats() {
+        std::vector<CacheShardStats> result;
+        result.reserve(shards_.size());
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            CacheShardStats s;
+            s.hits = shard.hits;
+            s.misses = shard.misses;
+            s.evictions = shard.evictions;
+            s.expirations = shard.expirations;
+            s.size = shard.entries.size();
+            result.push_back(s);
+        }
+        return result;
+    }
+
+    std::chrono::seconds maxAge() const { return maxAge_; }
+
+private:
+    struct Node {
+        Value value{};
+        Clock::time_point timestamp{};
+        const std::string* key = nullptr;
+        Node* lruPrev = nullptr;  // Towards most recently used
+        Node* lruNext = nullptr;
+        Node* agePrev = nullptr;  // Towards oldest write
+        Node* ageNext = nullptr;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // std::unordered_map never relocates its nodes, so the intrusive
+        // pointers stay valid across rehashes.
+        std::unordered_map<std::string, Node> entries;
+        Node* lruHead = nullptr;
+        Node* lruTail = nullptr;
+        Node* ageHead = nullptr;
+        Node* ageTail = nullptr;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t expirations = 0;
+    };
+
+    Shard& shardFor(const std::string& key) {
+        size_t hash = std::hash<std::string>{}(key);
+        hash ^= hash >> 17;  // Spread low-entropy hashes across shards
+        return shards_[hash % shards_.size()];
+    }
+
+    void purgeExpired(Shard& shard, Clock::time_point now) {
+        while (shard.ageHead && now - shard.ageHead->timestamp >= maxAge_) {
+            ++shard.expirations;
+            removeNode(shard, shard.ageHead);
+        }
+    }
+
+    void removeNode(Shard& shard, Node* node) {
+        lruUnlink(shard, node);
+        ageUnlink(shard, node);
+        shard.entries.erase(*node->key);
+    }
+
+    static void lruUnlink(Shard& shard, Node* node) {
+        if (node->lruPrev) node->lruPrev->lruNext = node->lruNext;
+        else if (shard.lruHead == node) shard.lruHead = node->lruNext;
+        if (node->lruNext) node->lruNext->lruPrev = node->lruPrev;
+        else if (shard.lruTail == node) shard.lruTail = node->lruPrev;
+        node->lruPrev = node->lruNext = nullptr;
+    }
+
+    static void lruPushFront(Shard& shard, Node* node) {
+        node->lruPrev = nullptr;
+        node->lruNext = shard.lruHead;
+        if (shard.lruHead) shard.lruHead->lruPrev = node;
+        shard.lruHead = node;
+        if (!shard.lruTail) shard.lruTail = node;
+    }
+
+    static void ageUnlink(Shard& shard, Node* node) {
+        if (node->agePrev) node->agePrev->ageNext = node->ageNext;
+        else if (shard.ageHead == node) shard.ageHead = node->ageNext;
+        if (node->ageNext) node->ageNext->agePrev = node->agePrev;
+        else if (shard.ageTail == node) shard.ageTail = node->agePrev;
+        node->agePrev = node->ageNext = nullptr;
+    }
+
+    static void agePushBack(Shard& shard, Node* node) {
+        node->ageNext = nullptr;
+        node->agePrev = shard.ageTail;
+        if (shard.ageTail) shard.ageTail->ageNext = node;
+        shard.ageTail = node;
+        if (!shard.ageHead) shard.ageHead = node;
+    }
+
+    std::chrono::seconds maxAge_;
+    size_t shardCapacity_ = 1;
+    std::vector<Shard> shards_;
+};
+
+// --- Helper: Summed Shard Counters ---
+inline CacheShardStats sumCacheStats(const std::vector<CacheShardStats>& shards) {
+    CacheShardStats total;
+    for (const auto& s : shards) {
+        total.hits += s.hits;
+        total.misses += s.misses;
+        total.evictions += s.evictions;
+        total.expirations += s.expirations;
+        total.size += s.size;
+    }
+    return total;
+}
@@ -0,0 +1,341 @@
+#include "snapshot_store.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- File Layout ---
+// FileHeader, then per record a RecordHeader followed by the cache name, the
+// key and the payload. Integers are in host byte order; byteOrder rejects a
+// file written on a machine with the other one.
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = {'K', 'V', 'V', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t recordCount;
+};
+
+struct RecordHeader {
+    uint32_t nameLength;
+    uint32_t keyLength;
+    uint32_t payloadLength;
+    uint32_t reserved;
+    int64_t storedAtMs;   // Unix time
+    int64_t expiresAtMs;
+};
+
+int64_t toUnixMs(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point fromUnixMs(int64_t ms) {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+std::string indexKey(const std::string& name, std::string_view key) {
+    std::string out = name;
+    out += '\n';
+    out.append(key.data(), key.size());
+    return out;
+}
+
+struct FileIdentity {
+    ino_t inode = 0;
+    off_t size = 0;
+    int64_t mtimeNs = 0;
+
+    bool operator==(const FileIdentity& other) const {
+        return inode == other.inode && size == other.size && mtimeNs == other.mtimeNs;
+    }
+};
+
+FileIdentity identityOf(const struct stat& st) {
+    return FileIdentity{st.st_ino, st.st_size, static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec};
+}
+
+// --- Mapped Snapshot ---
+// Payloads stay in the mapping; only the index lives on the heap.
+struct MappedSnapshot {
+    struct Record {
+        std::string_view payload;
+        int64_t storedAtMs;
+        int64_t expiresAtMs;
+    };
+
+    void* data = MAP_FAILED;
+    size_t size = 0;
+    FileIdentity identity;
+    std::unordered_map<std::string, Record> index;  // indexKey(name, key)
+
+    MappedSnapshot() = default;
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+    ~MappedSnapshot() {
+        if (data != MAP_FAILED) munmap(data, size);
+    }
+};
+
+using MappedSnapshotPtr = std::shared_ptr<const MappedSnapshot>;
+
+} // namespace
+
+// --- Snapshot State ---
+static std::mutex registry_mutex;
+static std::vector<std::pair<std::string, SnapshotExporter>> exporters;
+
+static std::mutex mapped_mutex;
+static MappedSnapshotPtr mapped_snapshot;  // protected by mapped_mutex
+
+static std::string snapshot_path;  // Set once in startCacheSnapshots
+static std::atomic<bool> snapshots_enabled{false};
+static std::atomic<uint64_t> snapshot_hits{0};
+static std::atomic<uint64_t> snapshot_writes{0};
+static std::atomic<uint64_t> snapshot_write_failures{0};
+static std::atomic<int64_t> last_write_unix{0};
+
+static std::mutex writer_mutex;
+static std::condition_variable writer_cv;
+static std::thread writer_thread;
+static bool writer_stopping = false;
+
+std::chrono::system_clock::time_point toWallClock(std::chrono::steady_clock::time_point timestamp) {
+    auto age = std::chrono::steady_clock::now() - timestamp;
+    return std::chrono::system_clock::now() - std::chrono::duration_cast<std::chrono::system_clock::duration>(age);
+}
+
+std::chrono::steady_clock::time_point toSteadyClock(std::chrono::system_clock::time_point timestamp) {
+    auto age = std::chrono::system_clock::now() - timestamp;
+    return std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(age);
+}
+
+void registerPersistentCache(const std::string& name, SnapshotExporter exporter) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    exporters.emplace_back(name, std::move(exporter));
+}
+
+// --- Helper: Map a Snapshot File ---
+// A truncated or foreign file is rejected as a whole. For a key stored more
+// than once, the most recently written record wins.
+static MappedSnapshotPtr mapSnapshotFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto snapshot = std::make_shared<MappedSnapshot>();
+    snapshot->size = static_cast<size_t>(st.st_size);
+    snapshot->identity = identityOf(st);
+    snapshot->data = mmap(nullptr, snapshot->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snapshot->data == MAP_FAILED) return nullptr;
+
+    const char* base = static_cast<const char*>(snapshot->data);
+    FileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+        std::cerr << "Ignoring cache snapshot " << path << ": not a snapshot file." << std::endl;
+        return nullptr;
+    }
+
+    size_t offset = sizeof(FileHeader);
+    for (uint32_t i = 0; i < header.recordCount; ++i) {
+        RecordHeader record;
+        if (snapshot->size - offset < sizeof(record)) break;
+        std::memcpy(&record, base + offset, sizeof(record));
+        offset += sizeof(record);
+        size_t length = size_t{record.nameLength} + record.keyLength + record.payloadLength;
+        if (snapshot->size - offset < length) {
+            std::cerr << "Ignoring cache snapshot " << path << ": truncated." << std::endl;
+            return nullptr;
+        }
+
+        std::string key = std::string(base + offset, record.nameLength) + '\n' +
+                          std::string(base + offset + record.nameLength, record.keyLength);
+        MappedSnapshot::Record entry{
+            std::string_view(base + offset + record.nameLength + record.keyLength, record.payloadLength),
+            record.storedAtMs, record.expiresAtMs};
+        auto [it, inserted] = snapshot->index.emplace(std::move(key), entry);
+        if (!inserted && it->second.storedAtMs < entry.storedAtMs) it->second = entry;
+        offset += length;
+    }
+    return snapshot;
+}
+
+static MappedSnapshotPtr currentSnapshot() {
+    std::lock_guard<std::mutex> lock(mapped_mutex);
+    return mapped_snapshot;
+}
+
+// Re-maps the file if another process replaced it since it was mapped.
+static void remapIfChanged() {
+    struct stat st {};
+    if (stat(snapshot_path.c_str(), &st) != 0) return;
+    MappedSnapshotPtr current = currentSnapshot();
+    if (current && current->identity == identityOf(st)) return;
+    if (MappedSnapshotPtr fresh = mapSnapshotFile(snapshot_path)) {
+        std::lock_guard<std::mutex> lock(mapped_mutex);
+        mapped_snapshot = std::move(fresh);
+    }
+}
+
+std::optional<PersistedEntry> lookupPersistent(const std::string& name, const std::string& key) {
+    if (!snapshots_enabled.load(std::memory_order_acquire)) return std::nullopt;
+    MappedSnapshotPtr snapshot = currentSnapshot();
+    if (!snapshot) return std::nullopt;
+
+    auto it = snapshot->index.find(indexKey(name, key));
+    if (it == snapshot->index.end()) return std::nullopt;
+    if (toUnixMs(std::chrono::system_clock::now()) >= it->second.expiresAtMs) return std::nullopt;
+    snapshot_hits.fetch_add(1, std::memory_order_relaxed);
+    return PersistedEntry{std::string(it->second.payload), fromUnixMs(it->second.storedAtMs),
+                          fromUnixMs(it->second.expiresAtMs)};
+}
+
+// --- Snapshot Writer ---
+// Live entries first, then the still-valid records of the mapped file that
+// are newer than (or missing from) this process's caches. Written to a
+// temporary file and renamed over the snapshot, so readers never see a
+// partial file.
+static bool writeSnapshot() {
+    std::string tmpPath = snapshot_path + ".tmp." + std::to_string(getpid());
+    FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+
+    FileHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    std::unordered_map<std::string, int64_t> written;  // indexKey -> storedAtMs
+    int64_t nowMs = toUnixMs(std::chrono::system_clock::now());
+    auto writeRecord = [&](const std::string& name, std::string_view key, std::string_view payload,
+                           int64_t storedAtMs, int64_t expiresAtMs) {
+        RecordHeader record{static_cast<uint32_t>(name.size()), static_cast<uint32_t>(key.size()),
+                            static_cast<uint32_t>(payload.size()), 0, storedAtMs, expiresAtMs};
+        ok = ok && std::fwrite(&record, sizeof(record), 1, file) == 1;
+        ok = ok && std::fwrite(name.data(), 1, name.size(), file) == name.size();
+        ok = ok && std::fwrite(key.data(), 1, key.size(), file) == key.size();
+        ok = ok && std::fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+        ++header.recordCount;
+    };
+
+    std::vector<std::pair<std::string, SnapshotExporter>> caches;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        caches = exporters;
+    }
+    for (const auto& [name, exporter] : caches) {
+        const std::string& cacheName = name;
+        exporter([&](const std::string& key, const std::string& payload,
+                     std::chrono::system_clock::time_point storedAt, std::chrono::seconds ttl) {
+            int64_t storedAtMs = toUnixMs(storedAt);
+            int64_t expiresAtMs = toUnixMs(storedAt + ttl);
+            if (expiresAtMs <= nowMs) return;
+            writeRecord(cacheName, key, payload, storedAtMs, expiresAtMs);
+            written[indexKey(cacheName, key)] = storedAtMs;
+        });
+    }
+
+    if (MappedSnapshotPtr previous = currentSnapshot()) {
+        for (const auto& [fullKey, record] : previous->index) {
+            if (record.expiresAtMs <= nowMs) continue;
+            auto it = written.find(fullKey);
+            if (it != written.end() && it->second >= record.storedAtMs) continue;
+            size_t split = fullKey.find('\n');
+            writeRecord(fullKey.substr(0, split), std::string_view(fullKey).substr(split + 1), record.payload,
+                        record.storedAtMs, record.expiresAtMs);
+        }
+    }
+
+    ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || std::rename(tmpPath.c_str(), snapshot_path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    if (MappedSnapshotPtr fresh = mapSnapshotFile(snapshot_path)) {
+        std::lock_guard<std::mutex> lock(mapped_mutex);
+        mapped_snapshot = std::move(fresh);
+    }
+    return true;
+}
+
+static void runSnapshotWrite() {
+    remapIfChanged();
+    if (writeSnapshot()) {
+        snapshot_writes.fetch_add(1, std::memory_order_relaxed);
+        last_write_unix.store(toUnixMs(std::chrono::system_clock::now()) / 1000, std::memory_order_relaxed);
+    } else {
+        snapshot_write_failures.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Failed to write cache snapshot " << snapshot_path << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+void startCacheSnapshots(const std::string& path, int intervalSeconds) {
+    if (writer_thread.joinable() || path.empty()) return;
+    snapshot_path = path;
+    remapIfChanged();
+    snapshots_enabled.store(true, std::memory_order_release);
+    if (MappedSnapshotPtr snapshot = currentSnapshot()) {
+        std::cout << "Loaded cache snapshot " << path << " (" << snapshot->index.size() << " entries)." << std::endl;
+    }
+
+    writer_thread = std::thread([intervalSeconds] {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(writer_mutex);
+                writer_cv.wait_for(lock, std::chrono::seconds(intervalSeconds), [] { return writer_stopping; });
+                if (writer_stopping) return;
+            }
+            runSnapshotWrite();
+        }
+    });
+}
+
+// Writes a final snapshot so the next start (e.g. after a deploy) is warm.
+void stopCacheSnapshots() {
+    if (!writer_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        writer_stopping = true;
+    }
+    writer_cv.notify_all();
+    writer_thread.join();
+    runSnapshotWrite();
+}
+
+SnapshotStoreStats getSnapshotStoreStats() {
+    SnapshotStoreStats stats;
+    stats.enabled = snapshots_enabled.load(std::memory_order_relaxed);
+    if (MappedSnapshotPtr snapshot = currentSnapshot()) {
+        stats.entries = snapshot->index.size();
+        stats.bytes = snapshot->size;
+    }
+    stats.hits = snapshot_hits.load(std::memory_order_relaxed);
+    stats.writes = snapshot_writes.load(std::memory_order_relaxed);
+    stats.writeFailures = snapshot_write_failures.load(std::memory_order_relaxed);
+    stats.lastWriteUnix = last_write_unix.load(std::memory_order_relaxed);
+    return stats;
+}
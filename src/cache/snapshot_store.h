@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+
+// --- Persistent Cache Tier ---
+// An optional second tier behind the in-process caches. Every interval the
+// live entries of each registered cache are written to one snapshot file,
+// together with the entries of the current file that are still valid (so
+// replicas sharing the file add to it instead of replacing each other's
+// entries). The file is memory-mapped at startup and re-mapped whenever
+// another process replaces it; a cache miss looks there before going
+// upstream. Every record carries its write time and TTL.
+
+struct PersistedEntry {
+    std::string payload;
+    std::chrono::system_clock::time_point storedAt;
+    std::chrono::system_clock::time_point expiresAt;
+};
+
+// Writes one entry into the snapshot being built; ttl counts from storedAt.
+using SnapshotWriter = std::function<void(const std::string& key, const std::string& payload,
+                                          std::chrono::system_clock::time_point storedAt,
+                                          std::chrono::seconds ttl)>;
+using SnapshotExporter = std::function<void(const SnapshotWriter& write)>;
+
+struct SnapshotStoreStats {
+    bool enabled = false;
+    size_t entries = 0;          // Records in the mapped file
+    size_t bytes = 0;            // Size of the mapped file
+    uint64_t hits = 0;           // Misses in memory answered from the file
+    uint64_t writes = 0;
+    uint64_t writeFailures = 0;
+    int64_t lastWriteUnix = 0;
+};
+
+// Called before startCacheSnapshots; name separates the caches inside the file.
+void registerPersistentCache(const std::string& name, SnapshotExporter exporter);
+std::optional<PersistedEntry> lookupPersistent(const std::string& name, const std::string& key);
+
+// Maps an existing snapshot right away, then writes one every intervalSeconds
+// and once more on stop.
+void startCacheSnapshots(const std::string& path, int intervalSeconds);
+void stopCacheSnapshots();
+SnapshotStoreStats getSnapshotStoreStats();
+
+// Converts between the wall clock used on disk and the caches' steady clock.
+std::chrono::system_clock::time_point toWallClock(std::chrono::steady_clock::time_point timestamp);
+std::chrono::steady_clock::time_point toSteadyClock(std::chrono::system_clock::time_point timestamp);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 #include <optional>
@@ -12,33 +13,142 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
-#include <regex>
 #include <iostream>
 #include <locale>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 
+// --- Provider Endpoint Overrides (e.g. the load generator's mock upstream) ---
+inline std::string getEnvString(const char* name, const std::string& fallback) {
+    const char* val = std::getenv(name);
+    return val && val[0] != '\0' ? std::string(val) : fallback;
+}
+
+inline std::vector<std::string> getEnvList(const char* name, const std::vector<std::string>& fallback) {
+    const char* val = std::getenv(name);
+    if (!val || val[0] == '\0') return fallback;
+    std::vector<std::string> items;
+    std::stringstream stream(val);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items.empty() ? fallback : items;
+}
+
 // --- Configuration Constants ---
-inline const std::string Provider_DM_URL = "https://projekte.kvv-efa.de/sl3-alone/XSLT_DM_REQUEST";
-inline const std::string Provider_SEARCH_URL = "https://projekte.kvv-efa.de/sl3-alone/XSLT_STOPFINDER_REQUEST";
+inline const std::string Provider_DM_URL =
+    getEnvString("PROVIDER_DM_URL", "https://projekte.kvv-efa.de/sl3-alone/XSLT_DM_REQUEST");
+inline const std::string Provider_SEARCH_URL =
+    getEnvString("PROVIDER_SEARCH_URL", "https://projekte.kvv-efa.de/sl3-alone/XSLT_STOPFINDER_REQUEST");
 inline const std::string DB_CONFIG_PATH = "db_connection.txt";
 inline const std::string DB_CONFIG_CONTAINER_PATH = "/config/db_connection.txt";
 inline constexpr long UPSTREAM_TIMEOUT_SECONDS = 15;
+inline constexpr size_t UPSTREAM_MAX_IDLE_SESSIONS = 16;
+inline constexpr long UPSTREAM_DNS_CACHE_SECONDS = 300;
+inline constexpr long UPSTREAM_MAX_HOST_CONNECTIONS = 64;  // Further transfers queue in the event loop
+inline constexpr size_t UPSTREAM_COMPLETION_THREADS = 4;
+inline constexpr int UPSTREAM_LOOP_POLL_MS = 1000;
+inline constexpr size_t UPSTREAM_BREAKER_WINDOW = 20;          // Recent calls per host the breaker looks at
+inline constexpr size_t UPSTREAM_BREAKER_MIN_CALLS = 10;
+inline constexpr size_t UPSTREAM_BREAKER_FAILURE_PERCENT = 50; // Failed share of the window that opens the circuit
+inline constexpr long UPSTREAM_BREAKER_SLOW_MS = 5000;         // Slower answers count as failures
+inline constexpr int UPSTREAM_BREAKER_OPEN_SECONDS = 10;
+inline constexpr size_t UPSTREAM_BREAKER_HALF_OPEN_PROBES = 3; // Successful probes that close it again
+inline constexpr size_t UPSTREAM_LATENCY_WINDOW = 128;         // Recent latencies the adaptive timeout uses
+inline constexpr size_t UPSTREAM_ADAPTIVE_MIN_SAMPLES = 20;
+inline constexpr long UPSTREAM_ADAPTIVE_TIMEOUT_FACTOR = 3;    // Timeout = factor x recent p99
+inline constexpr long UPSTREAM_MIN_TIMEOUT_MS = 1000;
+inline constexpr long UPSTREAM_THROTTLED_PAUSE_MS = 1000;     // Budget paused after a 429 from the provider
 inline constexpr size_t MAX_QUERY_LENGTH = 200;
 inline constexpr size_t MAX_STOPID_LENGTH = 100;
 inline constexpr int CACHE_TTL_SECONDS = 30;
 inline constexpr size_t MAX_CACHE_ENTRIES = 10000;
+inline constexpr size_t DEPARTURE_DELTA_VERSIONS = 4;  // Earlier versions per stop that since= can diff against
+inline constexpr int SEARCH_CACHE_TTL_SECONDS = 600;
+inline constexpr size_t MAX_SEARCH_CACHE_ENTRIES = 5000;
+inline constexpr int NOTIFICATION_CACHE_TTL_SECONDS = 60;
+inline constexpr size_t MAX_NOTIFICATION_CACHE_ENTRIES = 10000;
+inline constexpr long NOTIFICATION_DEADLINE_MS = 5000;
+inline constexpr size_t NOTIFICATION_FANOUT_THREADS = 16;
+inline constexpr size_t MAX_BATCH_STOPS = 20;
+inline constexpr size_t MAX_STREAM_STOPS = 20;        // Stops one stream client may subscribe to
+inline constexpr size_t MAX_STREAM_CLIENTS = 10000;
+inline constexpr size_t MAX_STREAM_MESSAGE_BYTES = 4096;
+inline constexpr long STREAM_POLL_MS = 1000;          // How often cached stops are checked for changes
+inline constexpr int STREAM_TICK_SECONDS = 60;
+inline constexpr uint32_t MAX_METRIC_SLOTS = 8192;  // Per thread, 8 bytes each
+inline constexpr int REFRESH_LEAD_SECONDS = 5;
+inline constexpr int REFRESH_DECAY_INTERVAL_SECONDS = 60;
+inline constexpr size_t STOP_WRITE_BATCH_SIZE = 200;
+inline constexpr long STOP_WRITE_FLUSH_MS = 500;
+inline constexpr size_t STOP_WRITE_QUEUE_LIMIT = 10000;
+inline constexpr int STOP_WRITE_DEDUPE_SECONDS = 3600;
+inline constexpr size_t MAX_RECENT_STOP_WRITES = 50000;
+inline constexpr int AUTH_CACHE_TTL_SECONDS = 60;
+inline constexpr int AUTH_NEGATIVE_CACHE_TTL_SECONDS = 10;
+inline constexpr size_t MAX_AUTH_CACHE_ENTRIES = 10000;
+inline constexpr size_t MAX_WARMUP_STOPS = 100;       // Departures prefetched during warm-up
+inline constexpr size_t MAX_RATE_LIMIT_BUCKETS = 50000;  // Tracked API keys / client addresses
+inline constexpr int LAST_USED_FLUSH_SECONDS = 60;
+inline constexpr size_t SEARCH_LOCAL_MAX_RESULTS = 30;
+inline constexpr double SEARCH_FUZZY_MIN_CONTAINMENT = 0.8;
+inline constexpr double SEARCH_FUZZY_MIN_TOKEN_SIMILARITY = 0.5;  // Trigram Jaccard each query token needs
+inline constexpr size_t MAX_KNOWN_SEARCH_QUERIES = 50000;
 
-inline const std::vector<std::string> NOTIFICATION_API_PROVIDERS = {
+// Base URLs; XML_ADDINFO_REQUEST is appended
+inline const std::vector<std::string> NOTIFICATION_API_PROVIDERS = getEnvList("NOTIFICATION_PROVIDER_URLS", {
     "https://www.efa-bw.de/nvbw/",
     "https://efa.vrr.de/standard/"
+});
+
+// --- Departure Refresh Configuration ---
+struct DepartureRefreshConfig {
+    int staleSeconds = 30;      // Serve expired entries this long while one refresh runs (0 = off)
+    size_t hotStopCount = 0;    // Most requested stops refreshed before expiry (0 = refresher off)
+    size_t concurrency = 2;     // Background refreshes running at once
+    int staleIfErrorSeconds = 300;  // Serve expired entries this long when upstream fails (0 = off)
+    size_t trackBuckets = 8;    // Filtered bodies kept per entry, one per requested track (0 = off)
+    int jitterSeconds = 5;      // Refresh deadlines spread up to this much earlier, per stop
+};
+
+// --- Response Compression Configuration ---
+struct CompressionConfig {
+    int gzipLevel = 6;       // 1-9 (0 = gzip off)
+    int brotliQuality = 5;   // 1-11 (0 = brotli off)
+    int zstdLevel = 3;       // 1-19 (0 = zstd off)
+    size_t minBytes = 1024;  // Smaller bodies are sent uncompressed
+};
+
+// --- Rate Limiting and Admission Configuration ---
+struct AdmissionConfig {
+    long rateLimitPerSecond = 0;  // Requests per second per API key (0 = off)
+    long rateLimitBurst = 0;      // Bucket size (0 = twice the rate)
+    size_t maxUpstream = 256;     // Client-initiated provider fetches in flight (0 = unlimited)
+    size_t maxBlocking = 0;       // Provider calls holding a server worker (0 = half the workers)
+};
+
+// --- Upstream Scheduler Configuration ---
+struct UpstreamSchedulerConfig {
+    long requestsPerSecond = 0;  // Per provider host (0 = unlimited, requests go out immediately)
+    long burst = 0;              // Requests a host may receive at once (0 = one second's budget)
+    size_t maxQueued = 500;      // Requests waiting per host before the lowest priority one is dropped
 };
 
-// --- Cache Structure ---
-struct CacheEntry {
-    json data;
-    std::chrono::steady_clock::time_point timestamp;
+// --- Request Tracing Configuration ---
+struct TracingConfig {
+    bool enabled = false;        // Trace every request with per-stage spans
+    long slowMs = 1000;          // Requests taking at least this long go to the slow log
+    long slowLogPerSecond = 5;   // Slow log lines per second at most (0 = no slow log)
+    bool serverTiming = false;   // Send the spans back in a Server-Timing header
+};
+
+// --- Startup Warm-up Configuration ---
+struct WarmupConfig {
+    std::vector<std::string> stops;  // Departures prefetched before the instance reports ready
+    int budgetSeconds = 20;          // Ready after this even if some warm-up tasks are still running
+    bool preloadApiKeys = false;     // Wait for the API key cache preload (set from AUTH in main)
 };
 
 // --- Database Configuration ---
@@ -69,10 +179,22 @@ inline std::string trim(const std::string& input) {
 }
 
 // --- Input Validation ---
+// Stop IDs match ^[a-zA-Z0-9:_. -]+$, checked with a lookup table
+inline constexpr std::array<bool, 256> STOP_ID_CHARS = [] {
+    std::array<bool, 256> table{};
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = true;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+    for (int c = '0'; c <= '9'; ++c) table[c] = true;
+    for (char c : {':', '_', '.', ' ', '-'}) table[static_cast<unsigned char>(c)] = true;
+    return table;
+}();
+
 inline bool isValidStopId(const std::string& stopId) {
     if (stopId.empty() || stopId.size() > MAX_STOPID_LENGTH) return false;
-    static const std::regex stopIdPattern("^[a-zA-Z0-9:_. -]+$");
-    return std::regex_match(stopId, stopIdPattern);
+    for (unsigned char c : stopId) {
+        if (!STOP_ID_CHARS[c]) return false;
+    }
+    return true;
 }
 
 inline bool isValidSearchQuery(const std::string& query) {
@@ -83,18 +205,6 @@ inline bool isValidSearchQuery(const std::string& query) {
     return true;
 }
 
-// --- Cache Eviction (caller must hold the appropriate mutex) ---
-inline void evictExpiredCacheEntries(std::map<std::string, CacheEntry>& cache) {
-    auto now = std::chrono::steady_clock::now();
-    for (auto it = cache.begin(); it != cache.end(); ) {
-        if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second.timestamp).count() >= CACHE_TTL_SECONDS) {
-            it = cache.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
 // --- JSON Utilities ---
 inline std::optional<std::string> jsonToString(const json& value) {
     if (value.is_string()) return value.get<std::string>();
@@ -137,6 +247,95 @@ inline std::string formatDouble(double value) {
     return stream.str();
 }
 
+// --- Environment Utilities ---
+// Reads a non-negative integer from the environment; falls back to the default
+// when the variable is unset, not all digits, or outside [minValue, maxValue].
+inline long getEnvLong(const char* name, long fallback, long minValue, long maxValue) {
+    const char* val = std::getenv(name);
+    if (!val || val[0] == '\0') return fallback;
+    std::string raw(val);
+    bool allDigits = std::all_of(raw.begin(), raw.end(),
+                                 [](unsigned char c){ return std::isdigit(c) != 0; });
+    if (!allDigits || raw.size() > 18) {
+        std::cerr << "Invalid " << name << " value, using default " << fallback << "." << std::endl;
+        return fallback;
+    }
+    long parsed = std::stol(raw);
+    if (parsed < minValue || parsed > maxValue) {
+        std::cerr << name << " out of range (" << minValue << "-" << maxValue
+                  << "), using default " << fallback << "." << std::endl;
+        return fallback;
+    }
+    return parsed;
+}
+
+inline DepartureRefreshConfig loadRefreshConfigFromEnv() {
+    DepartureRefreshConfig config;
+    config.staleSeconds = static_cast<int>(getEnvLong("CACHE_STALE_SECONDS", config.staleSeconds, 0, 3600));
+    config.hotStopCount = static_cast<size_t>(getEnvLong("REFRESH_HOT_STOPS", 0, 0, 1000));
+    config.concurrency = static_cast<size_t>(getEnvLong("REFRESH_CONCURRENCY", 2, 1, 64));
+    config.staleIfErrorSeconds = static_cast<int>(
+        getEnvLong("CACHE_STALE_IF_ERROR_SECONDS", config.staleIfErrorSeconds, 0, 86400));
+    config.trackBuckets = static_cast<size_t>(getEnvLong("CACHE_TRACK_BUCKETS", 8, 0, 64));
+    // At most half the lead-adjusted TTL, so no stop falls due while its entry is still new
+    config.jitterSeconds = static_cast<int>(getEnvLong("REFRESH_JITTER_SECONDS", config.jitterSeconds, 0,
+                                                       (CACHE_TTL_SECONDS - REFRESH_LEAD_SECONDS) / 2));
+    return config;
+}
+
+inline CompressionConfig loadCompressionConfigFromEnv() {
+    CompressionConfig config;
+    config.gzipLevel = static_cast<int>(getEnvLong("COMPRESSION_GZIP_LEVEL", config.gzipLevel, 0, 9));
+    config.brotliQuality = static_cast<int>(getEnvLong("COMPRESSION_BROTLI_QUALITY", config.brotliQuality, 0, 11));
+    config.zstdLevel = static_cast<int>(getEnvLong("COMPRESSION_ZSTD_LEVEL", config.zstdLevel, 0, 19));
+    config.minBytes = static_cast<size_t>(getEnvLong("COMPRESSION_MIN_BYTES", 1024, 0, 1 << 20));
+    return config;
+}
+
+inline AdmissionConfig loadAdmissionConfigFromEnv() {
+    AdmissionConfig config;
+    config.rateLimitPerSecond = getEnvLong("RATE_LIMIT_PER_SECOND", 0, 0, 100000);
+    config.rateLimitBurst = getEnvLong("RATE_LIMIT_BURST", 0, 0, 1000000);
+    config.maxUpstream = static_cast<size_t>(getEnvLong("ADMISSION_MAX_UPSTREAM", 256, 0, 100000));
+    config.maxBlocking = static_cast<size_t>(getEnvLong("ADMISSION_MAX_BLOCKING", 0, 0, 10000));
+    return config;
+}
+
+inline UpstreamSchedulerConfig loadUpstreamSchedulerConfigFromEnv() {
+    UpstreamSchedulerConfig config;
+    config.requestsPerSecond = getEnvLong("UPSTREAM_RPS", 0, 0, 10000);
+    config.burst = getEnvLong("UPSTREAM_BURST", 0, 0, 100000);
+    config.maxQueued = static_cast<size_t>(getEnvLong("UPSTREAM_QUEUE_MAX", 500, 1, 100000));
+    return config;
+}
+
+inline TracingConfig loadTracingConfigFromEnv() {
+    TracingConfig config;
+    config.enabled = getEnvLong("TRACING", 0, 0, 1) == 1;
+    config.slowMs = getEnvLong("TRACE_SLOW_MS", config.slowMs, 0, 600000);
+    config.slowLogPerSecond = getEnvLong("TRACE_SLOW_LOG_PER_SECOND", config.slowLogPerSecond, 0, 1000);
+    config.serverTiming = getEnvLong("TRACE_SERVER_TIMING", 0, 0, 1) == 1;
+    return config;
+}
+
+inline WarmupConfig loadWarmupConfigFromEnv() {
+    WarmupConfig config;
+    config.budgetSeconds = static_cast<int>(getEnvLong("WARMUP_BUDGET_SECONDS", config.budgetSeconds, 0, 600));
+    for (const auto& item : getEnvList("WARMUP_STOPS", {})) {
+        std::string stopId = trim(item);
+        if (!isValidStopId(stopId)) {
+            std::cerr << "Ignoring invalid WARMUP_STOPS entry: " << stopId << std::endl;
+            continue;
+        }
+        if (config.stops.size() == MAX_WARMUP_STOPS) {
+            std::cerr << "WARMUP_STOPS lists more than " << MAX_WARMUP_STOPS << " stops, ignoring the rest." << std::endl;
+            break;
+        }
+        config.stops.push_back(stopId);
+    }
+    return config;
+}
+
 // --- Database Config Loading from Environment Variables ---
 inline std::optional<DbConfig> loadDbConfigFromEnv() {
     auto getEnv = [](const char* name) -> std::string {
@@ -0,0 +1,144 @@
+#include "connection_pool.h"
+#include <algorithm>
+#include <iostream>
+
+static constexpr std::chrono::milliseconds INITIAL_BACKOFF{250};
+static constexpr std::chrono::milliseconds MAX_BACKOFF{30000};
+
+void PooledConnection::release() {
+    if (pool_ && conn_) pool_->release(conn_);
+    pool_ = nullptr;
+    conn_ = nullptr;
+}
+
+ConnectionPool::ConnectionPool(Connector connector, PoolConfig config)
+    : connector_(std::move(connector)), config_(config) {
+    if (config_.maxSize == 0) config_.maxSize = 1;
+    config_.minSize = std::min(config_.minSize, config_.maxSize);
+}
+
+ConnectionPool::~ConnectionPool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : idle_) PQfinish(entry.conn);
+    idle_.clear();
+}
+
+// --- Helper: Liveness Ping ---
+bool ConnectionPool::isHealthy(PGconn* conn) {
+    if (PQstatus(conn) != CONNECTION_OK) return false;
+    PGresult* res = PQexec(conn, "SELECT 1");
+    bool ok = res && PQresultStatus(res) == PGRES_TUPLES_OK;
+    if (res) PQclear(res);
+    return ok;
+}
+
+// --- Helper: Open a Connection (caller has reserved a slot in open_) ---
+PGconn* ConnectionPool::openConnection() {
+    PGconn* conn = connector_();
+    if (conn && PQstatus(conn) == CONNECTION_OK) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        backoff_ = std::chrono::milliseconds(0);
+        return conn;
+    }
+
+    if (conn) {
+        std::cerr << "Database connection failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+    } else {
+        std::cerr << "Database connection returned null" << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --open_;
+    ++connectFailures_;
+    backoff_ = backoff_.count() == 0 ? INITIAL_BACKOFF : std::min(backoff_ * 2, MAX_BACKOFF);
+    nextAttempt_ = Clock::now() + backoff_;
+    available_.notify_one();
+    return nullptr;
+}
+
+PooledConnection ConnectionPool::acquire() {
+    auto deadline = Clock::now() + std::chrono::milliseconds(config_.acquireTimeoutMs);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;) {
+        while (!idle_.empty()) {
+            IdleConnection entry = idle_.back();
+            idle_.pop_back();
+
+            bool needsPing = Clock::now() - entry.returnedAt >= std::chrono::seconds(config_.healthCheckIdleSeconds);
+            if (!needsPing && PQstatus(entry.conn) == CONNECTION_OK) {
+                ++checkouts_;
+                return PooledConnection(this, entry.conn);
+            }
+
+            // Ping (or reset) outside the lock; other callers keep going meanwhile
+            lock.unlock();
+            bool healthy = isHealthy(entry.conn);
+            if (!healthy) {
+                PQreset(entry.conn);
+                healthy = PQstatus(entry.conn) == CONNECTION_OK;
+            }
+            lock.lock();
+
+            if (healthy) {
+                ++checkouts_;
+                return PooledConnection(this, entry.conn);
+            }
+            PQfinish(entry.conn);
+            --open_;
+        }
+
+        if (open_ < config_.maxSize) {
+            if (Clock::now() < nextAttempt_) return PooledConnection();  // Backing off
+            ++open_;
+            lock.unlock();
+            PGconn* conn = openConnection();
+            if (!conn) return PooledConnection();
+            lock.lock();
+            ++checkouts_;
+            return PooledConnection(this, conn);
+        }
+
+        if (available_.wait_until(lock, deadline) == std::cv_status::timeout &&
+            idle_.empty() && open_ >= config_.maxSize) {
+            ++timeouts_;
+            return PooledConnection();
+        }
+    }
+}
+
+void ConnectionPool::release(PGconn* conn) {
+    // Anything not idle and OK (e.g. an aborted transaction) is not reusable
+    bool reusable = PQstatus(conn) == CONNECTION_OK && PQtransactionStatus(conn) == PQTRANS_IDLE;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reusable) {
+        idle_.push_back({conn, Clock::now()});
+    } else {
+        PQfinish(conn);
+        --open_;
+    }
+    available_.notify_one();
+}
+
+// --- Open minSize connections up front ---
+void ConnectionPool::prewarm() {
+    std::vector<PooledConnection> warmed;
+    for (size_t i = 0; i < config_.minSize; ++i) {
+        PooledConnection conn = acquire();
+        if (!conn) break;
+        warmed.push_back(std::move(conn));
+    }
+}
+
+PoolStats ConnectionPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PoolStats s;
+    s.open = open_;
+    s.idle = idle_.size();
+    s.checkouts = checkouts_;
+    s.timeouts = timeouts_;
+    s.connectFailures = connectFailures_;
+    return s;
+}
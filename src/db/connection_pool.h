@@ -0,0 +1,114 @@
+#pragma once
+
+#include <libpq-fe.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class ConnectionPool;
+
+// --- Pool Sizing ---
+struct PoolConfig {
+    size_t minSize = 1;
+    size_t maxSize = 8;
+    long acquireTimeoutMs = 2000;   // Wait this long for a free connection when at maxSize
+    long healthCheckIdleSeconds = 30; // Ping connections idle longer than this on checkout
+};
+
+struct PoolStats {
+    size_t open = 0;
+    size_t idle = 0;
+    uint64_t checkouts = 0;
+    uint64_t timeouts = 0;
+    uint64_t connectFailures = 0;
+};
+
+// --- Checked-out Connection (returned to the pool on destruction) ---
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, PGconn* conn) : pool_(pool), conn_(conn) {}
+    ~PooledConnection() { release(); }
+
+    PooledConnection(PooledConnection&& other) noexcept
+        : pool_(other.pool_), conn_(other.conn_) {
+        other.pool_ = nullptr;
+        other.conn_ = nullptr;
+    }
+
+    PooledConnection& operator=(PooledConnection&& other) noexcept {
+        if (this != &other) {
+            release();
+            pool_ = other.pool_;
+            conn_ = other.conn_;
+            other.pool_ = nullptr;
+            other.conn_ = nullptr;
+        }
+        return *this;
+    }
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    PGconn* get() const { return conn_; }
+    explicit operator bool() const { return conn_ != nullptr; }
+
+private:
+    void release();
+
+    ConnectionPool* pool_ = nullptr;
+    PGconn* conn_ = nullptr;
+};
+
+// --- Bounded libpq Connection Pool ---
+// Connections are opened on demand up to maxSize and reused afterwards.
+// Broken connections are dropped on return; failed connects back off
+// exponentially so an unreachable database fails fast instead of stalling
+// every request on a TCP/TLS handshake.
+class ConnectionPool {
+public:
+    using Connector = std::function<PGconn*()>;
+
+    ConnectionPool(Connector connector, PoolConfig config);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    PooledConnection acquire();
+    void prewarm();
+    PoolStats stats() const;
+    const PoolConfig& config() const { return config_; }
+
+private:
+    friend class PooledConnection;
+    using Clock = std::chrono::steady_clock;
+
+    struct IdleConnection {
+        PGconn* conn;
+        Clock::time_point returnedAt;
+    };
+
+    void release(PGconn* conn);
+    PGconn* openConnection();
+    static bool isHealthy(PGconn* conn);
+
+    Connector connector_;
+    PoolConfig config_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector<IdleConnection> idle_;
+    size_t open_ = 0;  // Idle + checked out + being opened
+
+    std::chrono::milliseconds backoff_{0};
+    Clock::time_point nextAttempt_{};
+
+    uint64_t checkouts_ = 0;
+    uint64_t timeouts_ = 0;
+    uint64_t connectFailures_ = 0;
+};
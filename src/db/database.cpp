@@ -1,4 +1,5 @@
 #include "database.h"
+#include <iostream>
 
 bool Database::loadConfig(const std::string& path) {
     config_ = loadDbConfig(path);
@@ -33,3 +34,38 @@ PGconn* Database::connect() const {
 const DbConfig& Database::config() const {
     return *config_;
 }
+
+// --- Connection Pool ---
+static PoolConfig loadPoolConfigFromEnv() {
+    PoolConfig cfg;
+    cfg.maxSize = static_cast<size_t>(getEnvLong("DB_POOL_MAX", 8, 1, 256));
+    cfg.minSize = static_cast<size_t>(getEnvLong("DB_POOL_MIN", 1, 0, static_cast<long>(cfg.maxSize)));
+    cfg.acquireTimeoutMs = getEnvLong("DB_POOL_TIMEOUT_MS", 2000, 0, 60000);
+    return cfg;
+}
+
+ConnectionPool& Database::pool() const {
+    std::call_once(poolOnce_, [this] {
+        pool_ = std::make_unique<ConnectionPool>([this] { return connect(); }, loadPoolConfigFromEnv());
+    });
+    return *pool_;
+}
+
+PooledConnection Database::acquire() const {
+    if (!config_) return PooledConnection();
+    return pool().acquire();
+}
+
+void Database::prewarmPool() const {
+    if (!config_) return;
+    auto& p = pool();
+    p.prewarm();
+    auto s = p.stats();
+    std::cout << "Database pool ready: " << s.open << " open (min " << p.config().minSize
+              << ", max " << p.config().maxSize << ")" << std::endl;
+}
+
+PoolStats Database::poolStats() const {
+    if (!config_) return PoolStats();
+    return pool().stats();
+}
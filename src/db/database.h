@@ -1,7 +1,10 @@
 #pragma once
 
 #include "../config/config.h"
+#include "connection_pool.h"
 #include <libpq-fe.h>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <optional>
 
@@ -13,6 +16,15 @@ public:
     PGconn* connect() const;
     const DbConfig& config() const;
 
+    // Pooled checkout; an empty handle means no connection is available
+    PooledConnection acquire() const;
+    void prewarmPool() const;
+    PoolStats poolStats() const;
+
 private:
+    ConnectionPool& pool() const;
+
     std::optional<DbConfig> config_;
+    mutable std::once_flag poolOnce_;
+    mutable std::unique_ptr<ConnectionPool> pool_;
 };
@@ -0,0 +1,46 @@
+#include "admission.h"
+#include <atomic>
+#include <thread>
+
+struct AdmissionGate {
+    const char* name;
+    size_t limit = 0;
+    std::atomic<size_t> inFlight{0};
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> shed{0};
+};
+
+// Limits are set once in main() before app.run().
+static AdmissionGate admission_gates[] = {{"upstream"}, {"blocking"}};
+
+void configureAdmission(const AdmissionConfig& config) {
+    admission_gates[0].limit = config.maxUpstream;
+    // Crow's multithreaded() runs one worker per hardware thread
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    admission_gates[1].limit = config.maxBlocking > 0 ? config.maxBlocking : std::max<size_t>(1, workers / 2);
+}
+
+bool tryAdmit(AdmissionLane lane) {
+    AdmissionGate& gate = admission_gates[static_cast<size_t>(lane)];
+    size_t previous = gate.inFlight.fetch_add(1, std::memory_order_acq_rel);
+    if (gate.limit > 0 && previous >= gate.limit) {
+        gate.inFlight.fetch_sub(1, std::memory_order_acq_rel);
+        gate.shed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    gate.admitted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void releaseAdmission(AdmissionLane lane) {
+    admission_gates[static_cast<size_t>(lane)].inFlight.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+std::vector<AdmissionLaneStats> getAdmissionStats() {
+    std::vector<AdmissionLaneStats> stats;
+    for (const AdmissionGate& gate : admission_gates) {
+        stats.push_back({gate.name, gate.inFlight.load(std::memory_order_relaxed), gate.limit,
+                         gate.admitted.load(std::memory_order_relaxed), gate.shed.load(std::memory_order_relaxed)});
+    }
+    return stats;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../config/config.h"
+
+// --- Admission Control ---
+// Requests answered from a cache never pass a gate, so they are never queued
+// behind work that waits on a provider. That work takes a slot in one of two
+// lanes first and is shed (503 with Retry-After) when the lane is full:
+//   Upstream: client-initiated provider fetches in flight on the event loop.
+//             Coalesced waiters and background refreshes take no slot.
+//   Blocking: provider calls that hold a server worker while they wait, kept
+//             below the worker count so cached requests always find a worker.
+enum class AdmissionLane : uint8_t { Upstream, Blocking };
+
+struct AdmissionLaneStats {
+    const char* lane = "";
+    size_t inFlight = 0;
+    size_t limit = 0;       // 0 = unlimited
+    uint64_t admitted = 0;
+    uint64_t shed = 0;
+};
+
+void configureAdmission(const AdmissionConfig& config);
+bool tryAdmit(AdmissionLane lane);
+void releaseAdmission(AdmissionLane lane);
+std::vector<AdmissionLaneStats> getAdmissionStats();
+
+// Scoped slot for work that finishes on the thread that admitted it.
+class AdmissionSlot {
+public:
+    explicit AdmissionSlot(AdmissionLane lane) : lane_(lane), admitted_(tryAdmit(lane)) {}
+    ~AdmissionSlot() {
+        if (admitted_) releaseAdmission(lane_);
+    }
+
+    AdmissionSlot(const AdmissionSlot&) = delete;
+    AdmissionSlot& operator=(const AdmissionSlot&) = delete;
+
+    explicit operator bool() const { return admitted_; }
+
+private:
+    AdmissionLane lane_;
+    bool admitted_;
+};
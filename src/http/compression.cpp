@@ -0,0 +1,182 @@
+#include "compression.h"
+#include "../metrics/metrics.h"
+#include <memory>
+#include <vector>
+#include <zlib.h>
+#ifdef KVV_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef KVV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// compression_config is set once in main() before app.run().
+static CompressionConfig compression_config;
+
+void configureCompression(const CompressionConfig& config) {
+    compression_config = config;
+}
+
+const char* contentEncodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Brotli: return "br";
+        case ContentEncoding::Zstd: return "zstd";
+        case ContentEncoding::Gzip: return "gzip";
+        default: return "identity";
+    }
+}
+
+static bool encodingEnabled(ContentEncoding encoding) {
+    switch (encoding) {
+#ifdef KVV_HAVE_BROTLI
+        case ContentEncoding::Brotli: return compression_config.brotliQuality > 0;
+#endif
+#ifdef KVV_HAVE_ZSTD
+        case ContentEncoding::Zstd: return compression_config.zstdLevel > 0;
+#endif
+        case ContentEncoding::Gzip: return compression_config.gzipLevel > 0;
+        default: return false;
+    }
+}
+
+// --- Accept-Encoding Negotiation ---
+// Picks the enabled encoding with the highest q-value; "*" covers encodings
+// not listed, and q=0 rules one out.
+ContentEncoding negotiateEncoding(const std::string& acceptEncoding, size_t bodySize) {
+    if (acceptEncoding.empty() || bodySize < compression_config.minBytes) return ContentEncoding::Identity;
+
+    double quality[COMPRESSED_ENCODING_COUNT] = {-1, -1, -1};
+    double wildcard = -1;
+    size_t pos = 0;
+    while (pos < acceptEncoding.size()) {
+        size_t comma = acceptEncoding.find(',', pos);
+        if (comma == std::string::npos) comma = acceptEncoding.size();
+        std::string item = acceptEncoding.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        double q = 1;
+        size_t semicolon = item.find(';');
+        if (semicolon != std::string::npos) {
+            std::string params = toLower(trim(item.substr(semicolon + 1)));
+            if (params.rfind("q=", 0) == 0) {
+                try {
+                    q = std::stod(params.substr(2));
+                } catch (...) {
+                    q = 0;
+                }
+            }
+            item = item.substr(0, semicolon);
+        }
+        std::string name = toLower(trim(item));
+        if (name == "br") quality[0] = q;
+        else if (name == "zstd") quality[1] = q;
+        else if (name == "gzip" || name == "x-gzip") quality[2] = q;
+        else if (name == "*") wildcard = q;
+    }
+
+    ContentEncoding chosen = ContentEncoding::Identity;
+    double best = 0;
+    for (size_t i = 0; i < COMPRESSED_ENCODING_COUNT; ++i) {
+        auto encoding = static_cast<ContentEncoding>(i + 1);
+        double q = quality[i] >= 0 ? quality[i] : wildcard;
+        if (q > best && encodingEnabled(encoding)) {
+            best = q;
+            chosen = encoding;
+        }
+    }
+    return chosen;
+}
+
+// --- Encoders ---
+static std::string gzipCompress(const std::string& data, int level) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return "";
+
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END ? out : "";
+}
+
+#ifdef KVV_HAVE_BROTLI
+static std::string brotliCompress(const std::string& data, int quality) {
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    if (size == 0) return "";
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+                               reinterpret_cast<const uint8_t*>(data.data()), &size,
+                               reinterpret_cast<uint8_t*>(&out[0]))) {
+        return "";
+    }
+    out.resize(size);
+    return out;
+}
+#endif
+
+#ifdef KVV_HAVE_ZSTD
+// One compression context per thread, reused across bodies
+static std::string zstdCompress(const std::string& data, int level) {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    if (!context) return "";
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    size_t size = ZSTD_compressCCtx(context.get(), &out[0], out.size(), data.data(), data.size(), level);
+    if (ZSTD_isError(size)) return "";
+    out.resize(size);
+    return out;
+}
+#endif
+
+struct CompressionCounters {
+    MetricCounter runs;
+    MetricCounter bytesIn;
+    MetricCounter bytesOut;
+};
+
+static const CompressionCounters& compressionCounters(ContentEncoding encoding) {
+    static const std::vector<CompressionCounters> counters = [] {
+        std::vector<CompressionCounters> out;
+        for (size_t i = 0; i < COMPRESSED_ENCODING_COUNT; ++i) {
+            MetricLabels labels = {{"encoding", contentEncodingName(static_cast<ContentEncoding>(i + 1))}};
+            out.push_back({registerCounter("kvv_compression_runs_total", "Response bodies compressed.", labels),
+                           registerCounter("kvv_compression_input_bytes_total",
+                                           "Uncompressed size of compressed bodies.", labels),
+                           registerCounter("kvv_compression_output_bytes_total",
+                                           "Compressed size of compressed bodies.", labels)});
+        }
+        return out;
+    }();
+    return counters[static_cast<size_t>(encoding) - 1];
+}
+
+std::string compressBody(ContentEncoding encoding, const std::string& data) {
+    std::string out;
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            out = gzipCompress(data, compression_config.gzipLevel);
+            break;
+#ifdef KVV_HAVE_BROTLI
+        case ContentEncoding::Brotli:
+            out = brotliCompress(data, compression_config.brotliQuality);
+            break;
+#endif
+#ifdef KVV_HAVE_ZSTD
+        case ContentEncoding::Zstd:
+            out = zstdCompress(data, compression_config.zstdLevel);
+            break;
+#endif
+        default:
+            return "";
+    }
+
+    const CompressionCounters& counters = compressionCounters(encoding);
+    counters.runs.inc();
+    counters.bytesIn.inc(data.size());
+    counters.bytesOut.inc(out.size());
+    if (out.size() >= data.size()) return "";
+    return out;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "../config/config.h"
+
+// --- Response Compression ---
+// gzip is always available; brotli and zstd when the build found them
+// (KVV_HAVE_BROTLI, KVV_HAVE_ZSTD). Encodings are listed in server preference
+// order, which breaks ties between equal Accept-Encoding q-values.
+enum class ContentEncoding : uint8_t { Identity, Brotli, Zstd, Gzip };
+
+inline constexpr size_t COMPRESSED_ENCODING_COUNT = 3;  // Every encoding except Identity
+
+void configureCompression(const CompressionConfig& config);
+
+// Identity when the body is below the minimum size or nothing acceptable is enabled.
+ContentEncoding negotiateEncoding(const std::string& acceptEncoding, size_t bodySize);
+const char* contentEncodingName(ContentEncoding encoding);
+
+// Empty when compression failed or would not make the body smaller.
+std::string compressBody(ContentEncoding encoding, const std::string& data);
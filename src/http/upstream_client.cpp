@@ -0,0 +1,689 @@
+#include "upstream_client.h"
+#include "../metrics/metrics.h"
+#include "../util/thread_pool.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// --- Shared curl State (DNS, TLS sessions) ---
+// One share handle for every upstream transfer, guarded by one mutex per lock
+// kind. Connections are cached by the event loop's multi handle.
+namespace {
+std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+void lockShare(CURL*, curl_lock_data data, curl_lock_access, void*) {
+    share_locks[data].lock();
+}
+
+void unlockShare(CURL*, curl_lock_data data, void*) {
+    share_locks[data].unlock();
+}
+
+CURLSH* sharedCurlState() {
+    static CURLSH* share = [] {
+        CURLSH* handle = curl_share_init();
+        if (!handle) return handle;
+        curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        return handle;
+    }();
+    return share;
+}
+
+// --- Per-host Handle Pool ---
+// Easy handles are reused across transfers so each keeps its TLS session and
+// settings warm; only the event loop thread checks them out and in.
+struct HostPool {
+    std::mutex mutex;
+    std::vector<CURL*> idle;
+
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> newConnections{0};
+    std::atomic<uint64_t> reusedConnections{0};
+    std::atomic<uint64_t> http2Responses{0};
+    std::atomic<uint64_t> handshakeMicros{0};
+    std::atomic<size_t> queued{0};
+    std::atomic<uint64_t> throttled{0};
+    std::atomic<uint64_t> rateLimitedResponses{0};
+
+    // Circuit breaker and adaptive timeout, protected by healthMutex
+    std::mutex healthMutex;
+    CircuitState state = CircuitState::Closed;
+    std::chrono::steady_clock::time_point openedAt;
+    bool outcomes[UPSTREAM_BREAKER_WINDOW] = {};  // true = failed
+    size_t outcomeCount = 0;
+    size_t outcomeNext = 0;
+    size_t probesInFlight = 0;
+    size_t probeSuccesses = 0;
+    uint32_t latenciesMs[UPSTREAM_LATENCY_WINDOW] = {};
+    size_t latencyCount = 0;
+    size_t latencyNext = 0;
+    long adaptiveTimeoutMs = 0;  // 0 until enough samples
+    uint64_t circuitOpenings = 0;
+    uint64_t circuitRejections = 0;
+};
+
+std::mutex pools_mutex;
+std::map<std::string, std::unique_ptr<HostPool>> host_pools;
+
+HostPool& poolFor(const std::string& host) {
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    auto& pool = host_pools[host];
+    if (!pool) pool = std::make_unique<HostPool>();
+    return *pool;
+}
+
+size_t appendBody(char* data, size_t size, size_t count, void* userdata) {
+    static_cast<std::string*>(userdata)->append(data, size * count);
+    return size * count;
+}
+
+// Same defaults cpr applied to its sessions (user agent, redirects, no signals)
+CURL* createHandle() {
+    static const std::string userAgent = std::string("curl/") + curl_version_info(CURLVERSION_NOW)->version;
+    CURL* handle = curl_easy_init();
+    if (!handle) return handle;
+    // HTTP/2 over TLS where the provider offers it (ALPN), HTTP/1.1 otherwise
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+    if (CURLSH* share = sharedCurlState()) curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, userAgent.c_str());
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 50L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);  // Prefer multiplexing over a new connection
+    curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, static_cast<long>(UPSTREAM_DNS_CACHE_SECONDS));
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, appendBody);
+    return handle;
+}
+
+CURL* checkout(HostPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.idle.empty()) {
+            CURL* handle = pool.idle.back();
+            pool.idle.pop_back();
+            return handle;
+        }
+    }
+    return createHandle();
+}
+
+void checkin(HostPool& pool, CURL* handle) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.idle.size() < UPSTREAM_MAX_IDLE_SESSIONS) {
+            pool.idle.push_back(handle);
+            return;
+        }
+    }
+    curl_easy_cleanup(handle);
+}
+
+void recordTransfer(HostPool& pool, CURL* handle, const UpstreamResponse& r) {
+    pool.requests.fetch_add(1, std::memory_order_relaxed);
+    if (r.status_code == 0) {
+        pool.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    if (connects > 0) {
+        pool.newConnections.fetch_add(1, std::memory_order_relaxed);
+        curl_off_t appConnect = 0;
+        curl_off_t connect = 0;
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+        // APPCONNECT (TLS done) is 0 for plain HTTP; fall back to TCP connect time
+        curl_off_t setup = appConnect > 0 ? appConnect : connect;
+        pool.handshakeMicros.fetch_add(static_cast<uint64_t>(setup), std::memory_order_relaxed);
+    } else {
+        pool.reusedConnections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    long httpVersion = 0;
+    curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &httpVersion);
+    if (httpVersion == CURL_HTTP_VERSION_2_0) {
+        pool.http2Responses.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// --- Circuit Breaker ---
+// Closed: every call goes out; the circuit opens once at least
+// UPSTREAM_BREAKER_MIN_CALLS of the last UPSTREAM_BREAKER_WINDOW calls are on
+// record and UPSTREAM_BREAKER_FAILURE_PERCENT of them failed (no response, 5xx
+// or slower than UPSTREAM_BREAKER_SLOW_MS). Open: calls fail fast for
+// UPSTREAM_BREAKER_OPEN_SECONDS. Half-open: a few probes go out with the full
+// timeout; enough successes close the circuit, any failure opens it again.
+void openCircuit(HostPool& pool, std::chrono::steady_clock::time_point now) {
+    pool.state = CircuitState::Open;
+    pool.openedAt = now;
+    pool.outcomeCount = 0;
+    pool.outcomeNext = 0;
+    ++pool.circuitOpenings;
+}
+
+// Returns false when the call must fail fast; sets probe for half-open trials.
+bool admitCall(HostPool& pool, bool& probe) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(pool.healthMutex);
+    probe = false;
+    if (pool.state == CircuitState::Open) {
+        if (now - pool.openedAt < std::chrono::seconds(UPSTREAM_BREAKER_OPEN_SECONDS)) {
+            ++pool.circuitRejections;
+            return false;
+        }
+        pool.state = CircuitState::HalfOpen;
+        pool.probesInFlight = 0;
+        pool.probeSuccesses = 0;
+    }
+    if (pool.state == CircuitState::HalfOpen) {
+        if (pool.probesInFlight + pool.probeSuccesses >= UPSTREAM_BREAKER_HALF_OPEN_PROBES) {
+            ++pool.circuitRejections;
+            return false;
+        }
+        ++pool.probesInFlight;
+        probe = true;
+    }
+    return true;
+}
+
+// A half-open probe that was dropped before it was sent frees its slot
+void cancelProbe(HostPool& pool) {
+    std::lock_guard<std::mutex> lock(pool.healthMutex);
+    if (pool.probesInFlight > 0) --pool.probesInFlight;
+}
+
+// p99 of the latency window, recomputed every 16 samples
+void updateAdaptiveTimeout(HostPool& pool) {
+    if (pool.latencyCount < UPSTREAM_ADAPTIVE_MIN_SAMPLES || pool.latencyNext % 16 != 0) return;
+    uint32_t sorted[UPSTREAM_LATENCY_WINDOW];
+    std::copy(pool.latenciesMs, pool.latenciesMs + pool.latencyCount, sorted);
+    size_t rank = pool.latencyCount * 99 / 100;
+    std::nth_element(sorted, sorted + rank, sorted + pool.latencyCount);
+    long timeout = static_cast<long>(sorted[rank]) * UPSTREAM_ADAPTIVE_TIMEOUT_FACTOR;
+    pool.adaptiveTimeoutMs = std::clamp(timeout, UPSTREAM_MIN_TIMEOUT_MS, UPSTREAM_TIMEOUT_SECONDS * 1000);
+}
+
+// Timed-out calls are recorded at their timeout, so a timeout that has become
+// too tight grows again by UPSTREAM_ADAPTIVE_TIMEOUT_FACTOR per update.
+void recordOutcome(HostPool& pool, bool probe, bool failed, bool answered, long elapsedMs) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(pool.healthMutex);
+    if (answered) {
+        pool.latenciesMs[pool.latencyNext] = static_cast<uint32_t>(std::max(0L, elapsedMs));
+        pool.latencyNext = (pool.latencyNext + 1) % UPSTREAM_LATENCY_WINDOW;
+        pool.latencyCount = std::min(pool.latencyCount + 1, UPSTREAM_LATENCY_WINDOW);
+        updateAdaptiveTimeout(pool);
+    }
+
+    if (probe) {
+        --pool.probesInFlight;
+        if (pool.state != CircuitState::HalfOpen) return;
+        if (failed) {
+            openCircuit(pool, now);
+        } else if (++pool.probeSuccesses >= UPSTREAM_BREAKER_HALF_OPEN_PROBES) {
+            pool.state = CircuitState::Closed;
+        }
+        return;
+    }
+    if (pool.state != CircuitState::Closed) return;  // Sent before the circuit opened
+
+    pool.outcomes[pool.outcomeNext] = failed;
+    pool.outcomeNext = (pool.outcomeNext + 1) % UPSTREAM_BREAKER_WINDOW;
+    pool.outcomeCount = std::min(pool.outcomeCount + 1, UPSTREAM_BREAKER_WINDOW);
+    if (pool.outcomeCount < UPSTREAM_BREAKER_MIN_CALLS) return;
+    size_t failures = static_cast<size_t>(std::count(pool.outcomes, pool.outcomes + pool.outcomeCount, true));
+    if (failures * 100 >= pool.outcomeCount * UPSTREAM_BREAKER_FAILURE_PERCENT) openCircuit(pool, now);
+}
+
+long effectiveTimeout(HostPool& pool, long callerTimeoutMs, bool probe) {
+    if (probe) return callerTimeoutMs;
+    std::lock_guard<std::mutex> lock(pool.healthMutex);
+    if (pool.adaptiveTimeoutMs <= 0) return callerTimeoutMs;
+    return std::min(callerTimeoutMs, pool.adaptiveTimeoutMs);
+}
+}
+
+const char* circuitStateName(CircuitState state) {
+    switch (state) {
+        case CircuitState::Closed: return "closed";
+        case CircuitState::Open: return "open";
+        case CircuitState::HalfOpen: return "half_open";
+    }
+    return "closed";
+}
+
+// --- Helper: Host Part of a URL ---
+std::string upstreamHostOf(const std::string& url) {
+    size_t start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    size_t end = url.find('/', start);
+    return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+// --- Latency Histograms (per-thread handle cache; registers each host/status pair once) ---
+static const MetricHistogram& upstreamLatency(const std::string& host, int statusCode) {
+    thread_local std::map<std::string, std::unordered_map<int, MetricHistogram>, std::less<>> handles;
+    auto hostIt = handles.find(host);
+    if (hostIt == handles.end()) hostIt = handles.emplace(host, std::unordered_map<int, MetricHistogram>()).first;
+    auto it = hostIt->second.find(statusCode);
+    if (it == hostIt->second.end()) {
+        it = hostIt->second.emplace(statusCode, upstreamRequestHistogram(host, statusCode)).first;
+    }
+    return it->second;
+}
+
+// --- Upstream Event Loop ---
+// One thread drives every upstream transfer through a curl multi handle, so a
+// request waiting on the provider holds a few kilobytes instead of a thread.
+// Finished transfers are handed to the completion pool for parsing.
+struct Transfer {
+    HostPool* pool = nullptr;
+    std::string host;
+    std::string url;
+    long timeoutMs = 0;
+    std::string body;
+    std::chrono::steady_clock::time_point submitted;
+    UpstreamCallback done;
+    bool inlineCallback = false;  // Run done on the loop thread (cheap hand-offs only)
+    bool probe = false;           // Half-open trial call
+    UpstreamPriority priority;    // nullptr = UPSTREAM_PRIORITY_CLIENT
+};
+
+// The loop starts with the first transfer; multi_handle is set once, before that.
+static CURLM* multi_handle = nullptr;
+static std::thread loop_thread;
+static std::mutex submit_mutex;
+static std::vector<std::unique_ptr<Transfer>> submitted_transfers;  // protected by submit_mutex
+static bool loop_started = false;                                    // protected by submit_mutex
+static bool loop_stopping = false;                                   // protected by submit_mutex
+static std::atomic<size_t> in_flight{0};
+
+static ThreadPool& completionPool() {
+    static ThreadPool pool(UPSTREAM_COMPLETION_THREADS);
+    return pool;
+}
+
+static void deliver(std::unique_ptr<Transfer> transfer, UpstreamResponse response) {
+    in_flight.fetch_sub(1, std::memory_order_relaxed);
+    if (transfer->inlineCallback) {
+        try {
+            transfer->done(std::move(response));
+        } catch (...) {
+            // Callbacks report their own failures; the loop must keep running.
+        }
+        return;
+    }
+    completionPool().post([done = std::move(transfer->done), response = std::move(response)]() mutable {
+        done(std::move(response));
+    });
+}
+
+// --- Upstream Scheduler (event loop thread only) ---
+// Each host gets a token bucket of scheduler_config.requestsPerSecond. A
+// request that finds no token, or other requests already waiting, joins the
+// host's queue; a full queue drops its lowest priority request. Queued
+// requests that could no longer finish within their timeout are dropped too,
+// and a 429 from the provider empties the bucket for UPSTREAM_THROTTLED_PAUSE_MS.
+struct HostSchedule {
+    std::vector<std::unique_ptr<Transfer>> queue;  // Arrival order
+    double tokens = 0;
+    std::chrono::steady_clock::time_point refilledAt;
+    std::chrono::steady_clock::time_point pausedUntil;
+};
+
+// scheduler_config is set once in main() before app.run().
+static UpstreamSchedulerConfig scheduler_config;
+static std::map<HostPool*, HostSchedule> host_schedules;
+
+void configureUpstreamScheduler(const UpstreamSchedulerConfig& config) {
+    scheduler_config = config;
+}
+
+UpstreamPriority makeUpstreamPriority(uint64_t value) {
+    return std::make_shared<std::atomic<uint64_t>>(value);
+}
+
+void raiseUpstreamPriority(const UpstreamPriority& priority, uint64_t value) {
+    if (!priority) return;
+    uint64_t current = priority->load(std::memory_order_relaxed);
+    while (current < value && !priority->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+static bool schedulerEnabled() {
+    return scheduler_config.requestsPerSecond > 0;
+}
+
+static double burstSize() {
+    return static_cast<double>(scheduler_config.burst > 0 ? scheduler_config.burst
+                                                          : scheduler_config.requestsPerSecond);
+}
+
+static HostSchedule& scheduleFor(HostPool* pool, std::chrono::steady_clock::time_point now) {
+    auto [it, created] = host_schedules.try_emplace(pool);
+    if (created) {
+        it->second.tokens = burstSize();
+        it->second.refilledAt = now;
+    }
+    return it->second;
+}
+
+static bool takeToken(HostSchedule& schedule, std::chrono::steady_clock::time_point now) {
+    if (now < schedule.pausedUntil) return false;
+    std::chrono::duration<double> elapsed = now - schedule.refilledAt;
+    schedule.refilledAt = now;
+    schedule.tokens = std::min(burstSize(),
+                               schedule.tokens + elapsed.count() * static_cast<double>(scheduler_config.requestsPerSecond));
+    if (schedule.tokens < 1) return false;
+    schedule.tokens -= 1;
+    return true;
+}
+
+static uint64_t priorityOf(const Transfer& transfer) {
+    return transfer.priority ? transfer.priority->load(std::memory_order_relaxed) : UPSTREAM_PRIORITY_CLIENT;
+}
+
+static void dropTransfer(std::unique_ptr<Transfer> transfer, CURLcode error, bool throttled) {
+    if (transfer->probe) cancelProbe(*transfer->pool);
+    if (throttled) transfer->pool->throttled.fetch_add(1, std::memory_order_relaxed);
+    UpstreamResponse response;
+    response.error = error;
+    response.throttled = throttled;
+    deliver(std::move(transfer), std::move(response));
+}
+
+static void finishTransfer(std::unique_ptr<Transfer> transfer, CURL* handle, CURLcode result) {
+    UpstreamResponse response;
+    response.error = result;
+    if (result == CURLE_OK) {
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response.status_code);
+        response.text = std::move(transfer->body);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - transfer->submitted;
+    upstreamLatency(transfer->host, static_cast<int>(response.status_code)).observe(elapsed);
+    recordTransfer(*transfer->pool, handle, response);
+
+    long elapsedMs = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    bool answered = response.status_code != 0;
+    if (response.timedOut()) {
+        answered = true;
+        elapsedMs = transfer->timeoutMs;
+    }
+    if (response.status_code == 429) {
+        transfer->pool->rateLimitedResponses.fetch_add(1, std::memory_order_relaxed);
+        if (schedulerEnabled()) {
+            auto now = std::chrono::steady_clock::now();
+            HostSchedule& schedule = scheduleFor(transfer->pool, now);
+            schedule.tokens = 0;
+            schedule.pausedUntil = now + std::chrono::milliseconds(UPSTREAM_THROTTLED_PAUSE_MS);
+            schedule.refilledAt = schedule.pausedUntil;  // The pause does not count as refill time
+        }
+    }
+    bool failed = response.status_code == 0 || response.status_code >= 500 || elapsedMs > UPSTREAM_BREAKER_SLOW_MS;
+    recordOutcome(*transfer->pool, transfer->probe, failed, answered, elapsedMs);
+    checkin(*transfer->pool, handle);
+    deliver(std::move(transfer), std::move(response));
+}
+
+static void startTransfer(std::unique_ptr<Transfer> transfer) {
+    transfer->timeoutMs = effectiveTimeout(*transfer->pool, transfer->timeoutMs, transfer->probe);
+    CURL* handle = checkout(*transfer->pool);
+    if (!handle) {
+        if (transfer->probe) recordOutcome(*transfer->pool, true, true, false, 0);
+        UpstreamResponse response;
+        response.error = CURLE_FAILED_INIT;
+        deliver(std::move(transfer), std::move(response));
+        return;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_URL, transfer->url.c_str());
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, transfer->timeoutMs);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer->body);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, transfer.get());
+    if (curl_multi_add_handle(multi_handle, handle) != CURLM_OK) {
+        finishTransfer(std::move(transfer), handle, CURLE_FAILED_INIT);
+        return;
+    }
+    transfer.release();  // Owned by the multi handle until CURLMSG_DONE
+}
+
+static void scheduleTransfer(std::unique_ptr<Transfer> transfer, std::chrono::steady_clock::time_point now) {
+    if (!schedulerEnabled()) {
+        startTransfer(std::move(transfer));
+        return;
+    }
+    HostSchedule& schedule = scheduleFor(transfer->pool, now);
+    if (schedule.queue.empty() && takeToken(schedule, now)) {
+        startTransfer(std::move(transfer));
+        return;
+    }
+
+    if (schedule.queue.size() >= scheduler_config.maxQueued) {
+        // Lowest priority, newest among equals
+        size_t lowest = 0;
+        for (size_t i = 1; i < schedule.queue.size(); ++i) {
+            if (priorityOf(*schedule.queue[i]) <= priorityOf(*schedule.queue[lowest])) lowest = i;
+        }
+        if (priorityOf(*transfer) <= priorityOf(*schedule.queue[lowest])) {
+            dropTransfer(std::move(transfer), CURLE_COULDNT_CONNECT, true);
+            return;
+        }
+        auto evicted = std::move(schedule.queue[lowest]);
+        schedule.queue.erase(schedule.queue.begin() + static_cast<std::ptrdiff_t>(lowest));
+        transfer->pool->queued.fetch_sub(1, std::memory_order_relaxed);
+        dropTransfer(std::move(evicted), CURLE_COULDNT_CONNECT, true);
+    }
+    transfer->pool->queued.fetch_add(1, std::memory_order_relaxed);
+    schedule.queue.push_back(std::move(transfer));
+}
+
+// Sends what the budgets allow and returns how long the loop may sleep before
+// the next queued request can go out.
+static long drainSchedules(std::chrono::steady_clock::time_point now) {
+    long waitMs = UPSTREAM_LOOP_POLL_MS;
+    for (auto& [pool, schedule] : host_schedules) {
+        auto& queue = schedule.queue;
+        for (size_t i = 0; i < queue.size(); ) {
+            long waitedMs = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - queue[i]->submitted).count());
+            if (waitedMs > std::max(0L, queue[i]->timeoutMs - UPSTREAM_MIN_TIMEOUT_MS)) {
+                auto expired = std::move(queue[i]);
+                queue.erase(queue.begin() + static_cast<std::ptrdiff_t>(i));
+                pool->queued.fetch_sub(1, std::memory_order_relaxed);
+                dropTransfer(std::move(expired), CURLE_COULDNT_CONNECT, true);
+            } else {
+                ++i;
+            }
+        }
+
+        while (!queue.empty() && takeToken(schedule, now)) {
+            size_t best = 0;
+            for (size_t i = 1; i < queue.size(); ++i) {
+                if (priorityOf(*queue[i]) > priorityOf(*queue[best])) best = i;
+            }
+            auto transfer = std::move(queue[best]);
+            queue.erase(queue.begin() + static_cast<std::ptrdiff_t>(best));
+            pool->queued.fetch_sub(1, std::memory_order_relaxed);
+            // The wait comes out of the caller's timeout; latency is measured from here
+            transfer->timeoutMs -= static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - transfer->submitted).count());
+            transfer->submitted = now;
+            startTransfer(std::move(transfer));
+        }
+
+        if (!queue.empty()) {
+            double refillMs = (1 - schedule.tokens) * 1000.0 / static_cast<double>(scheduler_config.requestsPerSecond);
+            long pausedMs = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(schedule.pausedUntil - now).count());
+            waitMs = std::min(waitMs, std::max({1L, static_cast<long>(refillMs) + 1, pausedMs}));
+        }
+    }
+    return waitMs;
+}
+
+// Shutdown fails queued requests instead of sending them
+static void abortSchedules() {
+    for (auto& [pool, schedule] : host_schedules) {
+        pool->queued.fetch_sub(schedule.queue.size(), std::memory_order_relaxed);
+        for (auto& transfer : schedule.queue) dropTransfer(std::move(transfer), CURLE_ABORTED_BY_CALLBACK, false);
+        schedule.queue.clear();
+    }
+}
+
+static void runLoop() {
+    int running = 0;
+    for (;;) {
+        std::vector<std::unique_ptr<Transfer>> batch;
+        bool stopping = false;
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex);
+            batch.swap(submitted_transfers);
+            stopping = loop_stopping;
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (auto& transfer : batch) scheduleTransfer(std::move(transfer), now);
+        if (stopping) abortSchedules();
+        long waitMs = drainSchedules(now);
+        // Shutdown lets in-flight transfers finish; each is bounded by its timeout
+        if (stopping && batch.empty() && running == 0) return;
+
+        curl_multi_perform(multi_handle, &running);
+
+        int queued = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi_handle, &queued)) {
+            if (message->msg != CURLMSG_DONE) continue;
+            CURL* handle = message->easy_handle;
+            CURLcode result = message->data.result;
+            char* priv = nullptr;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &priv);
+            curl_multi_remove_handle(multi_handle, handle);
+            finishTransfer(std::unique_ptr<Transfer>(reinterpret_cast<Transfer*>(priv)), handle, result);
+        }
+
+        curl_multi_poll(multi_handle, nullptr, 0, static_cast<int>(waitMs), nullptr);
+    }
+}
+
+static void submitTransfer(std::unique_ptr<Transfer> transfer) {
+    in_flight.fetch_add(1, std::memory_order_relaxed);
+    if (!admitCall(*transfer->pool, transfer->probe)) {
+        UpstreamResponse response;
+        response.error = CURLE_COULDNT_CONNECT;
+        response.circuitOpen = true;
+        deliver(std::move(transfer), std::move(response));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        if (!loop_stopping) {
+            if (!loop_started) {
+                multi_handle = curl_multi_init();
+                curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, static_cast<long>(CURLPIPE_MULTIPLEX));
+                curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, UPSTREAM_MAX_HOST_CONNECTIONS);
+                loop_thread = std::thread(runLoop);
+                loop_started = true;
+            }
+            submitted_transfers.push_back(std::move(transfer));
+        }
+    }
+    if (transfer) {
+        if (transfer->probe) recordOutcome(*transfer->pool, true, true, false, 0);
+        UpstreamResponse response;
+        response.error = CURLE_ABORTED_BY_CALLBACK;  // Shutting down
+        deliver(std::move(transfer), std::move(response));
+        return;
+    }
+    curl_multi_wakeup(multi_handle);
+}
+
+static std::unique_ptr<Transfer> makeTransfer(const std::string& url, const cpr::Parameters& params, long timeoutMs) {
+    thread_local cpr::CurlHolder encoder;  // Only used for URL-escaping parameters
+    auto transfer = std::make_unique<Transfer>();
+    transfer->host = upstreamHostOf(url);
+    transfer->pool = &poolFor(transfer->host);
+    std::string query = params.GetContent(encoder);
+    transfer->url = query.empty() ? url : url + (url.find('?') == std::string::npos ? "?" : "&") + query;
+    transfer->timeoutMs = timeoutMs;
+    transfer->submitted = std::chrono::steady_clock::now();
+    return transfer;
+}
+
+// --- Pooled GET ---
+void upstreamGetAsync(const std::string& url, const cpr::Parameters& params, long timeoutMs, UpstreamCallback done,
+                      UpstreamPriority priority) {
+    auto transfer = makeTransfer(url, params, timeoutMs);
+    transfer->done = std::move(done);
+    transfer->priority = std::move(priority);
+    submitTransfer(std::move(transfer));
+}
+
+// Blocking form for background threads; it waits on the same event loop.
+UpstreamResponse upstreamGet(const std::string& url, const cpr::Parameters& params, long timeoutMs,
+                             UpstreamPriority priority) {
+    std::promise<UpstreamResponse> promise;
+    std::future<UpstreamResponse> result = promise.get_future();
+    auto transfer = makeTransfer(url, params, timeoutMs);
+    transfer->done = [&promise](UpstreamResponse response) { promise.set_value(std::move(response)); };
+    transfer->inlineCallback = true;
+    transfer->priority = std::move(priority);
+    submitTransfer(std::move(transfer));
+    return result.get();
+}
+
+size_t getUpstreamInFlight() {
+    return in_flight.load(std::memory_order_relaxed);
+}
+
+void stopUpstreamClient() {
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        loop_stopping = true;
+        if (!loop_started) return;
+    }
+    curl_multi_wakeup(multi_handle);
+    if (loop_thread.joinable()) loop_thread.join();
+}
+
+std::vector<UpstreamHostStats> getUpstreamHostStats() {
+    std::vector<UpstreamHostStats> result;
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    for (const auto& [host, pool] : host_pools) {
+        UpstreamHostStats s;
+        s.host = host;
+        s.requests = pool->requests.load(std::memory_order_relaxed);
+        s.errors = pool->errors.load(std::memory_order_relaxed);
+        s.newConnections = pool->newConnections.load(std::memory_order_relaxed);
+        s.reusedConnections = pool->reusedConnections.load(std::memory_order_relaxed);
+        s.http2Responses = pool->http2Responses.load(std::memory_order_relaxed);
+        s.handshakeMicros = pool->handshakeMicros.load(std::memory_order_relaxed);
+        s.queued = pool->queued.load(std::memory_order_relaxed);
+        s.throttled = pool->throttled.load(std::memory_order_relaxed);
+        s.rateLimitedResponses = pool->rateLimitedResponses.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> poolLock(pool->mutex);
+            s.idleSessions = pool->idle.size();
+        }
+        {
+            std::lock_guard<std::mutex> healthLock(pool->healthMutex);
+            s.circuitState = pool->state;
+            s.circuitOpenings = pool->circuitOpenings;
+            s.circuitRejections = pool->circuitRejections;
+            s.timeoutMs = pool->adaptiveTimeoutMs;
+        }
+        result.push_back(s);
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../config/config.h"
+
+// --- Per-host Circuit Breaker State ---
+enum class CircuitState { Closed, Open, HalfOpen };
+
+const char* circuitStateName(CircuitState state);
+
+// --- Per-host Upstream Connection Counters ---
+struct UpstreamHostStats {
+    std::string host;
+    uint64_t requests = 0;
+    uint64_t errors = 0;              // Transport failures (no HTTP status)
+    uint64_t newConnections = 0;      // Requests that had to open a connection
+    uint64_t reusedConnections = 0;   // Requests served on a kept-alive connection
+    uint64_t http2Responses = 0;
+    uint64_t handshakeMicros = 0;     // Summed TCP+TLS setup time of new connections
+    size_t idleSessions = 0;
+    CircuitState circuitState = CircuitState::Closed;
+    uint64_t circuitOpenings = 0;     // Closed/half-open -> open transitions
+    uint64_t circuitRejections = 0;   // Requests failed fast while open
+    long timeoutMs = 0;               // Current adaptive timeout (0 = caller's timeout)
+    size_t queued = 0;                // Waiting for the host's request budget
+    uint64_t throttled = 0;           // Dropped from the queue (full, or waited out their timeout)
+    uint64_t rateLimitedResponses = 0;  // 429 answers, each pausing the budget
+};
+
+// --- Upstream Response ---
+struct UpstreamResponse {
+    long status_code = 0;         // 0 when the transfer failed before an HTTP status
+    std::string text;
+    CURLcode error = CURLE_OK;
+    bool circuitOpen = false;     // Not sent: the host's circuit breaker is open
+    bool throttled = false;       // Not sent: dropped while waiting for the host's request budget
+
+    bool timedOut() const { return error == CURLE_OPERATION_TIMEDOUT; }
+};
+
+// Invoked once per request on the upstream completion pool, never on the
+// caller's thread; parsing and responding to the client happen there.
+using UpstreamCallback = std::function<void(UpstreamResponse)>;
+
+// --- Upstream Scheduling Priority ---
+// With a request budget set, requests a host cannot take yet wait in its queue
+// and go out highest priority first, oldest first among equals. The value is
+// read each time the queue is drained, so a caller may raise it while the
+// request waits. No priority means UPSTREAM_PRIORITY_CLIENT.
+inline constexpr uint64_t UPSTREAM_PRIORITY_CLIENT = uint64_t(1) << 32;  // A client waits on the answer
+using UpstreamPriority = std::shared_ptr<std::atomic<uint64_t>>;
+
+UpstreamPriority makeUpstreamPriority(uint64_t value);
+void raiseUpstreamPriority(const UpstreamPriority& priority, uint64_t value);
+
+void configureUpstreamScheduler(const UpstreamSchedulerConfig& config);
+std::string upstreamHostOf(const std::string& url);
+void upstreamGetAsync(const std::string& url, const cpr::Parameters& params, long timeoutMs, UpstreamCallback done,
+                      UpstreamPriority priority = nullptr);
+UpstreamResponse upstreamGet(const std::string& url, const cpr::Parameters& params,
+                             long timeoutMs = UPSTREAM_TIMEOUT_SECONDS * 1000, UpstreamPriority priority = nullptr);
+std::vector<UpstreamHostStats> getUpstreamHostStats();
+size_t getUpstreamInFlight();
+void stopUpstreamClient();
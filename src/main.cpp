@@ -1,20 +1,36 @@
+#include "app.h"
+#include "cache/snapshot_store.h"
 #include "config/config.h"
+#include "http/admission.h"
 #include "db/database.h"
+#include "http/compression.h"
+#include "http/upstream_client.h"
 #include "middleware/api_key_auth.h"
 #include "routes/auth_routes.h"
 #include "routes/stops_routes.h"
 #include "routes/departures_routes.h"
 #include "routes/notifications_routes.h"
+#include "routes/stats_routes.h"
+#include "routes/stream_routes.h"
+#include "services/auth_service.h"
+#include "services/departures_service.h"
+#include "services/stops_service.h"
+#include "services/notifications_service.h"
+#include "services/stream_service.h"
+#include "services/warmup_service.h"
 
 #include <algorithm>
 #include <cctype>
 #include <string>
 
 int main() {
-    crow::SimpleApp app;
+    App app;
 
-    // Initialize authentication
+    // Initialize authentication, per-key rate limits and admission lanes
     initAuth();
+    AdmissionConfig admission = loadAdmissionConfigFromEnv();
+    configureRateLimit(admission);
+    configureAdmission(admission);
 
     // Initialize database (try environment variables first, then config files)
     Database db;
@@ -27,6 +43,21 @@ int main() {
         std::cerr << "Database config unavailable. Stop persistence disabled." << std::endl;
     }
 
+    // Departure cache revalidation and hot-stop refresher
+    configureDepartureRefresh(loadRefreshConfigFromEnv());
+    configureCompression(loadCompressionConfigFromEnv());
+    configureTracing(loadTracingConfigFromEnv());
+    configureUpstreamScheduler(loadUpstreamSchedulerConfigFromEnv());
+
+    // Optional on-disk cache tier, shared by replicas that mount the same path
+    registerDepartureCacheSnapshot();
+    registerSearchCacheSnapshot();
+    registerNotificationCacheSnapshot();
+    const char* snapshotPath = std::getenv("CACHE_SNAPSHOT_PATH");
+    if (snapshotPath && snapshotPath[0] != '\0') {
+        startCacheSnapshots(snapshotPath, static_cast<int>(getEnvLong("CACHE_SNAPSHOT_SECONDS", 30, 1, 3600)));
+    }
+
     // Determine server port (default: 8080)
     int port = 8080;
     const char* portEnv = std::getenv("APP_PORT");
@@ -58,6 +89,29 @@ int main() {
     registerStopsRoutes(app, db);
     registerDeparturesRoutes(app, db);
     registerNotificationsRoutes(app, db);
+    registerStatsRoutes(app, db);
+    registerStreamRoutes(app, db);
+
+    if (isAuthEnabled()) startAuthMaintenance(db);
+    startStopWriter(db);
+    startNearbyConsistencyChecks();
+    startDepartureRefresher();
+    startStreamPublisher();
+    startNotificationIndexer(static_cast<int>(getEnvLong("NOTIFICATION_INDEX_REFRESH_SECONDS", 60, 0, 3600)));
+
+    // Pool, stop indexes, API keys and hot stops warm up while /health reports liveness
+    WarmupConfig warmup = loadWarmupConfigFromEnv();
+    warmup.preloadApiKeys = isAuthEnabled();
+    startWarmup(db, warmup);
 
     app.port(port).multithreaded().run();
+    stopWarmup();
+    stopNotificationIndexer();
+    stopStreamPublisher();
+    stopDepartureRefresher();
+    stopNearbyConsistencyChecks();
+    stopStopWriter();
+    stopAuthMaintenance();
+    stopCacheSnapshots();
+    stopUpstreamClient();
 }
@@ -0,0 +1,267 @@
+#include "metrics.h"
+#include "../config/config.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// --- Histogram Buckets (upper bounds in microseconds: 1, 2, 3, 4, 6, 8, 12, ...) ---
+static constexpr uint64_t HISTOGRAM_MAX_MICROS = 1ULL << 26;
+static constexpr size_t HISTOGRAM_BUCKETS = 52;
+
+static const std::array<uint64_t, HISTOGRAM_BUCKETS>& bucketBounds() {
+    static const std::array<uint64_t, HISTOGRAM_BUCKETS> bounds = [] {
+        std::array<uint64_t, HISTOGRAM_BUCKETS> b{};
+        size_t n = 0;
+        b[n++] = 1;
+        for (uint64_t p = 2; p <= HISTOGRAM_MAX_MICROS; p *= 2) {
+            b[n++] = p;
+            if (p < HISTOGRAM_MAX_MICROS) b[n++] = p + p / 2;
+        }
+        return b;
+    }();
+    return bounds;
+}
+
+// Histogram slot layout: one per bucket, then +Inf, then the sum in microseconds
+static constexpr uint32_t HISTOGRAM_SLOTS = HISTOGRAM_BUCKETS + 2;
+
+// --- Per-thread Slot Storage ---
+struct ThreadSlots {
+    std::atomic<uint64_t> values[MAX_METRIC_SLOTS];
+};
+
+enum class SeriesType { Counter, Histogram };
+
+struct Series {
+    std::string name;
+    std::string help;
+    std::string labels;  // Rendered label pairs without braces, e.g. route="/health"
+    SeriesType type;
+    uint32_t slot;
+};
+
+static std::mutex registry_mutex;
+static std::vector<Series> registered_series;
+static std::map<std::string, uint32_t> series_slots;  // name + labels -> first slot
+static uint32_t next_slot = 0;
+static std::vector<ThreadSlots*> live_threads;
+static ThreadSlots* retired_totals = new ThreadSlots();  // Never freed; outlives every thread
+
+// Folds a thread's counts into the retired totals when the thread exits
+struct ThreadSlotsOwner {
+    ThreadSlots* slots = nullptr;
+
+    ~ThreadSlotsOwner() {
+        if (!slots) return;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (uint32_t i = 0; i < next_slot; ++i) {
+            uint64_t v = slots->values[i].load(std::memory_order_relaxed);
+            retired_totals->values[i].store(retired_totals->values[i].load(std::memory_order_relaxed) + v,
+                                            std::memory_order_relaxed);
+        }
+        live_threads.erase(std::remove(live_threads.begin(), live_threads.end(), slots), live_threads.end());
+        delete slots;
+    }
+};
+
+static ThreadSlots& localSlots() {
+    thread_local ThreadSlotsOwner owner;
+    if (!owner.slots) {
+        auto* slots = new ThreadSlots();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        live_threads.push_back(slots);
+        owner.slots = slots;
+    }
+    return *owner.slots;
+}
+
+// Single writer per slot array, so load + store is enough
+static inline void addToSlot(ThreadSlots& slots, uint32_t slot, uint64_t n) {
+    std::atomic<uint64_t>& v = slots.values[slot];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void MetricCounter::inc(uint64_t n) const {
+    if (slot_ != UINT32_MAX) addToSlot(localSlots(), slot_, n);
+}
+
+void MetricHistogram::observeMicros(uint64_t micros) const {
+    if (slot_ == UINT32_MAX) return;
+    const auto& bounds = bucketBounds();
+    size_t bucket = static_cast<size_t>(std::lower_bound(bounds.begin(), bounds.end(), micros) - bounds.begin());
+    ThreadSlots& slots = localSlots();
+    addToSlot(slots, slot_ + static_cast<uint32_t>(bucket), 1);  // bucket == HISTOGRAM_BUCKETS is +Inf
+    addToSlot(slots, slot_ + HISTOGRAM_BUCKETS + 1, micros);
+}
+
+// --- Registration ---
+static void appendEscapedLabelValue(std::string& out, const std::string& value) {
+    for (char c : value) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+}
+
+static std::string renderLabels(const MetricLabels& labels) {
+    std::string out;
+    for (const auto& [key, value] : labels) {
+        if (!out.empty()) out += ',';
+        out += key;
+        out += "=\"";
+        appendEscapedLabelValue(out, value);
+        out += '"';
+    }
+    return out;
+}
+
+static uint32_t registerSeries(const std::string& name, const std::string& help, const MetricLabels& labels,
+                               SeriesType type, uint32_t width) {
+    std::string rendered = renderLabels(labels);
+    std::string key = name + '{' + rendered + '}';
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = series_slots.find(key);
+    if (it != series_slots.end()) return it->second;
+
+    if (next_slot + width > MAX_METRIC_SLOTS) {
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "Metric slots exhausted; dropping series " << key << std::endl;
+            warned = true;
+        }
+        return UINT32_MAX;
+    }
+    uint32_t slot = next_slot;
+    next_slot += width;
+    registered_series.push_back({name, help, std::move(rendered), type, slot});
+    series_slots.emplace(std::move(key), slot);
+    return slot;
+}
+
+MetricCounter registerCounter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    return MetricCounter(registerSeries(name, help, labels, SeriesType::Counter, 1));
+}
+
+MetricHistogram registerHistogram(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    return MetricHistogram(registerSeries(name, help, labels, SeriesType::Histogram, HISTOGRAM_SLOTS));
+}
+
+// --- Exposition ---
+static void appendNumber(std::string& out, double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.15g", value);
+    out += buf;
+}
+
+static void appendSample(std::string& out, const std::string& name, const std::string& labels,
+                         const char* extraLabel, double value) {
+    out += name;
+    if (!labels.empty() || extraLabel) {
+        out += '{';
+        out += labels;
+        if (extraLabel) {
+            if (!labels.empty()) out += ',';
+            out += extraLabel;
+        }
+        out += '}';
+    }
+    out += ' ';
+    appendNumber(out, value);
+    out += '\n';
+}
+
+static void appendHeader(std::string& out, const std::string& name, const char* type, const std::string& help) {
+    out += "# HELP " + name + ' ' + help + '\n';
+    out += "# TYPE " + name + ' ' + type + '\n';
+}
+
+void appendMetricFamily(std::string& out, const std::string& name, const char* type,
+                        const std::string& help, const std::vector<MetricSample>& samples) {
+    appendHeader(out, name, type, help);
+    for (const auto& sample : samples) {
+        appendSample(out, name, renderLabels(sample.labels), nullptr, sample.value);
+    }
+}
+
+std::string renderRegisteredMetrics() {
+    std::vector<Series> series;
+    std::vector<uint64_t> totals;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        series = registered_series;
+        totals.assign(next_slot, 0);
+        for (uint32_t i = 0; i < next_slot; ++i) {
+            uint64_t sum = retired_totals->values[i].load(std::memory_order_relaxed);
+            for (const ThreadSlots* slots : live_threads) sum += slots->values[i].load(std::memory_order_relaxed);
+            totals[i] = sum;
+        }
+    }
+
+    // Group series of the same metric under one HELP/TYPE header
+    std::stable_sort(series.begin(), series.end(),
+                     [](const Series& a, const Series& b) { return a.name < b.name; });
+
+    static const std::vector<std::string> bucketLabels = [] {
+        std::vector<std::string> out;
+        char buf[48];
+        for (uint64_t bound : bucketBounds()) {
+            std::snprintf(buf, sizeof(buf), "le=\"%g\"", static_cast<double>(bound) / 1e6);
+            out.emplace_back(buf);
+        }
+        out.emplace_back("le=\"+Inf\"");
+        return out;
+    }();
+
+    std::string out;
+    for (size_t i = 0; i < series.size(); ++i) {
+        const Series& s = series[i];
+        bool histogram = s.type == SeriesType::Histogram;
+        if (i == 0 || series[i - 1].name != s.name) {
+            appendHeader(out, s.name, histogram ? "histogram" : "counter", s.help);
+        }
+        if (!histogram) {
+            appendSample(out, s.name, s.labels, nullptr, static_cast<double>(totals[s.slot]));
+            continue;
+        }
+
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b <= HISTOGRAM_BUCKETS; ++b) {
+            cumulative += totals[s.slot + b];
+            appendSample(out, s.name + "_bucket", s.labels, bucketLabels[b].c_str(), static_cast<double>(cumulative));
+        }
+        appendSample(out, s.name + "_sum", s.labels, nullptr,
+                     static_cast<double>(totals[s.slot + HISTOGRAM_BUCKETS + 1]) / 1e6);
+        appendSample(out, s.name + "_count", s.labels, nullptr, static_cast<double>(cumulative));
+    }
+    return out;
+}
+
+// --- Shared Families ---
+MetricHistogram upstreamRequestHistogram(const std::string& host, int statusCode) {
+    return registerHistogram("kvv_upstream_request_duration_seconds",
+                             "Upstream provider request latency by host and HTTP status (0 = transport error).",
+                             {{"host", host}, {"code", std::to_string(statusCode)}});
+}
+
+MetricHistogram jsonParseHistogram(const std::string& payload) {
+    return registerHistogram("kvv_json_parse_duration_seconds",
+                             "Time spent parsing and normalizing upstream JSON payloads.",
+                             {{"payload", payload}});
+}
+
+MetricHistogram dbQueryHistogram(const std::string& query) {
+    return registerHistogram("kvv_db_query_duration_seconds", "Database query latency.", {{"query", query}});
+}
+
+MetricHistogram authValidationHistogram(const std::string& source) {
+    return registerHistogram("kvv_auth_validation_duration_seconds",
+                             "API key validation latency by where the answer came from.",
+                             {{"source", source}});
+}
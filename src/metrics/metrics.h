@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --- Process Metrics (Prometheus text exposition) ---
+// Every thread writes its own slot array with plain relaxed stores; nothing on
+// the hot path takes a lock or does an atomic read-modify-write. A scrape sums
+// the live threads' slots plus the totals left behind by exited threads.
+// Series are registered once (a mutex-protected lookup) and the returned
+// handle is kept, usually in a function-local static.
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+class MetricCounter {
+public:
+    MetricCounter() = default;
+    void inc(uint64_t n = 1) const;
+
+private:
+    friend MetricCounter registerCounter(const std::string&, const std::string&, const MetricLabels&);
+    explicit MetricCounter(uint32_t slot) : slot_(slot) {}
+
+    uint32_t slot_ = UINT32_MAX;  // UINT32_MAX = slots exhausted, updates are dropped
+};
+
+// Log-linear buckets (two per power of two, 1 us .. ~67 s), HDR-style: the
+// relative error stays below 50% at every scale with a few dozen buckets.
+class MetricHistogram {
+public:
+    MetricHistogram() = default;
+    void observeMicros(uint64_t micros) const;
+
+    template <typename Duration>
+    void observe(Duration d) const {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        observeMicros(micros > 0 ? static_cast<uint64_t>(micros) : 0);
+    }
+
+private:
+    friend MetricHistogram registerHistogram(const std::string&, const std::string&, const MetricLabels&);
+    explicit MetricHistogram(uint32_t slot) : slot_(slot) {}
+
+    uint32_t slot_ = UINT32_MAX;
+};
+
+// Registering an existing name + label set returns the same series.
+MetricCounter registerCounter(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+MetricHistogram registerHistogram(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+
+// --- Scoped Timer (observes the elapsed time on destruction) ---
+class MetricTimer {
+public:
+    explicit MetricTimer(const MetricHistogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~MetricTimer() { histogram_.observe(std::chrono::steady_clock::now() - start_); }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+    const MetricHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// --- Exposition ---
+// Gauges and counters owned by other subsystems (cache shards, pools) are
+// rendered at scrape time from their existing stats.
+struct MetricSample {
+    MetricLabels labels;
+    double value = 0;
+};
+
+void appendMetricFamily(std::string& out, const std::string& name, const char* type,
+                        const std::string& help, const std::vector<MetricSample>& samples);
+std::string renderRegisteredMetrics();
+
+// --- Shared Families (one place for names and help text) ---
+MetricHistogram upstreamRequestHistogram(const std::string& host, int statusCode);
+MetricHistogram jsonParseHistogram(const std::string& payload);
+MetricHistogram dbQueryHistogram(const std::string& query);
+MetricHistogram authValidationHistogram(const std::string& source);
@@ -0,0 +1,48 @@
+#include "tracing.h"
+#include <chrono>
+
+static thread_local TracePtr current_trace;
+
+uint64_t monotonicNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void RequestTrace::addSpan(const char* stage, uint64_t startNs, uint64_t endNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!finished_) spans_.push_back({stage, startNs, endNs});
+}
+
+std::vector<TraceSpan> RequestTrace::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    return std::move(spans_);
+}
+
+TracePtr currentTrace() {
+    return current_trace;
+}
+
+void setCurrentTrace(TracePtr trace) {
+    current_trace = std::move(trace);
+}
+
+TracePtr takeCurrentTrace() {
+    return std::move(current_trace);
+}
+
+TraceScope::TraceScope(TracePtr trace) : previous_(currentTrace()) {
+    setCurrentTrace(std::move(trace));
+}
+
+TraceScope::~TraceScope() {
+    setCurrentTrace(std::move(previous_));
+}
+
+TraceSpanTimer::TraceSpanTimer(const char* stage) : trace_(current_trace), stage_(stage) {
+    if (trace_) startNs_ = monotonicNanos();
+}
+
+TraceSpanTimer::~TraceSpanTimer() {
+    if (trace_) trace_->addSpan(stage_, startNs_, monotonicNanos());
+}
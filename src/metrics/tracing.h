@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// --- Request Tracing ---
+// A request gets a RequestTrace when tracing is on; stages record spans on it
+// with monotonic nanosecond timestamps. The trace is found through a
+// thread-local "current trace": the tracing middleware sets it on the worker,
+// async routes scope it to the handler call, and an async continuation
+// reinstates the trace it captured (TraceScope), so no service signature has
+// to carry it. With tracing off there is no current trace and a span costs a
+// thread-local load and a null check.
+
+uint64_t monotonicNanos();
+
+struct TraceSpan {
+    const char* stage;  // String literal
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+class RequestTrace {
+public:
+    RequestTrace(std::string id, uint64_t startNs) : id_(std::move(id)), startNs_(startNs) {}
+
+    const std::string& id() const { return id_; }
+    uint64_t startNs() const { return startNs_; }
+
+    // Spans added after finish() (e.g. by a fetch the request no longer waits for) are dropped.
+    void addSpan(const char* stage, uint64_t startNs, uint64_t endNs);
+    std::vector<TraceSpan> finish();
+
+private:
+    std::string id_;
+    uint64_t startNs_;
+    std::mutex mutex_;
+    std::vector<TraceSpan> spans_;
+    bool finished_ = false;
+};
+
+using TracePtr = std::shared_ptr<RequestTrace>;
+
+TracePtr currentTrace();
+void setCurrentTrace(TracePtr trace);
+// Clears the current trace and returns it.
+TracePtr takeCurrentTrace();
+
+// Makes a captured trace current for the lifetime of the scope.
+class TraceScope {
+public:
+    explicit TraceScope(TracePtr trace);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TracePtr previous_;
+};
+
+// Records one span on the current trace when it goes out of scope.
+class TraceSpanTimer {
+public:
+    explicit TraceSpanTimer(const char* stage);
+    ~TraceSpanTimer();
+
+    TraceSpanTimer(const TraceSpanTimer&) = delete;
+    TraceSpanTimer& operator=(const TraceSpanTimer&) = delete;
+
+private:
+    TracePtr trace_;  // Kept alive even if the request finishes inside the scope
+    const char* stage_;
+    uint64_t startNs_ = 0;
+};
@@ -1,13 +1,17 @@
 #include "api_key_auth.h"
+#include "rate_limiter.h"
+#include "../metrics/tracing.h"
 #include "../services/auth_service.h"
 #include <cstdlib>
 #include <algorithm>
+#include <memory>
 #include <iostream>
 
 // These are initialized once in main() before app.run(), so they are
 // effectively immutable during request handling and safe to read concurrently.
 static bool auth_enabled = false;
 static std::string api_key;
+static std::unique_ptr<RateLimiter> rate_limiter;  // null = rate limiting off
 
 void initAuth() {
     const char* authEnv = std::getenv("AUTH");
@@ -28,6 +32,20 @@ void initAuth() {
     }
 }
 
+// Buckets are per API key; with AUTH off every client address gets its own.
+void configureRateLimit(const AdmissionConfig& config) {
+    if (config.rateLimitPerSecond <= 0) return;
+    double rate = static_cast<double>(config.rateLimitPerSecond);
+    double burst = config.rateLimitBurst > 0 ? static_cast<double>(config.rateLimitBurst) : 2 * rate;
+    rate_limiter = std::make_unique<RateLimiter>(rate, burst, MAX_RATE_LIMIT_BUCKETS);
+    std::cout << "Rate limit: " << config.rateLimitPerSecond << " requests/s per "
+              << (auth_enabled ? "API key" : "client address") << ", burst " << burst << "." << std::endl;
+}
+
+bool isAuthEnabled() {
+    return auth_enabled;
+}
+
 bool isAuthenticated(const crow::request& req, const Database& db) {
     if (!auth_enabled) return true;
     std::string providedKey = req.get_header_value("X-API-Key");
@@ -46,12 +64,43 @@ bool isAuthenticated(const crow::request& req, const Database& db) {
     return false;
 }
 
+std::optional<crow::response> rejectRequest(const crow::request& req, const Database& db) {
+    TraceSpanTimer span("auth");
+    if (!isAuthenticated(req, db)) return unauthorizedResponse();
+    if (!rate_limiter) return std::nullopt;
+
+    std::string client = auth_enabled ? req.get_header_value("X-API-Key") : req.remote_ip_address;
+    long retryAfter = rate_limiter->acquire(client);
+    if (retryAfter == 0) return std::nullopt;
+
+    auto response = crow::response(429, R"({"error":"Rate limit exceeded. Retry later."})");
+    setSecurityHeaders(response);
+    response.set_header("Retry-After", std::to_string(retryAfter));
+    return response;
+}
+
+RateLimitStats getRateLimitStats() {
+    RateLimitStats stats;
+    if (!rate_limiter) return stats;
+    stats.enabled = true;
+    stats.buckets = rate_limiter->buckets();
+    stats.limited = rate_limiter->limited();
+    return stats;
+}
+
 crow::response unauthorizedResponse() {
     auto response = crow::response(401, R"({"error":"Unauthorized. Invalid or missing API key."})");
     setSecurityHeaders(response);
     return response;
 }
 
+crow::response overloadedResponse() {
+    auto response = crow::response(503, R"({"error":"Server busy, retry later"})");
+    setSecurityHeaders(response);
+    response.set_header("Retry-After", "1");
+    return response;
+}
+
 void setSecurityHeaders(crow::response& res) {
     res.set_header("Content-Type", "application/json");
     res.set_header("X-Content-Type-Options", "nosniff");
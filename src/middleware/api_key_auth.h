@@ -2,8 +2,22 @@
 
 #include "crow.h"
 #include "../db/database.h"
+#include <optional>
+
+struct RateLimitStats {
+    bool enabled = false;
+    size_t buckets = 0;    // API keys (or client addresses) currently tracked
+    uint64_t limited = 0;  // Requests answered with 429
+};
 
 void initAuth();
+void configureRateLimit(const AdmissionConfig& config);
+bool isAuthEnabled();
 bool isAuthenticated(const crow::request& req, const Database& db);
+// The 401 or 429 response to send instead of handling the request, or nullopt
+// when the request is authenticated and within its key's rate limit.
+std::optional<crow::response> rejectRequest(const crow::request& req, const Database& db);
+RateLimitStats getRateLimitStats();
 crow::response unauthorizedResponse();
+crow::response overloadedResponse();
 void setSecurityHeaders(crow::response& res);
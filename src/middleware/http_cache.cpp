@@ -0,0 +1,60 @@
+#include "http_cache.h"
+#include "api_key_auth.h"
+#include "../config/config.h"
+#include "../metrics/tracing.h"
+
+// --- Helper: If-None-Match Evaluation ---
+// Uses the weak comparison RFC 9110 prescribes for If-None-Match, so a
+// "W/" prefix on the client's copy still matches our strong tag.
+bool etagMatches(const std::string& ifNoneMatch, const std::string& etag) {
+    if (ifNoneMatch.empty() || etag.empty()) return false;
+
+    size_t pos = 0;
+    while (pos < ifNoneMatch.size()) {
+        size_t comma = ifNoneMatch.find(',', pos);
+        if (comma == std::string::npos) comma = ifNoneMatch.size();
+        std::string candidate = trim(ifNoneMatch.substr(pos, comma - pos));
+        if (candidate == "*") return true;
+        if (candidate.rfind("W/", 0) == 0) candidate = candidate.substr(2);
+        if (candidate == etag) return true;
+        pos = comma + 1;
+    }
+    return false;
+}
+
+// --- Response from a Cached Body ---
+// A compressed variant is its own representation, so it gets its own strong
+// tag; If-None-Match accepts either, since both describe the same data.
+crow::response cachedBodyResponse(const crow::request& req, const CachedBody& body, int status) {
+    ContentEncoding encoding = negotiateEncoding(req.get_header_value("Accept-Encoding"), body.data.size());
+    const std::string* data = &body.data;
+    std::string etag = body.etag;
+    if (encoding != ContentEncoding::Identity) {
+        TraceSpanTimer span("compress");  // Encodes only on the entry's first request per encoding
+        const std::string& compressed = body.compressed(encoding);
+        if (compressed.empty()) {
+            encoding = ContentEncoding::Identity;
+        } else {
+            data = &compressed;
+            etag.insert(etag.size() - 1, std::string("-") + contentEncodingName(encoding));
+        }
+    }
+
+    crow::response response;
+    const std::string& ifNoneMatch = req.get_header_value("If-None-Match");
+    if (status == 200 && (etagMatches(ifNoneMatch, etag) || etagMatches(ifNoneMatch, body.etag))) {
+        response.code = 304;
+    } else {
+        response.code = status;
+        response.body = *data;
+        if (encoding != ContentEncoding::Identity) response.set_header("Content-Encoding", contentEncodingName(encoding));
+    }
+    setSecurityHeaders(response);
+    response.set_header("Vary", "Accept-Encoding");
+    if (status == 200) {
+        // Clients may keep the body but must revalidate it with If-None-Match
+        response.set_header("ETag", etag);
+        response.set_header("Cache-Control", "no-cache");
+    }
+    return response;
+}
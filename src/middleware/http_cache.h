@@ -0,0 +1,7 @@
+#pragma once
+
+#include "crow.h"
+#include "../cache/cached_body.h"
+
+bool etagMatches(const std::string& ifNoneMatch, const std::string& etag);
+crow::response cachedBodyResponse(const crow::request& req, const CachedBody& body, int status = 200);
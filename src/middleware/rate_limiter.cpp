@@ -0,0 +1,67 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <cmath>
+
+RateLimiter::RateLimiter(double ratePerSecond, double burst, size_t capacity, size_t shardCount)
+    : rate_(ratePerSecond),
+      burst_(std::max(1.0, burst)),
+      shards_(shardCount == 0 ? 1 : shardCount) {
+    shardCapacity_ = std::max<size_t>(1, (capacity + shards_.size() - 1) / shards_.size());
+}
+
+long RateLimiter::acquire(const std::string& key) {
+    Shard& shard = shards_[std::hash<std::string>{}(key) % shards_.size()];
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.buckets.find(key);
+    if (it == shard.buckets.end()) {
+        if (shard.buckets.size() >= shardCapacity_) makeRoom(shard, now);
+        it = shard.buckets.emplace(key, Bucket{burst_, now}).first;
+    }
+
+    Bucket& bucket = it->second;
+    double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+    bucket.tokens = std::min(burst_, bucket.tokens + elapsed * rate_);
+    bucket.updated = now;
+    if (bucket.tokens >= 1) {
+        bucket.tokens -= 1;
+        return 0;
+    }
+    ++shard.limited;
+    return std::max(1L, static_cast<long>(std::ceil((1 - bucket.tokens) / rate_)));
+}
+
+void RateLimiter::makeRoom(Shard& shard, Clock::time_point now) {
+    auto refilledBy = [this](const Bucket& bucket) {
+        return bucket.updated + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((burst_ - bucket.tokens) / rate_));
+    };
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        it = refilledBy(it->second) <= now ? shard.buckets.erase(it) : std::next(it);
+    }
+    if (shard.buckets.size() < shardCapacity_) return;
+
+    auto idlest = std::min_element(shard.buckets.begin(), shard.buckets.end(), [](const auto& a, const auto& b) {
+        return a.second.updated < b.second.updated;
+    });
+    shard.buckets.erase(idlest);
+}
+
+size_t RateLimiter::buckets() const {
+    size_t total = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.buckets.size();
+    }
+    return total;
+}
+
+uint64_t RateLimiter::limited() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.limited;
+    }
+    return total;
+}
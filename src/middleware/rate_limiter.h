@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --- Sharded Token Bucket Rate Limiter ---
+// One bucket per client key, refilled continuously at ratePerSecond up to
+// burst tokens. Buckets are spread over independently locked shards by key
+// hash, like ShardedCache. A bucket that has refilled to burst is identical
+// to a new one, so a full shard first drops those, then the longest idle.
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimiter(double ratePerSecond, double burst, size_t capacity, size_t shardCount = 16);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Takes one token. Returns 0 if one was available, otherwise the whole
+    // seconds until the next token (for Retry-After).
+    long acquire(const std::string& key);
+
+    size_t buckets() const;
+    uint64_t limited() const;
+
+private:
+    struct Bucket {
+        double tokens = 0;
+        Clock::time_point updated;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+        uint64_t limited = 0;
+    };
+
+    void makeRoom(Shard& shard, Clock::time_point now);
+
+    double rate_;
+    double burst_;
+    size_t shardCapacity_;
+    std::vector<Shard> shards_;
+};
@@ -0,0 +1,71 @@
+#include "request_metrics.h"
+#include "../metrics/metrics.h"
+#include <unordered_map>
+#include <vector>
+
+static const char* const ROUTE_LABELS[] = {
+    "/health",
+    "/health/ready",
+    "/metrics",
+    "/api/stats",
+    "/api/current_notifs",
+    "/api/stops/search",
+    "/api/stops/nearby",
+    "/api/departures/batch",
+    "/api/stops/<stop_id>",
+    "other"
+};
+static constexpr size_t ROUTE_COUNT = sizeof(ROUTE_LABELS) / sizeof(ROUTE_LABELS[0]);
+
+static size_t routeIndex(const std::string& url) {
+    static const std::string stopPrefix = "/api/stops/";
+    for (size_t i = 0; i + 2 < ROUTE_COUNT; ++i) {
+        if (url == ROUTE_LABELS[i]) return i;
+    }
+    if (url.size() > stopPrefix.size() && url.compare(0, stopPrefix.size(), stopPrefix) == 0 &&
+        url.find('/', stopPrefix.size()) == std::string::npos) {
+        return ROUTE_COUNT - 2;
+    }
+    return ROUTE_COUNT - 1;
+}
+
+const char* routeLabel(const std::string& url) {
+    return ROUTE_LABELS[routeIndex(url)];
+}
+
+static const MetricHistogram& routeLatency(size_t route) {
+    static const std::vector<MetricHistogram> histograms = [] {
+        std::vector<MetricHistogram> out;
+        for (const char* label : ROUTE_LABELS) {
+            out.push_back(registerHistogram("kvv_http_request_duration_seconds",
+                                            "Time from routing to the completed response.",
+                                            {{"route", label}}));
+        }
+        return out;
+    }();
+    return histograms[route];
+}
+
+// Status codes are open-ended, so each thread keeps its own handle cache and
+// only registers a (route, code) pair the first time it sees it.
+static const MetricCounter& routeRequests(size_t route, int code) {
+    thread_local std::unordered_map<int, MetricCounter> counters;
+    int key = static_cast<int>(route) * 1000 + code;
+    auto it = counters.find(key);
+    if (it == counters.end()) {
+        MetricCounter counter = registerCounter("kvv_http_requests_total", "Handled HTTP requests.",
+                                                {{"route", ROUTE_LABELS[route]}, {"code", std::to_string(code)}});
+        it = counters.emplace(key, counter).first;
+    }
+    return it->second;
+}
+
+void RequestMetrics::before_handle(crow::request& /*req*/, crow::response& /*res*/, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+}
+
+void RequestMetrics::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    size_t route = routeIndex(req.url);
+    routeLatency(route).observe(std::chrono::steady_clock::now() - ctx.start);
+    routeRequests(route, res.code).inc();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "crow.h"
+#include <chrono>
+
+// --- Request Metrics Middleware ---
+// Counts every handled request by route and status code and records its
+// latency. Routes are labelled by template (stop IDs are folded into
+// "/api/stops/<stop_id>") so the series count stays fixed.
+// Route template the request is counted under, e.g. "/api/stops/<stop_id>".
+const char* routeLabel(const std::string& url);
+
+struct RequestMetrics {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
@@ -0,0 +1,130 @@
+#include "request_tracing.h"
+#include "request_metrics.h"
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <random>
+
+inline constexpr size_t MAX_REQUEST_ID_LENGTH = 64;
+inline constexpr size_t RECENT_SLOW_REQUESTS = 20;
+
+// tracing_config is set once in main() before app.run().
+static TracingConfig tracing_config;
+static std::atomic<uint64_t> traced_requests{0};
+static std::atomic<uint64_t> slow_requests{0};
+static std::atomic<uint64_t> slow_logged{0};
+
+static std::mutex slow_log_mutex;
+static std::deque<json> recent_slow;  // Newest last
+static int64_t slow_log_second = 0;
+static long slow_log_count = 0;
+
+void configureTracing(const TracingConfig& config) {
+    tracing_config = config;
+    if (config.enabled) {
+        std::cout << "Request tracing enabled (slow log at " << config.slowMs << " ms)." << std::endl;
+    }
+}
+
+static bool isValidRequestId(const std::string& id) {
+    if (id.empty() || id.size() > MAX_REQUEST_ID_LENGTH) return false;
+    return std::all_of(id.begin(), id.end(), [](unsigned char c) {
+        return std::isalnum(c) != 0 || c == '-' || c == '_' || c == '.';
+    });
+}
+
+static std::string generateRequestId() {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    std::ostringstream id;
+    id << std::hex << std::setfill('0') << std::setw(16) << generator();
+    return id.str();
+}
+
+static double millis(uint64_t nanos) {
+    return static_cast<double>(nanos) / 1e6;
+}
+
+static std::string serverTimingHeader(const std::vector<TraceSpan>& spans, uint64_t totalNs) {
+    std::ostringstream header;
+    header.imbue(std::locale::classic());
+    header << std::fixed << std::setprecision(3);
+    for (const auto& span : spans) header << span.stage << ";dur=" << millis(span.endNs - span.startNs) << ", ";
+    header << "total;dur=" << millis(totalNs);
+    return header.str();
+}
+
+// Span offsets and durations in microseconds, relative to the request start.
+static json slowRequestEntry(const crow::request& req, const crow::response& res, const RequestTrace& trace,
+                             const std::vector<TraceSpan>& spans, uint64_t totalNs) {
+    json stages = json::array();
+    for (const auto& span : spans) {
+        stages.push_back({{"stage", span.stage},
+                          {"start_us", (span.startNs - trace.startNs()) / 1000},
+                          {"duration_us", (span.endNs - span.startNs) / 1000}});
+    }
+    auto unixSeconds = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return {
+        {"type", "slow_request"},
+        {"time", unixSeconds},
+        {"request_id", trace.id()},
+        {"method", crow::method_name(req.method)},
+        {"route", routeLabel(req.url)},
+        {"url", req.url},
+        {"status", res.code},
+        {"total_us", totalNs / 1000},
+        {"spans", stages}
+    };
+}
+
+static void recordSlowRequest(json entry) {
+    slow_requests.fetch_add(1, std::memory_order_relaxed);
+    int64_t second = static_cast<int64_t>(monotonicNanos() / 1000000000);
+
+    std::lock_guard<std::mutex> lock(slow_log_mutex);
+    if (second != slow_log_second) {
+        slow_log_second = second;
+        slow_log_count = 0;
+    }
+    if (slow_log_count < tracing_config.slowLogPerSecond) {
+        ++slow_log_count;
+        slow_logged.fetch_add(1, std::memory_order_relaxed);
+        std::cout << entry.dump() << std::endl;
+    }
+    recent_slow.push_back(std::move(entry));
+    if (recent_slow.size() > RECENT_SLOW_REQUESTS) recent_slow.pop_front();
+}
+
+void RequestTracing::before_handle(crow::request& req, crow::response& /*res*/, context& ctx) {
+    if (!tracing_config.enabled) return;
+    std::string id = req.get_header_value("X-Request-ID");
+    if (!isValidRequestId(id)) id = generateRequestId();
+    ctx.trace = std::make_shared<RequestTrace>(std::move(id), monotonicNanos());
+    setCurrentTrace(ctx.trace);
+    traced_requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RequestTracing::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (!ctx.trace) return;
+    uint64_t totalNs = monotonicNanos() - ctx.trace->startNs();
+    std::vector<TraceSpan> spans = ctx.trace->finish();
+
+    res.set_header("X-Request-ID", ctx.trace->id());
+    if (tracing_config.serverTiming) res.set_header("Server-Timing", serverTimingHeader(spans, totalNs));
+    if (totalNs >= static_cast<uint64_t>(tracing_config.slowMs) * 1000000) {
+        recordSlowRequest(slowRequestEntry(req, res, *ctx.trace, spans, totalNs));
+    }
+    if (currentTrace() == ctx.trace) setCurrentTrace(nullptr);
+}
+
+TracingStats getTracingStats() {
+    TracingStats stats;
+    stats.enabled = tracing_config.enabled;
+    stats.traced = traced_requests.load(std::memory_order_relaxed);
+    stats.slow = slow_requests.load(std::memory_order_relaxed);
+    stats.slowLogged = slow_logged.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(slow_log_mutex);
+    for (const auto& entry : recent_slow) stats.recentSlow.push_back(entry);
+    return stats;
+}
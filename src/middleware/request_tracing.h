@@ -0,0 +1,31 @@
+#pragma once
+
+#include "crow.h"
+#include "../config/config.h"
+#include "../metrics/tracing.h"
+
+// --- Request Tracing Middleware ---
+// With tracing on, every request gets a trace whose ID is taken from a valid
+// X-Request-ID header or generated, and echoed in X-Request-ID. When the
+// response is done the spans are optionally sent as Server-Timing. Requests
+// over the slow threshold are logged as one JSON line with their spans,
+// rate-limited per second, and the most recent ones are kept for /api/stats.
+struct RequestTracing {
+    struct context {
+        TracePtr trace;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+struct TracingStats {
+    bool enabled = false;
+    uint64_t traced = 0;
+    uint64_t slow = 0;        // Requests over the slow threshold
+    uint64_t slowLogged = 0;  // Of those, written to the slow log
+    json recentSlow = json::array();
+};
+
+void configureTracing(const TracingConfig& config);
+TracingStats getTracingStats();
@@ -0,0 +1,24 @@
+#include "response_compression.h"
+#include "../http/compression.h"
+#include "../metrics/tracing.h"
+
+static bool isCompressibleType(const std::string& contentType) {
+    return contentType.rfind("application/json", 0) == 0 || contentType.rfind("text/plain", 0) == 0;
+}
+
+void ResponseCompression::before_handle(crow::request& /*req*/, crow::response& /*res*/, context& /*ctx*/) {}
+
+void ResponseCompression::after_handle(crow::request& req, crow::response& res, context& /*ctx*/) {
+    if (res.body.empty() || !res.get_header_value("Content-Encoding").empty()) return;
+    if (!isCompressibleType(res.get_header_value("Content-Type"))) return;
+    res.set_header("Vary", "Accept-Encoding");
+
+    ContentEncoding encoding = negotiateEncoding(req.get_header_value("Accept-Encoding"), res.body.size());
+    if (encoding == ContentEncoding::Identity) return;
+    TraceSpanTimer span("compress");
+    std::string compressed = compressBody(encoding, res.body);
+    if (compressed.empty()) return;
+
+    res.body = std::move(compressed);
+    res.set_header("Content-Encoding", contentEncodingName(encoding));
+}
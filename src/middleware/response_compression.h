@@ -0,0 +1,14 @@
+#pragma once
+
+#include "crow.h"
+
+// --- Response Compression Middleware ---
+// Compresses JSON and text bodies the handler produced itself, per request.
+// Cached bodies arrive already encoded by cachedBodyResponse (which keeps the
+// compressed variant with the cache entry) and are passed through unchanged.
+struct ResponseCompression {
+    struct context {};
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
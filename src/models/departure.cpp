@@ -0,0 +1,218 @@
+#include "departure.h"
+#include "../config/config.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// --- Helper: JSON String (same escaping as nlohmann dump, ensure_ascii off) ---
+static void appendJsonString(std::string& out, const std::string& value) {
+    static constexpr char hexDigits[] = "0123456789abcdef";
+    out += '"';
+    for (char ch : value) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hexDigits[c >> 4];
+                    out += hexDigits[c & 0x0f];
+                } else {
+                    out += ch;
+                }
+        }
+    }
+    out += '"';
+}
+
+static void appendKey(std::string& out, bool& first, const char* key) {
+    if (!first) out += ',';
+    first = false;
+    out += '"';
+    out += key;
+    out += "\":";
+}
+
+static void appendInt(std::string& out, int value) {
+    out += std::to_string(value);
+}
+
+static void appendBool(std::string& out, bool value) {
+    out += value ? "true" : "false";
+}
+
+void appendDepartureJson(std::string& out, const Departure& d, bool detailed, bool includeDelay) {
+    bool first = true;
+    bool servingLine = d.hasServingLine;
+    bool details = servingLine && detailed;
+
+    out += '{';
+    if (servingLine && includeDelay && d.delayMinutes) {
+        appendKey(out, first, "delay_minutes");
+        appendInt(out, *d.delayMinutes);
+    }
+    if (servingLine) {
+        appendKey(out, first, "direction");
+        appendJsonString(out, d.direction);
+    }
+    if (detailed && !d.hints.empty()) {
+        appendKey(out, first, "hints");
+        out += '[';
+        for (size_t i = 0; i < d.hints.size(); ++i) {
+            if (i > 0) out += ',';
+            appendJsonString(out, d.hints[i]);
+        }
+        out += ']';
+    }
+    appendKey(out, first, "is_realtime");
+    appendBool(out, d.isRealtime);
+    if (servingLine) {
+        appendKey(out, first, "line");
+        appendJsonString(out, d.line);
+    }
+    if (details) {
+        appendKey(out, first, "low_floor");
+        appendBool(out, d.lowFloor);
+    }
+    appendKey(out, first, "minutes_remaining");
+    appendInt(out, d.minutesRemaining);
+    if (servingLine) {
+        appendKey(out, first, "mot");
+        appendInt(out, d.mot);
+    }
+    appendKey(out, first, "platform");
+    appendJsonString(out, d.platform);
+    if (details) {
+        // train_length and train_composition are mutually exclusive upstream fallbacks
+        if (d.trainComposition && !d.trainLength) {
+            appendKey(out, first, "train_composition");
+            appendJsonString(out, *d.trainComposition);
+        }
+        if (d.trainLength) {
+            appendKey(out, first, "train_length");
+            appendJsonString(out, *d.trainLength);
+        }
+        if (d.trainType) {
+            appendKey(out, first, "train_type");
+            appendJsonString(out, *d.trainType);
+        }
+        appendKey(out, first, "wheelchair_accessible");
+        appendBool(out, d.wheelchairAccessible);
+    }
+    out += '}';
+}
+
+// --- Snapshot Encoding ---
+// One array per departure, fields in declaration order; optionals are null.
+std::string encodeDepartures(const std::vector<Departure>& departures) {
+    auto optional = [](const auto& value) { return value ? json(*value) : json(nullptr); };
+    json out = json::array();
+    for (const auto& d : departures) {
+        out.push_back({d.hasServingLine, d.line, d.direction, d.mot, optional(d.delayMinutes), d.lowFloor,
+                       d.wheelchairAccessible, optional(d.trainType), optional(d.trainLength),
+                       optional(d.trainComposition), d.platform, d.minutesRemaining, d.isRealtime, d.hints,
+                       d.tripKey});
+    }
+    return out.dump();
+}
+
+std::optional<std::vector<Departure>> decodeDepartures(const std::string& payload) {
+    json parsed = json::parse(payload, nullptr, false);
+    if (!parsed.is_array()) return std::nullopt;
+
+    std::vector<Departure> departures;
+    departures.reserve(parsed.size());
+    try {
+        for (const auto& item : parsed) {
+            if (!item.is_array() || item.size() != 15) return std::nullopt;
+            auto optionalString = [](const json& value) {
+                return value.is_null() ? std::nullopt : std::optional<std::string>(value.get<std::string>());
+            };
+            Departure d;
+            d.hasServingLine = item[0].get<bool>();
+            d.line = item[1].get<std::string>();
+            d.direction = item[2].get<std::string>();
+            d.mot = item[3].get<int>();
+            if (!item[4].is_null()) d.delayMinutes = item[4].get<int>();
+            d.lowFloor = item[5].get<bool>();
+            d.wheelchairAccessible = item[6].get<bool>();
+            d.trainType = optionalString(item[7]);
+            d.trainLength = optionalString(item[8]);
+            d.trainComposition = optionalString(item[9]);
+            d.platform = item[10].get<std::string>();
+            d.minutesRemaining = item[11].get<int>();
+            d.isRealtime = item[12].get<bool>();
+            d.hints = item[13].get<std::vector<std::string>>();
+            d.tripKey = item[14].get<std::string>();
+            departures.push_back(std::move(d));
+        }
+    } catch (const json::exception&) {
+        return std::nullopt;
+    }
+    return departures;
+}
+
+// --- Accessibility Hint Matcher ---
+// A single pass over the text: a 256-entry table maps each byte to the
+// keywords starting with it, and only those are compared at that offset.
+// Keyword first letters are rare enough that most bytes cost one lookup.
+namespace {
+
+constexpr uint8_t HINT_LOW_FLOOR = 1;
+constexpr uint8_t HINT_WHEELCHAIR = 2;
+
+struct HintKeyword {
+    std::string_view word;
+    uint8_t flag;
+};
+
+constexpr HintKeyword HINT_KEYWORDS[] = {
+    {"Niederflur", HINT_LOW_FLOOR}, {"low floor", HINT_LOW_FLOOR}, {"lowFloor", HINT_LOW_FLOOR},
+    {"Rollstuhl", HINT_WHEELCHAIR}, {"wheelchair", HINT_WHEELCHAIR},
+    {"barrierefrei", HINT_WHEELCHAIR}, {"barrier-free", HINT_WHEELCHAIR},
+};
+constexpr size_t HINT_KEYWORD_COUNT = sizeof(HINT_KEYWORDS) / sizeof(HINT_KEYWORDS[0]);
+
+// Bit i set when HINT_KEYWORDS[i] starts with the byte
+constexpr std::array<uint8_t, 256> HINT_FIRST_BYTES = [] {
+    std::array<uint8_t, 256> table{};
+    for (size_t i = 0; i < HINT_KEYWORD_COUNT; ++i) {
+        table[static_cast<uint8_t>(HINT_KEYWORDS[i].word[0])] |= static_cast<uint8_t>(1u << i);
+    }
+    return table;
+}();
+
+} // namespace
+
+HintAccessibility scanAccessibilityHint(std::string_view text) {
+    uint8_t found = 0;
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        uint8_t candidates = HINT_FIRST_BYTES[static_cast<uint8_t>(text[pos])];
+        if (candidates == 0) continue;
+        for (size_t i = 0; i < HINT_KEYWORD_COUNT; ++i) {
+            if ((candidates >> i & 1) == 0) continue;
+            std::string_view word = HINT_KEYWORDS[i].word;
+            if (text.size() - pos >= word.size() && std::memcmp(text.data() + pos, word.data(), word.size()) == 0) {
+                found |= HINT_KEYWORDS[i].flag;
+            }
+        }
+        if (found == (HINT_LOW_FLOOR | HINT_WHEELCHAIR)) break;
+    }
+    return {(found & HINT_LOW_FLOOR) != 0, (found & HINT_WHEELCHAIR) != 0};
+}
+
+bool equalsIgnoreCase(std::string_view text, std::string_view lowercase) {
+    if (text.size() != lowercase.size()) return false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+        if (c != static_cast<unsigned char>(lowercase[i])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One normalized departure (the detailed + delay superset). Fields that
+// normalizeResponse only emits when the upstream entry has a servingLine are
+// guarded by hasServingLine.
+struct Departure {
+    bool hasServingLine = false;
+    std::string line;
+    std::string direction;
+    int mot = -1;
+    std::optional<int> delayMinutes;
+    bool lowFloor = false;
+    bool wheelchairAccessible = false;
+    std::optional<std::string> trainType;
+    std::optional<std::string> trainLength;
+    std::optional<std::string> trainComposition;
+
+    std::string platform = "Unknown";
+    int minutesRemaining = 0;
+    bool isRealtime = false;
+    std::vector<std::string> hints;
+
+    // Identifies the same trip across refreshes (line ID plus planned time);
+    // used for since= deltas, never serialized.
+    std::string tripKey;
+};
+
+// --- Serialization ---
+// Appends the departure as a JSON object, byte-for-byte what json::dump()
+// produced for the normalizeResponse item (keys in sorted order). The
+// detailed and delay fields are left out when not requested.
+void appendDepartureJson(std::string& out, const Departure& departure, bool detailed, bool includeDelay);
+
+// --- Snapshot Encoding ---
+// Compact JSON of the full model (tripKey included) for the persistent cache
+// tier; decodeDepartures returns nullopt for anything it did not write.
+std::string encodeDepartures(const std::vector<Departure>& departures);
+std::optional<std::vector<Departure>> decodeDepartures(const std::string& payload);
+
+// --- Accessibility Hints ---
+// One pass over a hint text for every keyword normalizeResponse looks for:
+// lowFloor for "Niederflur", "low floor" or "lowFloor"; wheelchair for
+// "Rollstuhl", "wheelchair", "barrierefrei" or "barrier-free".
+struct HintAccessibility {
+    bool lowFloor = false;
+    bool wheelchair = false;
+};
+
+HintAccessibility scanAccessibilityHint(std::string_view text);
+
+// ASCII case-insensitive equality without a lowered copy (toLower(a) == b
+// for a lowercase b)
+bool equalsIgnoreCase(std::string_view text, std::string_view lowercase);
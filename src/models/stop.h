@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <optional>
+
+struct StopRecord {
+    std::string stop_id;
+    std::optional<std::string> local_id;
+    std::string stop_name;
+    std::optional<std::string> city;
+    std::optional<std::string> mot_array;
+    double latitude;
+    double longitude;
+};
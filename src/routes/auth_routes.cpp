@@ -1,10 +1,40 @@
 #include "auth_routes.h"
+#include "../services/warmup_service.h"
 
-void registerAuthRoutes(crow::SimpleApp& app, Database& /*db*/) {
-    // --- Route: Health Check (no authentication required) ---
+namespace {
+json warmupReport(const WarmupStatus& status) {
+    json tasks = json::array();
+    for (const auto& task : status.tasks) {
+        json item = {{"name", task.name}, {"status", warmupTaskStateName(task.state)}, {"elapsed_ms", task.elapsedMs}};
+        if (!task.detail.empty()) item["detail"] = task.detail;
+        tasks.push_back(item);
+    }
+    return {
+        {"elapsed_ms", status.elapsedMs},
+        {"budget_ms", status.budgetMs},
+        {"timed_out", status.timedOut},
+        {"tasks", tasks}
+    };
+}
+}
+
+void registerAuthRoutes(App& app, Database& /*db*/) {
+    // --- Route: Health Check (liveness; no authentication required) ---
     CROW_ROUTE(app, "/health")
     ([](const crow::request& /*req*/){
-        auto response = crow::response(200, R"({"status":"ok"})");
+        WarmupStatus status = getWarmupStatus();
+        json body = {{"status", "ok"}, {"ready", status.ready}, {"warmup", warmupReport(status)}};
+        auto response = crow::response(200, body.dump());
+        response.set_header("Content-Type", "application/json");
+        return response;
+    });
+
+    // --- Route: Readiness (503 until warm-up finished or ran out of budget) ---
+    CROW_ROUTE(app, "/health/ready")
+    ([](const crow::request& /*req*/){
+        WarmupStatus status = getWarmupStatus();
+        json body = {{"status", status.ready ? "ready" : "warming_up"}, {"warmup", warmupReport(status)}};
+        auto response = crow::response(status.ready ? 200 : 503, body.dump());
         response.set_header("Content-Type", "application/json");
         return response;
     });
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "crow.h"
+#include "../app.h"
 #include "../db/database.h"
 
-void registerAuthRoutes(crow::SimpleApp& app, Database& db);
+void registerAuthRoutes(App& app, Database& db);
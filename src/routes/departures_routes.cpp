@@ -1,16 +1,45 @@
 #include "departures_routes.h"
+#include "../metrics/tracing.h"
 #include "../middleware/api_key_auth.h"
+#include "../middleware/http_cache.h"
 #include "../services/departures_service.h"
+#include <unordered_set>
 
-void registerDeparturesRoutes(crow::SimpleApp& app, Database& db) {
+namespace {
+bool parseBoolOption(const json& body, const char* key) {
+    if (!body.contains(key)) return false;
+    const auto& value = body.at(key);
+    if (value.is_boolean()) return value.get<bool>();
+    if (value.is_string()) return value.get<std::string>() == "true" || value.get<std::string>() == "1";
+    return false;
+}
+
+crow::response badRequest(const std::string& body) {
+    auto response = crow::response(400, body);
+    setSecurityHeaders(response);
+    return response;
+}
+
+void respond(crow::response& res, crow::response response) {
+    res = std::move(response);
+    res.end();
+}
+}
+
+void registerDeparturesRoutes(App& app, Database& db) {
     // --- Route: Departures ---
+    // Asynchronous: a cache miss returns the worker to Crow and the response is
+    // completed from the upstream completion pool once the DM answer arrives.
     CROW_ROUTE(app, "/api/stops/<string>")
-    ([&db](const crow::request& req, std::string stopId){
-        if (!isAuthenticated(req, db)) return unauthorizedResponse();
+    ([&db](const crow::request& req, crow::response& res, std::string stopId){
+        // after_handle runs wherever res.end() is called, so scope the worker's
+        // trace to this call instead of leaving it for later work on the thread
+        TraceScope scope(takeCurrentTrace());
+        if (auto rejection = rejectRequest(req, db)) return respond(res, std::move(*rejection));
         if (!isValidStopId(stopId)) {
             auto response = crow::response(400, R"({"error":"Invalid stop ID"})");
             setSecurityHeaders(response);
-            return response;
+            return respond(res, std::move(response));
         }
 
         const char* detailedParam = req.url_params.get("detailed");
@@ -20,17 +49,96 @@ void registerDeparturesRoutes(crow::SimpleApp& app, Database& db) {
         bool includeDelay = (delayParam && (std::string(delayParam) == "true" || std::string(delayParam) == "1"));
 
         const char* requestedTrack = req.url_params.get("track");
+        std::optional<std::string> track;
+        if (requestedTrack) track = requestedTrack;
 
-        json result = getDepartures(stopId, detailed, includeDelay, requestedTrack);
+        // Version token from an earlier response's X-Departures-Version header
+        const char* sinceParam = req.url_params.get("since");
+        std::optional<std::string> since;
+        if (sinceParam) since = sinceParam;
 
-        if (result.is_object() && result.contains("error")) {
-            auto response = crow::response(502, result.dump());
-            setSecurityHeaders(response);
-            return response;
+        // req and res stay valid until res.end(); Crow keeps the connection alive
+        getDepartures(stopId, detailed, includeDelay, std::move(track), std::move(since),
+                      [&req, &res](DeparturesResult result) {
+            if (result.overloaded) return respond(res, overloadedResponse());
+            if (result.error) {
+                auto response = crow::response(502, result.error->dump());
+                setSecurityHeaders(response);
+                return respond(res, std::move(response));
+            }
+            auto response = cachedBodyResponse(req, *result.body);
+            response.set_header("X-Departures-Version", result.version);
+            respond(res, std::move(response));
+        });
+    });
+
+    // --- Route: Batch Departures ---
+    // One authenticated request for several stops; the response is keyed by stop
+    // ID and splices the cached per-stop bodies without re-serializing them.
+    CROW_ROUTE(app, "/api/departures/batch").methods(crow::HTTPMethod::Post)
+    ([&db](const crow::request& req, crow::response& res){
+        TraceScope scope(takeCurrentTrace());
+        if (auto rejection = rejectRequest(req, db)) return respond(res, std::move(*rejection));
+
+        json body = json::parse(req.body, nullptr, false);
+        if (body.is_discarded() || !body.is_object()) return respond(res, badRequest(R"({"error":"Invalid JSON body"})"));
+
+        if (!body.contains("stops") || !body.at("stops").is_array() || body.at("stops").empty()) {
+            return respond(res, badRequest(R"({"error":"Missing 'stops' array"})"));
+        }
+        if (body.at("stops").size() > MAX_BATCH_STOPS) {
+            static const std::string tooMany =
+                json{{"error", "Too many stops, at most " + std::to_string(MAX_BATCH_STOPS) + " allowed"}}.dump();
+            return respond(res, badRequest(tooMany));
+        }
+
+        std::optional<std::string> track;
+        if (body.contains("track") && !body.at("track").is_null()) {
+            if (!body.at("track").is_string()) return respond(res, badRequest(R"({"error":"Invalid 'track' parameter"})"));
+            track = body.at("track").get<std::string>();
         }
+        bool detailed = parseBoolOption(body, "detailed");
+        bool includeDelay = parseBoolOption(body, "delay");
+
+        // Keep request order, drop duplicates, and answer invalid IDs without fetching
+        std::vector<std::string> requested;
+        std::vector<std::string> valid;
+        std::unordered_set<std::string> seen;
+        for (const auto& item : body.at("stops")) {
+            if (!item.is_string()) return respond(res, badRequest(R"({"error":"Invalid 'stops' array"})"));
+            std::string stopId = item.get<std::string>();
+            if (!seen.insert(stopId).second) continue;
+            requested.push_back(stopId);
+            if (isValidStopId(stopId)) valid.push_back(stopId);
+        }
+
+        auto respondBatch = [&req, &res, requested = std::move(requested), valid](std::vector<DeparturesResult> results) {
+            std::string out = "{";
+            size_t next = 0;
+            for (size_t i = 0; i < requested.size(); ++i) {
+                if (i > 0) out += ',';
+                out += json(requested[i]).dump();
+                out += ':';
+
+                if (next >= valid.size() || valid[next] != requested[i]) {
+                    out += R"({"status":400,"error":"Invalid stop ID"})";
+                    continue;
+                }
+                const DeparturesResult& result = results[next++];
+                if (result.error) {
+                    json error = result.error->is_object() ? *result.error : json{{"error", *result.error}};
+                    error["status"] = result.overloaded ? 503 : 502;
+                    out += error.dump();
+                } else {
+                    out += R"({"status":200,"departures":)";
+                    out += result.body->data;
+                    out += '}';
+                }
+            }
+            out += '}';
 
-        auto response = crow::response(result.dump());
-        setSecurityHeaders(response);
-        return response;
+            respond(res, cachedBodyResponse(req, *makeCachedBody(std::move(out))));
+        };
+        getDeparturesBatch(valid, detailed, includeDelay, std::move(track), std::move(respondBatch));
     });
 }
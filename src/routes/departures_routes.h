@@ -1,6 +1,6 @@
 #pragma once
 
-#include "crow.h"
+#include "../app.h"
 #include "../db/database.h"
 
-void registerDeparturesRoutes(crow::SimpleApp& app, Database& db);
+void registerDeparturesRoutes(App& app, Database& db);
@@ -1,12 +1,13 @@
 #include "notifications_routes.h"
 #include "../middleware/api_key_auth.h"
+#include "../middleware/http_cache.h"
 #include "../services/notifications_service.h"
 
-void registerNotificationsRoutes(crow::SimpleApp& app, Database& db) {
+void registerNotificationsRoutes(App& app, Database& db) {
     // --- Route: Current Notifications ---
     CROW_ROUTE(app, "/api/current_notifs")
     ([&db](const crow::request& req){
-        if (!isAuthenticated(req, db)) return unauthorizedResponse();
+        if (auto rejection = rejectRequest(req, db)) return std::move(*rejection);
         auto stopIdParam = req.url_params.get("stopID");
 
         if (!stopIdParam) {
@@ -22,10 +23,10 @@ void registerNotificationsRoutes(crow::SimpleApp& app, Database& db) {
             return response;
         }
 
-        json notifications = extractValidNotifications(stopId);
-
-        auto response = crow::response(notifications.dump());
-        setSecurityHeaders(response);
+        NotificationsResultPtr notifications = getNotifications(stopId);
+        if (!notifications) return overloadedResponse();
+        auto response = cachedBodyResponse(req, *notifications->body);
+        response.set_header("X-Provider-Status", formatProviderStatus(notifications->providers));
         return response;
     });
 }
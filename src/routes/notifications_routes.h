@@ -1,6 +1,6 @@
 #pragma once
 
-#include "crow.h"
+#include "../app.h"
 #include "../db/database.h"
 
-void registerNotificationsRoutes(crow::SimpleApp& app, Database& db);
+void registerNotificationsRoutes(App& app, Database& db);
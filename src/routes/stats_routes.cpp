@@ -0,0 +1,334 @@
+#include "stats_routes.h"
+#include "../cache/snapshot_store.h"
+#include "../http/admission.h"
+#include "../http/upstream_client.h"
+#include "../metrics/metrics.h"
+#include "../search/stop_index.h"
+#include "../middleware/api_key_auth.h"
+#include "../services/auth_service.h"
+#include "../services/departures_service.h"
+#include "../services/notifications_service.h"
+#include "../services/stops_service.h"
+#include "../services/stream_service.h"
+
+namespace {
+json cacheStatsToJson(const CacheShardStats& s) {
+    return {
+        {"hits", s.hits},
+        {"misses", s.misses},
+        {"evictions", s.evictions},
+        {"expirations", s.expirations},
+        {"size", s.size}
+    };
+}
+
+json cacheReport(const std::vector<CacheShardStats>& shards) {
+    json perShard = json::array();
+    for (const auto& shard : shards) perShard.push_back(cacheStatsToJson(shard));
+    json report = cacheStatsToJson(sumCacheStats(shards));
+    report["shards"] = perShard;
+    return report;
+}
+
+json upstreamReport() {
+    json hosts = json::array();
+    for (const auto& h : getUpstreamHostStats()) {
+        hosts.push_back({
+            {"host", h.host},
+            {"requests", h.requests},
+            {"errors", h.errors},
+            {"new_connections", h.newConnections},
+            {"reused_connections", h.reusedConnections},
+            {"http2_responses", h.http2Responses},
+            {"avg_handshake_ms", h.newConnections > 0
+                ? static_cast<double>(h.handshakeMicros) / 1000.0 / static_cast<double>(h.newConnections)
+                : 0.0},
+            {"idle_sessions", h.idleSessions},
+            {"circuit_state", circuitStateName(h.circuitState)},
+            {"circuit_openings", h.circuitOpenings},
+            {"circuit_rejections", h.circuitRejections},
+            {"timeout_ms", h.timeoutMs > 0 ? h.timeoutMs : UPSTREAM_TIMEOUT_SECONDS * 1000},
+            {"queued", h.queued},
+            {"throttled", h.throttled},
+            {"rate_limited_responses", h.rateLimitedResponses}
+        });
+    }
+    return hosts;
+}
+
+json streamReport() {
+    StreamStats s = getStreamStats();
+    return {
+        {"clients", s.clients},
+        {"stops", s.stops},
+        {"pushes", s.pushes},
+        {"ticks", s.ticks}
+    };
+}
+
+json cacheSnapshotReport() {
+    SnapshotStoreStats s = getSnapshotStoreStats();
+    return {
+        {"enabled", s.enabled},
+        {"entries", s.entries},
+        {"bytes", s.bytes},
+        {"hits", s.hits},
+        {"writes", s.writes},
+        {"write_failures", s.writeFailures},
+        {"last_write", s.lastWriteUnix}
+    };
+}
+
+json admissionReport() {
+    RateLimitStats limits = getRateLimitStats();
+    json lanes = json::object();
+    for (const auto& lane : getAdmissionStats()) {
+        lanes[lane.lane] = {
+            {"in_flight", lane.inFlight},
+            {"limit", lane.limit},
+            {"admitted", lane.admitted},
+            {"shed", lane.shed}
+        };
+    }
+    return {
+        {"rate_limit", {{"enabled", limits.enabled}, {"buckets", limits.buckets}, {"limited", limits.limited}}},
+        {"lanes", lanes}
+    };
+}
+
+json tracingReport() {
+    TracingStats s = getTracingStats();
+    return {
+        {"enabled", s.enabled},
+        {"traced", s.traced},
+        {"slow", s.slow},
+        {"slow_logged", s.slowLogged},
+        {"recent_slow", s.recentSlow}
+    };
+}
+
+json searchIndexReport() {
+    StopIndexStats s = getStopIndexStats();
+    return {
+        {"indexed_stops", s.stops},
+        {"known_queries", s.knownQueries},
+        {"local_answers", s.localAnswers},
+        {"fuzzy_answers", s.fuzzyAnswers},
+        {"upstream_fallbacks", s.declined}
+    };
+}
+
+json nearbyReport() {
+    NearbyStats s = getNearbyStats();
+    return {
+        {"indexed_stops", s.indexedStops},
+        {"index_answers", s.indexAnswers},
+        {"postgis_answers", s.postgisAnswers},
+        {"consistency_checks", s.consistencyChecks},
+        {"consistency_mismatches", s.consistencyMismatches}
+    };
+}
+
+// --- Prometheus Families from Existing Stats ---
+void appendCacheMetrics(std::string& out) {
+    const std::pair<const char*, std::vector<CacheShardStats>> caches[] = {
+        {"departures", getDepartureCacheStats()},
+        {"search", getSearchCacheStats()},
+        {"notifications", getNotificationCacheStats()},
+        {"api_keys", getAuthCacheStats()},
+        {"api_keys_negative", getNegativeAuthCacheStats()}
+    };
+
+    std::vector<MetricSample> hits, misses, evictions, expirations, entries;
+    for (const auto& [name, shards] : caches) {
+        CacheShardStats s = sumCacheStats(shards);
+        MetricLabels labels = {{"cache", name}};
+        hits.push_back({labels, static_cast<double>(s.hits)});
+        misses.push_back({labels, static_cast<double>(s.misses)});
+        evictions.push_back({labels, static_cast<double>(s.evictions)});
+        expirations.push_back({labels, static_cast<double>(s.expirations)});
+        entries.push_back({labels, static_cast<double>(s.size)});
+    }
+    appendMetricFamily(out, "kvv_cache_hits_total", "counter", "Cache lookups that found an entry.", hits);
+    appendMetricFamily(out, "kvv_cache_misses_total", "counter", "Cache lookups that found nothing.", misses);
+    appendMetricFamily(out, "kvv_cache_evictions_total", "counter", "Entries dropped to make room.", evictions);
+    appendMetricFamily(out, "kvv_cache_expirations_total", "counter", "Entries dropped after their maximum age.", expirations);
+    appendMetricFamily(out, "kvv_cache_entries", "gauge", "Entries currently cached.", entries);
+}
+
+void appendUpstreamMetrics(std::string& out) {
+    std::vector<MetricSample> requests, errors, newConnections, reused;
+    std::vector<MetricSample> circuitState, circuitOpenings, circuitRejections, timeouts;
+    std::vector<MetricSample> queued, throttled, rateLimited;
+    for (const auto& h : getUpstreamHostStats()) {
+        MetricLabels labels = {{"host", h.host}};
+        requests.push_back({labels, static_cast<double>(h.requests)});
+        errors.push_back({labels, static_cast<double>(h.errors)});
+        newConnections.push_back({labels, static_cast<double>(h.newConnections)});
+        reused.push_back({labels, static_cast<double>(h.reusedConnections)});
+        for (CircuitState state : {CircuitState::Closed, CircuitState::Open, CircuitState::HalfOpen}) {
+            circuitState.push_back({{{"host", h.host}, {"state", circuitStateName(state)}},
+                                    h.circuitState == state ? 1.0 : 0.0});
+        }
+        circuitOpenings.push_back({labels, static_cast<double>(h.circuitOpenings)});
+        circuitRejections.push_back({labels, static_cast<double>(h.circuitRejections)});
+        long timeoutMs = h.timeoutMs > 0 ? h.timeoutMs : UPSTREAM_TIMEOUT_SECONDS * 1000;
+        timeouts.push_back({labels, static_cast<double>(timeoutMs) / 1000.0});
+        queued.push_back({labels, static_cast<double>(h.queued)});
+        throttled.push_back({labels, static_cast<double>(h.throttled)});
+        rateLimited.push_back({labels, static_cast<double>(h.rateLimitedResponses)});
+    }
+    appendMetricFamily(out, "kvv_upstream_requests_total", "counter", "Upstream requests sent.", requests);
+    appendMetricFamily(out, "kvv_upstream_transport_errors_total", "counter",
+                       "Upstream requests that got no HTTP response.", errors);
+    appendMetricFamily(out, "kvv_upstream_new_connections_total", "counter",
+                       "Upstream requests that opened a connection.", newConnections);
+    appendMetricFamily(out, "kvv_upstream_reused_connections_total", "counter",
+                       "Upstream requests served on a kept-alive connection.", reused);
+    appendMetricFamily(out, "kvv_upstream_circuit_state", "gauge",
+                       "Circuit breaker state per host (1 for the current state).", circuitState);
+    appendMetricFamily(out, "kvv_upstream_circuit_openings_total", "counter",
+                       "Times the circuit breaker opened.", circuitOpenings);
+    appendMetricFamily(out, "kvv_upstream_circuit_rejections_total", "counter",
+                       "Upstream requests failed fast by an open circuit.", circuitRejections);
+    appendMetricFamily(out, "kvv_upstream_timeout_seconds", "gauge",
+                       "Current adaptive upstream timeout.", timeouts);
+    appendMetricFamily(out, "kvv_upstream_queued", "gauge",
+                       "Upstream requests waiting for the host's request budget.", queued);
+    appendMetricFamily(out, "kvv_upstream_throttled_total", "counter",
+                       "Upstream requests dropped while waiting for the request budget.", throttled);
+    appendMetricFamily(out, "kvv_upstream_rate_limited_responses_total", "counter",
+                       "Upstream 429 responses.", rateLimited);
+    appendMetricFamily(out, "kvv_upstream_in_flight", "gauge", "Upstream requests waiting for a response.",
+                       {{{}, static_cast<double>(getUpstreamInFlight())}});
+}
+
+void appendStreamMetrics(std::string& out) {
+    StreamStats s = getStreamStats();
+    appendMetricFamily(out, "kvv_stream_clients", "gauge", "Connected departure stream clients.",
+                       {{{}, static_cast<double>(s.clients)}});
+    appendMetricFamily(out, "kvv_stream_stops", "gauge", "Distinct stops with stream subscribers.",
+                       {{{}, static_cast<double>(s.stops)}});
+    appendMetricFamily(out, "kvv_stream_pushes_total", "counter", "Departure updates pushed to stream clients.",
+                       {{{}, static_cast<double>(s.pushes)}});
+}
+
+void appendCacheSnapshotMetrics(std::string& out) {
+    SnapshotStoreStats s = getSnapshotStoreStats();
+    if (!s.enabled) return;
+    appendMetricFamily(out, "kvv_cache_snapshot_entries", "gauge", "Records in the mapped cache snapshot.",
+                       {{{}, static_cast<double>(s.entries)}});
+    appendMetricFamily(out, "kvv_cache_snapshot_bytes", "gauge", "Size of the mapped cache snapshot.",
+                       {{{}, static_cast<double>(s.bytes)}});
+    appendMetricFamily(out, "kvv_cache_snapshot_hits_total", "counter",
+                       "Cache misses answered from the snapshot file.", {{{}, static_cast<double>(s.hits)}});
+    appendMetricFamily(out, "kvv_cache_snapshot_writes_total", "counter", "Cache snapshots written.",
+                       {{{}, static_cast<double>(s.writes)}});
+    appendMetricFamily(out, "kvv_cache_snapshot_write_failures_total", "counter",
+                       "Cache snapshots that could not be written.", {{{}, static_cast<double>(s.writeFailures)}});
+}
+
+void appendAdmissionMetrics(std::string& out) {
+    std::vector<MetricSample> inFlight, shed;
+    for (const auto& lane : getAdmissionStats()) {
+        MetricLabels labels = {{"lane", lane.lane}};
+        inFlight.push_back({labels, static_cast<double>(lane.inFlight)});
+        shed.push_back({labels, static_cast<double>(lane.shed)});
+    }
+    appendMetricFamily(out, "kvv_admission_in_flight", "gauge", "Admitted provider work still running.", inFlight);
+    appendMetricFamily(out, "kvv_admission_shed_total", "counter", "Requests shed with 503 by admission control.", shed);
+    appendMetricFamily(out, "kvv_rate_limited_total", "counter", "Requests answered with 429 by the rate limiter.",
+                       {{{}, static_cast<double>(getRateLimitStats().limited)}});
+}
+
+void appendTracingMetrics(std::string& out) {
+    TracingStats s = getTracingStats();
+    if (!s.enabled) return;
+    appendMetricFamily(out, "kvv_slow_requests_total", "counter", "Traced requests over the slow threshold.",
+                       {{{}, static_cast<double>(s.slow)}});
+}
+
+void appendDatabasePoolMetrics(std::string& out, const Database& db) {
+    PoolStats s = db.poolStats();
+    appendMetricFamily(out, "kvv_db_pool_connections", "gauge", "Open database connections.",
+                       {{{{"state", "idle"}}, static_cast<double>(s.idle)},
+                        {{{"state", "in_use"}}, static_cast<double>(s.open - std::min(s.idle, s.open))}});
+    appendMetricFamily(out, "kvv_db_pool_checkouts_total", "counter", "Connections handed out by the pool.",
+                       {{{}, static_cast<double>(s.checkouts)}});
+    appendMetricFamily(out, "kvv_db_pool_timeouts_total", "counter",
+                       "Acquires that gave up waiting for a connection.", {{{}, static_cast<double>(s.timeouts)}});
+    appendMetricFamily(out, "kvv_db_pool_connect_failures_total", "counter", "Failed connection attempts.",
+                       {{{}, static_cast<double>(s.connectFailures)}});
+}
+
+json databasePoolReport(const Database& db) {
+    PoolStats s = db.poolStats();
+    return {
+        {"open", s.open},
+        {"idle", s.idle},
+        {"checkouts", s.checkouts},
+        {"timeouts", s.timeouts},
+        {"connect_failures", s.connectFailures}
+    };
+}
+}
+
+void registerStatsRoutes(App& app, Database& db) {
+    // --- Route: Runtime Statistics ---
+    CROW_ROUTE(app, "/api/stats")
+    ([&db](const crow::request& req){
+        if (auto rejection = rejectRequest(req, db)) return std::move(*rejection);
+
+        json stats = {
+            {"departures", {
+                {"coalesced_waiters", getCoalescedDepartureWaiters()},
+                {"stale_hits", getStaleDepartureHits()},
+                {"stale_if_error_hits", getStaleIfErrorDepartureHits()},
+                {"background_refreshes", getBackgroundDepartureRefreshes()}
+            }},
+            {"caches", {
+                {"departures", cacheReport(getDepartureCacheStats())},
+                {"search", cacheReport(getSearchCacheStats())},
+                {"notifications", cacheReport(getNotificationCacheStats())},
+                {"api_keys", cacheReport(getAuthCacheStats())},
+                {"api_keys_negative", cacheReport(getNegativeAuthCacheStats())}
+            }},
+            {"cache_snapshot", cacheSnapshotReport()},
+            {"admission", admissionReport()},
+            {"tracing", tracingReport()},
+            {"notifications", {
+                {"indexed_stops", getIndexedNotificationStops()}
+            }},
+            {"stream", streamReport()},
+            {"search", searchIndexReport()},
+            {"nearby", nearbyReport()},
+            {"upstream", upstreamReport()},
+            {"upstream_in_flight", getUpstreamInFlight()},
+            {"database_pool", databasePoolReport(db)}
+        };
+
+        auto response = crow::response(stats.dump());
+        setSecurityHeaders(response);
+        return response;
+    });
+
+    // --- Route: Prometheus Metrics ---
+    CROW_ROUTE(app, "/metrics")
+    ([&db](const crow::request& req){
+        if (auto rejection = rejectRequest(req, db)) return std::move(*rejection);
+
+        std::string body = renderRegisteredMetrics();
+        appendCacheMetrics(body);
+        appendUpstreamMetrics(body);
+        appendStreamMetrics(body);
+        appendCacheSnapshotMetrics(body);
+        appendAdmissionMetrics(body);
+        appendTracingMetrics(body);
+        appendDatabasePoolMetrics(body, db);
+
+        auto response = crow::response(std::move(body));
+        setSecurityHeaders(response);
+        response.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+        return response;
+    });
+}
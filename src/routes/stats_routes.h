@@ -0,0 +1,6 @@
+#pragma once
+
+#include "../app.h"
+#include "../db/database.h"
+
+void registerStatsRoutes(App& app, Database& db);
@@ -1,5 +1,7 @@
 #include "stops_routes.h"
+#include "../metrics/tracing.h"
 #include "../middleware/api_key_auth.h"
+#include "../middleware/http_cache.h"
 #include "../services/stops_service.h"
 #include <cmath>
 #include <limits>
@@ -34,13 +36,21 @@ std::optional<int> parseIntParam(const char* value) {
         return std::nullopt;
     }
 }
+
+void respond(crow::response& res, crow::response response) {
+    res = std::move(response);
+    res.end();
+}
 }
 
-void registerStopsRoutes(crow::SimpleApp& app, Database& db) {
+void registerStopsRoutes(App& app, Database& db) {
     // --- Route: Search Stops ---
+    // Asynchronous like the departures route: upstream searches complete the
+    // response from the upstream completion pool.
     CROW_ROUTE(app, "/api/stops/search")
-    ([&db](const crow::request& req){
-        if (!isAuthenticated(req, db)) return unauthorizedResponse();
+    ([&db](const crow::request& req, crow::response& res){
+        TraceScope scope(takeCurrentTrace());  // See the departures route
+        if (auto rejection = rejectRequest(req, db)) return respond(res, std::move(*rejection));
         auto query = req.url_params.get("q");
         auto city = req.url_params.get("city");
         auto locationParam = req.url_params.get("location");
@@ -50,38 +60,33 @@ void registerStopsRoutes(crow::SimpleApp& app, Database& db) {
         if (!query) {
             auto response = crow::response(400, R"({"error":"Missing 'q' parameter"})");
             setSecurityHeaders(response);
-            return response;
+            return respond(res, std::move(response));
         }
 
         std::string queryStr(query);
         if (!isValidSearchQuery(queryStr)) {
             auto response = crow::response(400, R"({"error":"Invalid search query"})");
             setSecurityHeaders(response);
-            return response;
+            return respond(res, std::move(response));
         }
 
         std::string cityStr = city ? std::string(city) : "";
         if (!cityStr.empty() && !isValidSearchQuery(cityStr)) {
             auto response = crow::response(400, R"({"error":"Invalid city parameter"})");
             setSecurityHeaders(response);
-            return response;
-        }
-
-        json searchResult = searchStopsProvider(queryStr, cityStr, includeLocation);
-        bool hasError = searchResult.is_object() && searchResult.contains("error");
-        if (!hasError) {
-            ensureStopsInDatabase(searchResult, queryStr, db);
+            return respond(res, std::move(response));
         }
-        auto response = crow::response(searchResult.dump());
-        setSecurityHeaders(response);
-        return response;
 
+        searchStops(queryStr, cityStr, includeLocation, db, [&req, &res](CachedBodyPtr searchResult) {
+            if (!searchResult) return respond(res, overloadedResponse());
+            respond(res, cachedBodyResponse(req, *searchResult));
+        });
     });
 
     // --- Route: Nearby Stops ---
     CROW_ROUTE(app, "/api/stops/nearby")
     ([&db](const crow::request& req){
-        if (!isAuthenticated(req, db)) return unauthorizedResponse();
+        if (auto rejection = rejectRequest(req, db)) return std::move(*rejection);
 
         const char* latParam = req.url_params.get("lat");
         const char* longParam = req.url_params.get("long");
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "crow.h"
+#include "../app.h"
 #include "../db/database.h"
 
-void registerStopsRoutes(crow::SimpleApp& app, Database& db);
+void registerStopsRoutes(App& app, Database& db);
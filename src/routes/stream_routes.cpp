@@ -0,0 +1,36 @@
+#include "stream_routes.h"
+#include "../middleware/api_key_auth.h"
+#include "../services/stream_service.h"
+#include <cstdint>
+
+namespace {
+uint64_t clientIdOf(crow::websocket::connection& conn) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(conn.userdata()));
+}
+}
+
+void registerStreamRoutes(App& app, Database& db) {
+    // --- Route: Live Departure Stream (WebSocket) ---
+    // The API key and its rate limit are checked on the upgrade request. The trailing parameters
+    // absorb the extra arguments newer Crow versions pass to onaccept/onclose.
+    CROW_WEBSOCKET_ROUTE(app, "/api/stream")
+        .max_payload(MAX_STREAM_MESSAGE_BYTES)
+        .onaccept([&db](const crow::request& req, auto&&...) {
+            return !rejectRequest(req, db);
+        })
+        .onopen([](crow::websocket::connection& conn) {
+            uint64_t clientId = openStreamClient([&conn](const std::string& message) { conn.send_text(message); });
+            if (clientId == 0) {
+                conn.close("Too many stream clients");
+                return;
+            }
+            conn.userdata(reinterpret_cast<void*>(static_cast<uintptr_t>(clientId)));
+        })
+        .onmessage([](crow::websocket::connection& conn, const std::string& data, bool isBinary) {
+            if (isBinary) return;
+            handleStreamMessage(clientIdOf(conn), data);
+        })
+        .onclose([](crow::websocket::connection& conn, const std::string&, auto&&...) {
+            closeStreamClient(clientIdOf(conn));
+        });
+}
@@ -0,0 +1,188 @@
+#include "spatial_index.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+static constexpr double EARTH_RADIUS_METERS = 6371008.8;
+static constexpr double GRID_CELL_DEGREES = 0.01;   // ~1.1 km north-south
+static constexpr double DEG_TO_RAD = M_PI / 180.0;
+// On the same sphere as the haversine distance, so the box always covers the radius
+static constexpr double METERS_PER_DEGREE_LAT = EARTH_RADIUS_METERS * DEG_TO_RAD;
+static constexpr double BOUNDING_BOX_MARGIN = 1.01;
+static constexpr int64_t CELL_INDEX_OFFSET = 1 << 20;
+
+// --- Grid Snapshot (immutable once published) ---
+struct SpatialSnapshot {
+    std::vector<uint64_t> cellKeys;     // Sorted, one per non-empty cell
+    std::vector<uint32_t> cellStart;    // cellKeys.size() + 1 offsets into the point arrays
+    std::vector<double> latRad;         // Point arrays, ordered by cell
+    std::vector<double> lonRad;
+    std::vector<double> cosLat;
+    std::vector<uint32_t> recordIndex;
+    std::vector<StopRecord> records;
+};
+
+using SpatialSnapshotPtr = std::shared_ptr<const SpatialSnapshot>;
+
+static std::mutex spatial_mutex;  // Serializes rebuilds; readers use the atomic snapshot
+static std::unordered_map<std::string, StopRecord> spatial_records;
+static SpatialSnapshotPtr spatial_snapshot;  // Accessed via std::atomic_load/store
+static std::atomic<bool> spatial_ready{false};
+
+static int64_t cellIndex(double degrees) {
+    return static_cast<int64_t>(std::floor(degrees / GRID_CELL_DEGREES));
+}
+
+static uint64_t cellKey(int64_t latIdx, int64_t lonIdx) {
+    return (static_cast<uint64_t>(latIdx + CELL_INDEX_OFFSET) << 32) |
+           static_cast<uint64_t>(static_cast<uint32_t>(lonIdx + CELL_INDEX_OFFSET));
+}
+
+double haversineMeters(double lat1, double lon1, double lat2, double lon2) {
+    double dLat = (lat2 - lat1) * DEG_TO_RAD;
+    double dLon = (lon2 - lon1) * DEG_TO_RAD;
+    double sinLat = std::sin(dLat * 0.5);
+    double sinLon = std::sin(dLon * 0.5);
+    double a = sinLat * sinLat + std::cos(lat1 * DEG_TO_RAD) * std::cos(lat2 * DEG_TO_RAD) * sinLon * sinLon;
+    return 2.0 * EARTH_RADIUS_METERS * std::asin(std::sqrt(std::min(1.0, a)));
+}
+
+// --- Helper: Rebuild (spatial_mutex held) ---
+static void publishSnapshot() {
+    auto snapshot = std::make_shared<SpatialSnapshot>();
+    snapshot->records.reserve(spatial_records.size());
+
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    order.reserve(spatial_records.size());
+    for (const auto& [id, record] : spatial_records) {
+        uint32_t index = static_cast<uint32_t>(snapshot->records.size());
+        snapshot->records.push_back(record);
+        order.emplace_back(cellKey(cellIndex(record.latitude), cellIndex(record.longitude)), index);
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t count = order.size();
+    snapshot->latRad.reserve(count);
+    snapshot->lonRad.reserve(count);
+    snapshot->cosLat.reserve(count);
+    snapshot->recordIndex.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto& [key, index] = order[i];
+        if (snapshot->cellKeys.empty() || snapshot->cellKeys.back() != key) {
+            snapshot->cellKeys.push_back(key);
+            snapshot->cellStart.push_back(static_cast<uint32_t>(i));
+        }
+        const StopRecord& record = snapshot->records[index];
+        double lat = record.latitude * DEG_TO_RAD;
+        snapshot->latRad.push_back(lat);
+        snapshot->lonRad.push_back(record.longitude * DEG_TO_RAD);
+        snapshot->cosLat.push_back(std::cos(lat));
+        snapshot->recordIndex.push_back(index);
+    }
+    snapshot->cellStart.push_back(static_cast<uint32_t>(count));
+
+    std::atomic_store(&spatial_snapshot, SpatialSnapshotPtr(std::move(snapshot)));
+}
+
+void replaceStopLocations(const std::vector<StopRecord>& records) {
+    std::lock_guard<std::mutex> lock(spatial_mutex);
+    spatial_records.clear();
+    for (const auto& record : records) spatial_records[record.stop_id] = record;
+    publishSnapshot();
+    spatial_ready.store(true);
+}
+
+void indexStopLocations(const std::vector<StopRecord>& records) {
+    if (records.empty() || !spatial_ready.load()) return;
+    std::lock_guard<std::mutex> lock(spatial_mutex);
+    for (const auto& record : records) spatial_records[record.stop_id] = record;
+    publishSnapshot();
+}
+
+size_t getSpatialIndexSize() {
+    auto snapshot = std::atomic_load(&spatial_snapshot);
+    return snapshot ? snapshot->records.size() : 0;
+}
+
+// --- Query ---
+
+struct NearbyCandidate {
+    double distance;
+    uint32_t point;
+};
+
+std::optional<json> findNearbyStops(double latitude, double longitude, int maxDistanceMeters, int limit) {
+    if (!spatial_ready.load()) return std::nullopt;
+    auto snapshot = std::atomic_load(&spatial_snapshot);
+    if (!snapshot) return std::nullopt;
+    const SpatialSnapshot& grid = *snapshot;
+
+    const double radius = static_cast<double>(maxDistanceMeters);
+    const double queryLat = latitude * DEG_TO_RAD;
+    const double queryLon = longitude * DEG_TO_RAD;
+    const double queryCos = std::cos(queryLat);
+
+    std::vector<NearbyCandidate> candidates;
+    auto consider = [&](uint32_t point) {
+        double sinLat = std::sin((grid.latRad[point] - queryLat) * 0.5);
+        double sinLon = std::sin((grid.lonRad[point] - queryLon) * 0.5);
+        double a = sinLat * sinLat + queryCos * grid.cosLat[point] * sinLon * sinLon;
+        double distance = 2.0 * EARTH_RADIUS_METERS * std::asin(std::sqrt(std::min(1.0, a)));
+        if (distance <= radius) candidates.push_back({distance, point});
+    };
+
+    // Bounding box in degrees with a small margin; longitude span widens with
+    // latitude, taken at the box edge nearest the pole
+    double latSpan = radius * BOUNDING_BOX_MARGIN / METERS_PER_DEGREE_LAT;
+    double minLat = latitude - latSpan, maxLat = latitude + latSpan;
+    double edgeCos = std::cos(std::min(90.0, std::max(std::abs(minLat), std::abs(maxLat))) * DEG_TO_RAD);
+    double lonSpan = latSpan / std::max(0.01, edgeCos);
+    double minLon = longitude - lonSpan, maxLon = longitude + lonSpan;
+
+    int64_t latLo = cellIndex(std::max(-90.0, minLat)), latHi = cellIndex(std::min(90.0, maxLat));
+    int64_t lonLo = cellIndex(minLon), lonHi = cellIndex(maxLon);
+    int64_t cellCount = (latHi - latLo + 1) * (lonHi - lonLo + 1);
+
+    bool crossesAntimeridian = minLon < -180.0 || maxLon > 180.0;
+    if (crossesAntimeridian || cellCount > static_cast<int64_t>(grid.cellKeys.size())) {
+        // Large radius relative to the data: a flat scan touches less memory than the cell walk
+        for (uint32_t point = 0; point < grid.latRad.size(); ++point) consider(point);
+    } else {
+        for (int64_t row = latLo; row <= latHi; ++row) {
+            uint64_t first = cellKey(row, lonLo);
+            uint64_t last = cellKey(row, lonHi);
+            auto it = std::lower_bound(grid.cellKeys.begin(), grid.cellKeys.end(), first);
+            for (; it != grid.cellKeys.end() && *it <= last; ++it) {
+                size_t cell = static_cast<size_t>(it - grid.cellKeys.begin());
+                for (uint32_t point = grid.cellStart[cell]; point < grid.cellStart[cell + 1]; ++point) consider(point);
+            }
+        }
+    }
+
+    auto byDistance = [&](const NearbyCandidate& a, const NearbyCandidate& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        return grid.records[grid.recordIndex[a.point]].stop_id < grid.records[grid.recordIndex[b.point]].stop_id;
+    };
+    size_t keep = std::min(candidates.size(), static_cast<size_t>(std::max(0, limit)));
+    std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), byDistance);
+
+    json nearbyStops = json::array();
+    for (size_t i = 0; i < keep; ++i) {
+        const StopRecord& record = grid.records[grid.recordIndex[candidates[i].point]];
+        json stop{
+            {"stop_id", record.stop_id},
+            {"stop_name", record.stop_name},
+            {"latitude", record.latitude},
+            {"longitude", record.longitude},
+            {"distance_meters", candidates[i].distance}
+        };
+        if (record.local_id) stop["local_id"] = *record.local_id;
+        if (record.city) stop["city"] = *record.city;  // Like the PostGIS query: any non-NULL city
+        nearbyStops.push_back(stop);
+    }
+    return nearbyStops;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../config/config.h"
+#include "../models/stop.h"
+#include <optional>
+#include <vector>
+
+// --- In-memory Spatial Index for Nearby Stops ---
+// Stops are bucketed into a fixed lat/lon grid stored as flat, cell-sorted
+// arrays. Queries scan only the cells overlapping the search radius and rank
+// candidates with a haversine kernel. The grid is rebuilt copy-on-write, so
+// readers never block writers.
+
+// Replaces the whole index (initial load); marks it ready
+void replaceStopLocations(const std::vector<StopRecord>& records);
+// Adds or updates stops; ignored until the index is ready
+void indexStopLocations(const std::vector<StopRecord>& records);
+
+// Same result shape and ordering as the PostGIS nearby query; nullopt when not ready
+std::optional<json> findNearbyStops(double latitude, double longitude, int maxDistanceMeters, int limit);
+size_t getSpatialIndexSize();
+
+double haversineMeters(double lat1, double lon1, double lat2, double lon2);
@@ -0,0 +1,376 @@
+#include "stop_index.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+// --- Index State (guarded by index_mutex) ---
+
+struct IndexedStop {
+    StopRecord record;
+    std::string normName;         // Full name, e.g. "karlsruhe marktplatz"
+    std::string normShortName;    // Name without the "City, " prefix
+    std::vector<std::string> tokens;
+    std::vector<uint32_t> trigrams;
+};
+
+static std::shared_mutex index_mutex;
+static std::vector<IndexedStop> indexed_stops;
+static std::unordered_map<std::string, uint32_t> stop_slots;              // stop_id -> slot
+static std::map<std::string, std::vector<uint32_t>> token_postings;       // ordered for prefix scans
+static std::unordered_map<uint32_t, std::vector<uint32_t>> trigram_postings;
+static std::unordered_set<std::string> known_queries;                     // normalized queries answered upstream
+
+static std::atomic<uint64_t> local_answers{0};
+static std::atomic<uint64_t> fuzzy_answers{0};
+static std::atomic<uint64_t> declined_answers{0};
+
+// --- Helper: Normalization ---
+
+std::string normalizeSearchText(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() + 4);
+    bool pendingSpace = false;
+
+    auto emit = [&](const char* piece) {
+        if (pendingSpace && !out.empty()) out += ' ';
+        pendingSpace = false;
+        out += piece;
+    };
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x80) {
+            if (std::isalnum(c)) {
+                char lower[2] = {static_cast<char>(std::tolower(c)), '\0'};
+                emit(lower);
+            } else {
+                pendingSpace = true;
+            }
+            continue;
+        }
+
+        // Two-byte UTF-8 sequences for German umlauts and sharp s (U+00C4..U+00FC, U+00DF)
+        if (c == 0xC3 && i + 1 < text.size()) {
+            unsigned char next = static_cast<unsigned char>(text[i + 1]);
+            const char* folded = nullptr;
+            switch (next) {
+                case 0xA4: case 0x84: folded = "ae"; break;
+                case 0xB6: case 0x96: folded = "oe"; break;
+                case 0xBC: case 0x9C: folded = "ue"; break;
+                case 0x9F: folded = "ss"; break;
+                default: break;
+            }
+            if (folded) {
+                emit(folded);
+                ++i;
+                continue;
+            }
+        }
+
+        // Any other non-ASCII byte is kept verbatim as part of the word
+        char raw[2] = {static_cast<char>(c), '\0'};
+        emit(raw);
+    }
+    return out;
+}
+
+static std::vector<std::string> splitTokens(const std::string& normalized) {
+    std::vector<std::string> tokens;
+    size_t start = 0;
+    while (start < normalized.size()) {
+        size_t end = normalized.find(' ', start);
+        if (end == std::string::npos) end = normalized.size();
+        if (end > start) tokens.push_back(normalized.substr(start, end - start));
+        start = end + 1;
+    }
+    return tokens;
+}
+
+// --- Helper: Trigrams (pg_trgm style padding: two spaces before, one after each word) ---
+
+static uint32_t packTrigram(unsigned char a, unsigned char b, unsigned char c) {
+    return (static_cast<uint32_t>(a) << 16) | (static_cast<uint32_t>(b) << 8) | c;
+}
+
+static std::vector<uint32_t> trigramsOf(const std::vector<std::string>& tokens) {
+    std::vector<uint32_t> grams;
+    for (const auto& token : tokens) {
+        std::string padded = "  " + token + " ";
+        for (size_t i = 0; i + 2 < padded.size(); ++i) {
+            grams.push_back(packTrigram(padded[i], padded[i + 1], padded[i + 2]));
+        }
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+// --- Helper: Postings Maintenance (index_mutex held exclusively) ---
+
+static void removePosting(std::vector<uint32_t>& postings, uint32_t slot) {
+    postings.erase(std::remove(postings.begin(), postings.end(), slot), postings.end());
+}
+
+static void unlinkStop(uint32_t slot) {
+    const IndexedStop& stop = indexed_stops[slot];
+    for (const auto& token : stop.tokens) {
+        auto it = token_postings.find(token);
+        if (it == token_postings.end()) continue;
+        removePosting(it->second, slot);
+        if (it->second.empty()) token_postings.erase(it);
+    }
+    for (uint32_t gram : stop.trigrams) {
+        auto it = trigram_postings.find(gram);
+        if (it == trigram_postings.end()) continue;
+        removePosting(it->second, slot);
+        if (it->second.empty()) trigram_postings.erase(it);
+    }
+}
+
+static void linkStop(uint32_t slot) {
+    const IndexedStop& stop = indexed_stops[slot];
+    for (const auto& token : stop.tokens) token_postings[token].push_back(slot);
+    for (uint32_t gram : stop.trigrams) trigram_postings[gram].push_back(slot);
+}
+
+static void upsertStop(const StopRecord& record) {
+    std::string normName = normalizeSearchText(record.stop_name);
+    if (normName.empty()) return;
+
+    auto existing = stop_slots.find(record.stop_id);
+    if (existing != stop_slots.end()) {
+        IndexedStop& stop = indexed_stops[existing->second];
+        if (stop.normName == normName) {
+            stop.record = record;
+            return;
+        }
+        unlinkStop(existing->second);
+    }
+
+    IndexedStop stop;
+    stop.record = record;
+    stop.normName = normName;
+    size_t comma = record.stop_name.find(',');
+    stop.normShortName = comma == std::string::npos ? normName
+                                                    : normalizeSearchText(record.stop_name.substr(comma + 1));
+    stop.tokens = splitTokens(normName);
+    std::sort(stop.tokens.begin(), stop.tokens.end());
+    stop.tokens.erase(std::unique(stop.tokens.begin(), stop.tokens.end()), stop.tokens.end());
+    stop.trigrams = trigramsOf(stop.tokens);
+
+    uint32_t slot;
+    if (existing != stop_slots.end()) {
+        slot = existing->second;
+        indexed_stops[slot] = std::move(stop);
+    } else {
+        slot = static_cast<uint32_t>(indexed_stops.size());
+        indexed_stops.push_back(std::move(stop));
+        stop_slots.emplace(record.stop_id, slot);
+    }
+    linkStop(slot);
+}
+
+// --- Index Maintenance ---
+
+void indexStops(const std::vector<StopRecord>& records) {
+    if (records.empty()) return;
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    for (const auto& record : records) upsertStop(record);
+}
+
+void rememberSearchQuery(const std::string& normalizedQuery) {
+    if (normalizedQuery.empty()) return;
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    if (known_queries.size() < MAX_KNOWN_SEARCH_QUERIES) known_queries.insert(normalizedQuery);
+}
+
+// --- Helper: Response Shaping (mirrors the upstream rapidJSON stop finder) ---
+
+static json motArrayToJson(const std::optional<std::string>& motArray) {
+    json classes = json::array();
+    if (!motArray) return classes;
+    int value = 0;
+    bool inNumber = false;
+    for (char c : *motArray) {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+            inNumber = true;
+        } else if (inNumber) {
+            classes.push_back(value);
+            value = 0;
+            inNumber = false;
+        }
+    }
+    if (inNumber) classes.push_back(value);
+    return classes;
+}
+
+static json locationJson(const IndexedStop& stop, int score, bool isBest) {
+    const StopRecord& record = stop.record;
+    json location{
+        {"id", record.stop_id},
+        {"name", record.stop_name},
+        {"type", "stop"},
+        {"coord", {record.latitude, record.longitude}},
+        {"matchQuality", score},
+        {"isBest", isBest},
+        {"productClasses", motArrayToJson(record.mot_array)}
+    };
+    if (record.city && !record.city->empty()) location["parent"] = {{"name", *record.city}, {"type", "locality"}};
+    if (record.local_id) location["properties"] = {{"stopId", *record.local_id}};
+    return location;
+}
+
+// --- Local Search ---
+
+struct ScoredStop {
+    uint32_t slot;
+    int score;
+};
+
+static json buildLocations(std::vector<ScoredStop>& scored) {
+    std::sort(scored.begin(), scored.end(), [](const ScoredStop& a, const ScoredStop& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return indexed_stops[a.slot].normName < indexed_stops[b.slot].normName;
+    });
+    if (scored.size() > SEARCH_LOCAL_MAX_RESULTS) scored.resize(SEARCH_LOCAL_MAX_RESULTS);
+
+    json locations = json::array();
+    for (size_t i = 0; i < scored.size(); ++i) {
+        locations.push_back(locationJson(indexed_stops[scored[i].slot], scored[i].score, i == 0));
+    }
+    return json{{"locations", locations}};
+}
+
+// Jaccard similarity of the two tokens' trigram sets
+static double tokenSimilarity(const std::string& a, const std::string& b) {
+    std::vector<uint32_t> gramsA = trigramsOf({a});
+    std::vector<uint32_t> gramsB = trigramsOf({b});
+    std::vector<uint32_t> common;
+    std::set_intersection(gramsA.begin(), gramsA.end(), gramsB.begin(), gramsB.end(), std::back_inserter(common));
+    size_t unionSize = gramsA.size() + gramsB.size() - common.size();
+    return unionSize == 0 ? 0.0 : static_cast<double>(common.size()) / static_cast<double>(unionSize);
+}
+
+static bool everyTokenMatches(const std::vector<std::string>& queryTokens, const IndexedStop& stop) {
+    return std::all_of(queryTokens.begin(), queryTokens.end(), [&stop](const std::string& token) {
+        return std::any_of(stop.tokens.begin(), stop.tokens.end(), [&token](const std::string& stopToken) {
+            return tokenSimilarity(token, stopToken) >= SEARCH_FUZZY_MIN_TOKEN_SIMILARITY;
+        });
+    });
+}
+
+std::optional<json> searchStopsLocally(const std::string& normalizedQuery, bool* fuzzy) {
+    std::vector<std::string> queryTokens = splitTokens(normalizedQuery);
+    if (queryTokens.empty()) return std::nullopt;
+    std::sort(queryTokens.begin(), queryTokens.end());
+    queryTokens.erase(std::unique(queryTokens.begin(), queryTokens.end()), queryTokens.end());
+
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    if (indexed_stops.empty()) {
+        declined_answers.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    // Prefix pass: every query token must prefix some token of the stop name
+    std::unordered_map<uint32_t, int> matches;
+    for (size_t t = 0; t < queryTokens.size(); ++t) {
+        const std::string& token = queryTokens[t];
+        std::unordered_map<uint32_t, int> tokenScores;
+        for (auto it = token_postings.lower_bound(token);
+             it != token_postings.end() && it->first.compare(0, token.size(), token) == 0; ++it) {
+            int points = it->first.size() == token.size() ? 2 : 1;
+            for (uint32_t slot : it->second) {
+                int& best = tokenScores[slot];
+                best = std::max(best, points);
+            }
+        }
+
+        if (t == 0) {
+            matches = std::move(tokenScores);
+        } else {
+            for (auto it = matches.begin(); it != matches.end(); ) {
+                auto found = tokenScores.find(it->first);
+                if (found == tokenScores.end()) {
+                    it = matches.erase(it);
+                } else {
+                    it->second += found->second;
+                    ++it;
+                }
+            }
+        }
+        if (matches.empty()) break;
+    }
+
+    if (!matches.empty()) {
+        std::vector<ScoredStop> scored;
+        scored.reserve(matches.size());
+        bool exact = false;
+        for (const auto& [slot, points] : matches) {
+            const IndexedStop& stop = indexed_stops[slot];
+            int score = points;
+            if (stop.normName == normalizedQuery || stop.normShortName == normalizedQuery) {
+                score += 10;
+                // A bare stop name ("marktplatz") may exist in cities the index has not seen
+                exact = exact || stop.normName == normalizedQuery;
+            } else if (stop.normName.compare(0, normalizedQuery.size(), normalizedQuery) == 0 ||
+                       stop.normShortName.compare(0, normalizedQuery.size(), normalizedQuery) == 0) {
+                score += 1;
+            }
+            scored.push_back({slot, score});
+        }
+
+        // Confident when the stop is named exactly, or upstream has answered this query before
+        if (exact || known_queries.count(normalizedQuery) > 0) {
+            local_answers.fetch_add(1, std::memory_order_relaxed);
+            return buildLocations(scored);
+        }
+        declined_answers.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    // Fuzzy pass: share of query trigrams found in the stop name (handles typos).
+    // Containment alone rewards a stop name plus an extra word ("durlach bahnhof
+    // ost"), so every query token must also closely match a token of the stop.
+    std::vector<uint32_t> queryGrams = trigramsOf(queryTokens);
+    std::unordered_map<uint32_t, int> shared;
+    for (uint32_t gram : queryGrams) {
+        auto it = trigram_postings.find(gram);
+        if (it == trigram_postings.end()) continue;
+        for (uint32_t slot : it->second) ++shared[slot];
+    }
+
+    std::vector<ScoredStop> scored;
+    for (const auto& [slot, count] : shared) {
+        double containment = static_cast<double>(count) / static_cast<double>(queryGrams.size());
+        if (containment >= SEARCH_FUZZY_MIN_CONTAINMENT && everyTokenMatches(queryTokens, indexed_stops[slot])) {
+            scored.push_back({slot, static_cast<int>(containment * 100.0)});
+        }
+    }
+    if (scored.empty()) {
+        declined_answers.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    if (fuzzy) *fuzzy = true;
+    fuzzy_answers.fetch_add(1, std::memory_order_relaxed);
+    local_answers.fetch_add(1, std::memory_order_relaxed);
+    return buildLocations(scored);
+}
+
+StopIndexStats getStopIndexStats() {
+    StopIndexStats stats;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex);
+        stats.stops = indexed_stops.size();
+        stats.knownQueries = known_queries.size();
+    }
+    stats.localAnswers = local_answers.load(std::memory_order_relaxed);
+    stats.fuzzyAnswers = fuzzy_answers.load(std::memory_order_relaxed);
+    stats.declined = declined_answers.load(std::memory_order_relaxed);
+    return stats;
+}
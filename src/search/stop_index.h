@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../config/config.h"
+#include "../models/stop.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+// --- Local Stop Search Index ---
+// In-process index over the stops table: token prefix matching plus trigram
+// containment for typos. Only confident answers are returned; everything
+// else falls through to the upstream stop finder.
+
+struct StopIndexStats {
+    size_t stops = 0;
+    size_t knownQueries = 0;
+    uint64_t localAnswers = 0;
+    uint64_t fuzzyAnswers = 0;
+    uint64_t declined = 0;
+};
+
+// Lowercases, folds ä/ö/ü/ß (either case) to ae/oe/ue/ss and collapses punctuation to single spaces
+std::string normalizeSearchText(const std::string& text);
+
+void indexStops(const std::vector<StopRecord>& records);
+void rememberSearchQuery(const std::string& normalizedQuery);
+
+// Returns an upstream-shaped {"locations":[...]} body, or nullopt when the index is not confident.
+// fuzzy is set when the answer came from typo matching rather than an exact or known query.
+std::optional<json> searchStopsLocally(const std::string& normalizedQuery, bool* fuzzy = nullptr);
+StopIndexStats getStopIndexStats();
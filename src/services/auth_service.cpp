@@ -1,33 +1,134 @@
 #include "auth_service.h"
+#include "../cache/sharded_cache.h"
+#include "../metrics/metrics.h"
+#include "../metrics/tracing.h"
 #include <openssl/evp.h>
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
-#include <map>
+#include <thread>
+#include <unordered_set>
 #include <chrono>
 #include <iostream>
+#include <poll.h>
 
-// Persistent auth DB connection and throttle state (protected by auth_db_mutex)
-static std::mutex auth_db_mutex;
-static PGconn* auth_db_conn = nullptr;
-static std::map<std::string, std::chrono::steady_clock::time_point> last_used_updates;
-static constexpr int LAST_USED_UPDATE_INTERVAL_SECONDS = 300; // 5 minutes
+// --- Key Lookup Cache ---
+// Positive and negative lookups are cached by key hash in separate caches so
+// that unknown keys expire quickly. Revocations arrive via LISTEN/NOTIFY on
+// api_keys_changed; without the trigger the positive TTL bounds staleness.
+
+struct KeyLookup {
+    std::string keyId;
+    long long expiresAtEpoch = 0;                // 0 = no expiry
+    mutable std::atomic<long long> lastMarked{0}; // steady-clock seconds of last last_used_at enqueue
+};
+
+using KeyLookupPtr = std::shared_ptr<const KeyLookup>;
+using KeyCache = ShardedCache<KeyLookupPtr>;
+using NegativeKeyCache = ShardedCache<bool>;
+
+static KeyCache& keyCache() {
+    static KeyCache cache(MAX_AUTH_CACHE_ENTRIES,
+                          std::chrono::seconds(getEnvLong("AUTH_CACHE_TTL_SECONDS", AUTH_CACHE_TTL_SECONDS, 0, 3600)));
+    return cache;
+}
+
+static NegativeKeyCache& negativeKeyCache() {
+    static NegativeKeyCache cache(MAX_AUTH_CACHE_ENTRIES,
+                                  std::chrono::seconds(getEnvLong("AUTH_NEGATIVE_CACHE_TTL_SECONDS",
+                                                                  AUTH_NEGATIVE_CACHE_TTL_SECONDS, 0, 3600)));
+    return cache;
+}
+
+// Bumped on every invalidation; a lookup that raced with one is not cached
+static std::atomic<uint64_t> key_cache_generation{0};
+
+static void invalidateKey(const std::string& keyHash) {
+    key_cache_generation.fetch_add(1);
+    if (keyHash.empty()) {
+        keyCache().clear();
+        negativeKeyCache().clear();
+    } else {
+        keyCache().erase(keyHash);
+        negativeKeyCache().erase(keyHash);
+    }
+}
+
+// --- last_used_at Write-back (flushed by the maintenance thread) ---
+static std::mutex last_used_mutex;
+static std::unordered_set<std::string> last_used_pending;
+
+static long long steadySeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void markKeyUsed(const KeyLookup& lookup) {
+    long long now = steadySeconds();
+    long long last = lookup.lastMarked.load(std::memory_order_relaxed);
+    if (last != 0 && now - last < LAST_USED_FLUSH_SECONDS) return;
+    if (!lookup.lastMarked.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+
+    std::lock_guard<std::mutex> lock(last_used_mutex);
+    last_used_pending.insert(lookup.keyId);
+}
+
+static void flushLastUsed(const Database& db) {
+    std::unordered_set<std::string> ids;
+    {
+        std::lock_guard<std::mutex> lock(last_used_mutex);
+        ids.swap(last_used_pending);
+    }
+    if (ids.empty()) return;
+
+    // Integer array literal; ids come from the SERIAL primary key
+    std::string idArray = "{";
+    for (const auto& id : ids) {
+        if (id.empty() || !std::all_of(id.begin(), id.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+            continue;
+        }
+        if (idArray.size() > 1) idArray += ',';
+        idArray += id;
+    }
+    idArray += '}';
+    if (idArray.size() == 2) return;
+
+    PooledConnection pooled = db.acquire();
+    if (!pooled) {
+        std::cerr << "Database connection unavailable; last_used_at update deferred" << std::endl;
+        std::lock_guard<std::mutex> lock(last_used_mutex);
+        last_used_pending.insert(ids.begin(), ids.end());
+        return;
+    }
+
+    const char* updateSql = "UPDATE api_keys SET last_used_at = NOW() WHERE id = ANY($1::int[])";
+    const char* updateValues[1] = { idArray.c_str() };
+    static const MetricHistogram updateLatency = dbQueryHistogram("api_key_last_used");
+    auto queryStart = std::chrono::steady_clock::now();
+    PGresult* res = PQexecParams(pooled.get(), updateSql, 1, nullptr, updateValues, nullptr, nullptr, 0);
+    updateLatency.observe(std::chrono::steady_clock::now() - queryStart);
+    if (!res || PQresultStatus(res) != PGRES_COMMAND_OK) {
+        std::cerr << "Failed to update last_used_at: " << PQerrorMessage(pooled.get()) << std::endl;
+    }
+    if (res) PQclear(res);
+}
 
 std::string sha256Hex(const std::string& input) {
+    static constexpr char digits[] = "0123456789abcdef";
     unsigned char hash[EVP_MAX_MD_SIZE];
     unsigned int hashLen = 0;
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx) return "";
-    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1
-           && EVP_DigestUpdate(ctx, input.c_str(), input.size()) == 1
-           && EVP_DigestFinal_ex(ctx, hash, &hashLen) == 1;
-    EVP_MD_CTX_free(ctx);
-    if (!ok || hashLen == 0) return "";
-    std::ostringstream ss;
+    if (EVP_Digest(input.data(), input.size(), hash, &hashLen, EVP_sha256(), nullptr) != 1 || hashLen == 0) {
+        return "";
+    }
+    std::string hex(hashLen * 2, '0');
     for (unsigned int i = 0; i < hashLen; i++) {
-        ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(hash[i]);
+        hex[i * 2] = digits[hash[i] >> 4];
+        hex[i * 2 + 1] = digits[hash[i] & 0x0f];
     }
-    return ss.str();
+    return hex;
 }
 
 // Constant-time string comparison to prevent timing attacks
@@ -40,86 +141,280 @@ bool constantTimeEquals(const std::string& a, const std::string& b) {
     return result == 0;
 }
 
-static PGconn* getAuthDbConnection(const Database& db) {
-    // Must be called with auth_db_mutex held
-    if (auth_db_conn && PQstatus(auth_db_conn) == CONNECTION_OK) {
-        return auth_db_conn;
+// --- Helper: Database Lookup (nullopt = database unavailable, nullptr = unknown key) ---
+static std::optional<KeyLookupPtr> lookupKeyInDatabase(const std::string& keyHash, const Database& db) {
+    TraceSpanTimer span("db_query");
+    PooledConnection pooled = db.acquire();
+    if (!pooled) return std::nullopt;
+    PGconn* conn = pooled.get();
+
+    const char* querySql =
+        "SELECT id, COALESCE(EXTRACT(EPOCH FROM expires_at)::bigint, 0) FROM api_keys "
+        "WHERE key_hash = $1 AND revoked = FALSE "
+        "AND (expires_at IS NULL OR expires_at > NOW())";
+    const char* queryValues[1] = { keyHash.c_str() };
+
+    static const MetricHistogram lookupLatency = dbQueryHistogram("api_key_lookup");
+    auto queryStart = std::chrono::steady_clock::now();
+    PGresult* res = PQexecParams(conn, querySql, 1, nullptr, queryValues, nullptr, nullptr, 0);
+    lookupLatency.observe(std::chrono::steady_clock::now() - queryStart);
+    if (!res) {
+        std::cerr << "Auth query returned null result" << std::endl;
+        return std::nullopt;
     }
-    // Clean up stale connection
-    if (auth_db_conn) {
-        PQfinish(auth_db_conn);
-        auth_db_conn = nullptr;
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        std::cerr << "Auth query failed: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        return std::nullopt;
     }
-    if (!db.hasConfig()) return nullptr;
-    auth_db_conn = db.connect();
-    if (!auth_db_conn) return nullptr;
-    if (PQstatus(auth_db_conn) != CONNECTION_OK) {
-        std::cerr << "Auth DB connection failed: " << PQerrorMessage(auth_db_conn) << std::endl;
-        PQfinish(auth_db_conn);
-        auth_db_conn = nullptr;
-        return nullptr;
+    if (PQntuples(res) == 0) {
+        PQclear(res);
+        return KeyLookupPtr();
+    }
+
+    auto lookup = std::make_shared<KeyLookup>();
+    lookup->keyId = PQgetvalue(res, 0, 0);
+    try {
+        lookup->expiresAtEpoch = std::stoll(PQgetvalue(res, 0, 1));
+    } catch (...) {
+        lookup->expiresAtEpoch = 0;
+    }
+    PQclear(res);
+    return KeyLookupPtr(std::move(lookup));
+}
+
+// --- Key Preload ---
+// Fills the positive cache with the most recently used active keys, so their
+// first requests after startup skip the database. Runs on the maintenance
+// thread right after a LISTEN (re)connect has invalidated the cache, so no
+// revocation can fall between the load and the listener.
+static std::mutex key_preload_mutex;
+static std::condition_variable key_preload_cv;
+static bool key_preload_done = false;
+static std::optional<size_t> key_preload_count;  // nullopt = last preload failed
+
+static void preloadKeys(const Database& db) {
+    uint64_t generation = key_cache_generation.load();
+    std::optional<size_t> loaded;
+
+    if (PooledConnection pooled = db.acquire()) {
+        const char* querySql =
+            "SELECT key_hash, id, COALESCE(EXTRACT(EPOCH FROM expires_at)::bigint, 0) FROM api_keys "
+            "WHERE revoked = FALSE AND (expires_at IS NULL OR expires_at > NOW()) "
+            "ORDER BY last_used_at DESC NULLS LAST LIMIT $1";
+        std::string limit = std::to_string(MAX_AUTH_CACHE_ENTRIES);
+        const char* queryValues[1] = { limit.c_str() };
+
+        static const MetricHistogram preloadLatency = dbQueryHistogram("api_key_preload");
+        auto queryStart = std::chrono::steady_clock::now();
+        PGresult* res = PQexecParams(pooled.get(), querySql, 1, nullptr, queryValues, nullptr, nullptr, 0);
+        preloadLatency.observe(std::chrono::steady_clock::now() - queryStart);
+        if (res && PQresultStatus(res) == PGRES_TUPLES_OK && key_cache_generation.load() == generation) {
+            int rows = PQntuples(res);
+            for (int i = 0; i < rows; ++i) {
+                auto lookup = std::make_shared<KeyLookup>();
+                lookup->keyId = PQgetvalue(res, i, 1);
+                try {
+                    lookup->expiresAtEpoch = std::stoll(PQgetvalue(res, i, 2));
+                } catch (...) {
+                    lookup->expiresAtEpoch = 0;
+                }
+                keyCache().put(PQgetvalue(res, i, 0), KeyLookupPtr(std::move(lookup)));
+            }
+            loaded = static_cast<size_t>(rows);
+            std::cout << "API keys preloaded: " << rows << std::endl;
+        } else if (!res || PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::cerr << "API key preload failed: " << PQerrorMessage(pooled.get()) << std::endl;
+        }
+        if (res) PQclear(res);
+    } else {
+        std::cerr << "Database connection unavailable; API keys not preloaded" << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(key_preload_mutex);
+        key_preload_done = true;
+        key_preload_count = loaded;
     }
-    return auth_db_conn;
+    key_preload_cv.notify_all();
+}
+
+std::optional<size_t> waitForApiKeyPreload(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(key_preload_mutex);
+    if (!key_preload_cv.wait_until(lock, deadline, [] { return key_preload_done; })) return std::nullopt;
+    return key_preload_count;
+}
+
+// --- Validation Latency (by answer source) ---
+enum class AuthSource { Cache, NegativeCache, Database, Unavailable };
+
+static void recordValidation(AuthSource source, std::chrono::steady_clock::time_point start) {
+    static const MetricHistogram histograms[] = {
+        authValidationHistogram("cache"),
+        authValidationHistogram("negative_cache"),
+        authValidationHistogram("database"),
+        authValidationHistogram("unavailable")
+    };
+    histograms[static_cast<int>(source)].observe(std::chrono::steady_clock::now() - start);
 }
 
 bool validateKeyViaDatabase(const std::string& providedKey, const Database& db) {
     if (!db.hasConfig()) return false;
+    auto start = std::chrono::steady_clock::now();
 
     std::string keyHash = sha256Hex(providedKey);
     if (keyHash.empty()) return false;
 
-    std::lock_guard<std::mutex> lock(auth_db_mutex);
+    long long nowEpoch = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
 
-    // Purge stale entries from the throttle map to prevent unbounded growth
-    auto now = std::chrono::steady_clock::now();
-    for (auto it = last_used_updates.begin(); it != last_used_updates.end(); ) {
-        if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second).count() >= LAST_USED_UPDATE_INTERVAL_SECONDS) {
-            it = last_used_updates.erase(it);
-        } else {
-            ++it;
+    if (auto entry = keyCache().get(keyHash)) {
+        const KeyLookup& lookup = *entry->value;
+        if (lookup.expiresAtEpoch == 0 || lookup.expiresAtEpoch > nowEpoch) {
+            markKeyUsed(lookup);
+            recordValidation(AuthSource::Cache, start);
+            return true;
         }
+        keyCache().erase(keyHash);
+    }
+    if (negativeKeyCache().get(keyHash)) {
+        recordValidation(AuthSource::NegativeCache, start);
+        return false;
     }
 
-    PGconn* conn = getAuthDbConnection(db);
-    if (!conn) return false;
+    uint64_t generation = key_cache_generation.load();
+    auto result = lookupKeyInDatabase(keyHash, db);
+    if (!result) {
+        recordValidation(AuthSource::Unavailable, start);
+        return false;  // Database errors are not cached
+    }
+    recordValidation(AuthSource::Database, start);
 
-    const char* querySql =
-        "SELECT id FROM api_keys "
-        "WHERE key_hash = $1 AND revoked = FALSE "
-        "AND (expires_at IS NULL OR expires_at > NOW())";
-    const char* queryValues[1] = { keyHash.c_str() };
+    bool cacheable = key_cache_generation.load() == generation;
+    if (!*result) {
+        if (cacheable) negativeKeyCache().put(keyHash, true);
+        return false;
+    }
+    if (cacheable) keyCache().put(keyHash, *result);
+    markKeyUsed(**result);
+    return true;
+}
 
-    PGresult* res = PQexecParams(conn, querySql, 1, nullptr, queryValues, nullptr, nullptr, 0);
-    if (!res) {
-        std::cerr << "Auth query returned null result" << std::endl;
+// --- Auth Maintenance Thread (LISTEN api_keys_changed + last_used_at flush) ---
+
+static std::mutex auth_maintenance_mutex;
+static std::condition_variable auth_maintenance_cv;
+static std::thread auth_maintenance_thread;
+static bool auth_maintenance_stop = false;
+
+static PGconn* openListenConnection(const Database& db) {
+    PGconn* conn = db.connect();
+    if (!conn || PQstatus(conn) != CONNECTION_OK) {
+        if (conn) {
+            std::cerr << "Auth listener connection failed: " << PQerrorMessage(conn) << std::endl;
+            PQfinish(conn);
+        }
+        return nullptr;
+    }
+    PGresult* res = PQexec(conn, "LISTEN api_keys_changed");
+    bool ok = res && PQresultStatus(res) == PGRES_COMMAND_OK;
+    if (res) PQclear(res);
+    if (!ok) {
+        std::cerr << "LISTEN api_keys_changed failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+        return nullptr;
+    }
+    return conn;
+}
+
+// Waits up to timeoutMs for notifications; returns false if the connection broke
+static bool drainNotifications(PGconn* conn, int timeoutMs) {
+    pollfd pfd{PQsocket(conn), POLLIN, 0};
+    if (pfd.fd < 0) return false;
+    if (poll(&pfd, 1, timeoutMs) < 0) return true;
+
+    if (PQconsumeInput(conn) != 1) {
+        std::cerr << "Auth listener lost connection: " << PQerrorMessage(conn) << std::endl;
         return false;
     }
-    bool valid = (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) > 0);
+    while (PGnotify* notify = PQnotifies(conn)) {
+        invalidateKey(notify->extra ? notify->extra : "");
+        PQfreemem(notify);
+    }
+    return true;
+}
 
-    if (valid) {
-        std::string keyId = PQgetvalue(res, 0, 0);
-        PQclear(res);
+static void runAuthMaintenance(const Database* db) {
+    using Clock = std::chrono::steady_clock;
+    PGconn* listenConn = nullptr;
+    auto nextListenAttempt = Clock::now();
+    auto nextFlush = Clock::now() + std::chrono::seconds(LAST_USED_FLUSH_SECONDS);
+    std::chrono::seconds listenBackoff(1);
+    bool preloaded = false;
 
-        // Throttle last_used_at updates: only once per LAST_USED_UPDATE_INTERVAL_SECONDS per key
-        auto now = std::chrono::steady_clock::now();
-        auto it = last_used_updates.find(keyId);
-        bool shouldUpdate = (it == last_used_updates.end()) ||
-            (std::chrono::duration_cast<std::chrono::seconds>(now - it->second).count() >= LAST_USED_UPDATE_INTERVAL_SECONDS);
-
-        if (shouldUpdate) {
-            const char* updateSql = "UPDATE api_keys SET last_used_at = NOW() WHERE id = $1";
-            const char* updateValues[1] = { keyId.c_str() };
-            PGresult* updateRes = PQexecParams(conn, updateSql, 1, nullptr, updateValues, nullptr, nullptr, 0);
-            if (!updateRes || PQresultStatus(updateRes) != PGRES_COMMAND_OK) {
-                std::cerr << "Failed to update last_used_at: " << PQerrorMessage(conn) << std::endl;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(auth_maintenance_mutex);
+            if (auth_maintenance_stop) break;
+        }
+
+        if (!listenConn && Clock::now() >= nextListenAttempt) {
+            listenConn = openListenConnection(*db);
+            if (listenConn) {
+                // Anything could have changed while we were not listening
+                invalidateKey("");
+                preloadKeys(*db);
+                preloaded = true;
+                listenBackoff = std::chrono::seconds(1);
             } else {
-                last_used_updates[keyId] = now;
+                // Without the listener the positive TTL bounds staleness, as for lookups
+                if (!preloaded) preloadKeys(*db);
+                preloaded = true;
+                nextListenAttempt = Clock::now() + listenBackoff;
+                listenBackoff = std::min(listenBackoff * 2, std::chrono::seconds(60));
             }
-            if (updateRes) PQclear(updateRes);
         }
-    } else {
-        PQclear(res);
+
+        if (listenConn) {
+            if (!drainNotifications(listenConn, 1000)) {
+                PQfinish(listenConn);
+                listenConn = nullptr;
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(auth_maintenance_mutex);
+            auth_maintenance_cv.wait_for(lock, std::chrono::seconds(1), [] { return auth_maintenance_stop; });
+        }
+
+        if (Clock::now() >= nextFlush) {
+            flushLastUsed(*db);
+            nextFlush = Clock::now() + std::chrono::seconds(LAST_USED_FLUSH_SECONDS);
+        }
     }
 
-    return valid;
+    if (listenConn) PQfinish(listenConn);
+    flushLastUsed(*db);
+}
+
+void startAuthMaintenance(const Database& db) {
+    std::lock_guard<std::mutex> lock(auth_maintenance_mutex);
+    if (auth_maintenance_thread.joinable() || !db.hasConfig()) return;
+    auth_maintenance_stop = false;
+    auth_maintenance_thread = std::thread(runAuthMaintenance, &db);
+}
+
+void stopAuthMaintenance() {
+    {
+        std::lock_guard<std::mutex> lock(auth_maintenance_mutex);
+        auth_maintenance_stop = true;
+    }
+    auth_maintenance_cv.notify_all();
+    if (auth_maintenance_thread.joinable()) auth_maintenance_thread.join();
+}
+
+std::vector<CacheShardStats> getAuthCacheStats() {
+    return keyCache().stats();
+}
+
+std::vector<CacheShardStats> getNegativeAuthCacheStats() {
+    return negativeKeyCache().stats();
 }
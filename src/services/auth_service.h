@@ -2,7 +2,18 @@
 
 #include <string>
 #include "../db/database.h"
+#include "../cache/sharded_cache.h"
+#include <chrono>
+#include <optional>
+#include <vector>
 
 std::string sha256Hex(const std::string& input);
 bool constantTimeEquals(const std::string& a, const std::string& b);
 bool validateKeyViaDatabase(const std::string& providedKey, const Database& db);
+void startAuthMaintenance(const Database& db);
+void stopAuthMaintenance();
+// Number of keys the maintenance thread's first preload put into the cache;
+// nullopt when it failed or has not finished by the deadline.
+std::optional<size_t> waitForApiKeyPreload(std::chrono::steady_clock::time_point deadline);
+std::vector<CacheShardStats> getAuthCacheStats();
+std::vector<CacheShardStats> getNegativeAuthCacheStats();
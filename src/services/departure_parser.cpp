@@ -0,0 +1,548 @@
+#include "departure_parser.h"
+#include <map>
+
+namespace {
+
+// --- Raw Field State ---
+// What json::value(key, default) would see: the key is absent, holds a string,
+// or holds anything else (which makes value() throw a type_error).
+struct RawField {
+    enum State : uint8_t { Absent, String, Other };
+    State state = Absent;
+    std::string text;
+
+    void setString(std::string& value) {
+        state = String;
+        text.swap(value);
+    }
+    void setOther() {
+        state = Other;
+        text.clear();
+    }
+    void reset() {
+        state = Absent;
+        text.clear();
+    }
+};
+
+// Hint arrays (servingLine.hints and the departure's own hints)
+struct RawHintList {
+    enum State : uint8_t { Absent, NonArray, Array };
+    State state = Absent;
+    bool throws = false;            // An element would make value() throw
+    std::vector<std::string> texts; // h.value("hint", h.value("content", "")) per element
+
+    void reset(State next) {
+        state = next;
+        throws = false;
+        texts.clear();
+    }
+};
+
+struct RawDeparture {
+    enum ServingLineState : uint8_t { SlAbsent, SlNonObject, SlObject };
+    ServingLineState servingLine = SlAbsent;
+    RawField number, direction, motType, delay, trainType, trainLength, trainComposition;
+    RawHintList lineHints;
+
+    bool attrsArray = false;
+    bool attrsThrow = false;
+    bool hasPlanLowFloor = false, planLowFloor = false;
+    bool hasPlanWheelchair = false, planWheelchair = false;
+
+    RawField platform, platformName, countdown;
+    bool hasRealDateTime = false;
+    RawHintList hints;
+
+    // Trip identity only; normalizeResponse never reads these
+    RawField stateless, year, month, day, hour, minute;
+
+    void resetServingLine(ServingLineState next) {
+        servingLine = next;
+        number.reset(); direction.reset(); motType.reset(); delay.reset(); stateless.reset();
+        trainType.reset(); trainLength.reset(); trainComposition.reset();
+        lineHints.reset(RawHintList::Absent);
+    }
+    void resetAttrs(bool isArray) {
+        attrsArray = isArray;
+        attrsThrow = false;
+        hasPlanLowFloor = planLowFloor = false;
+        hasPlanWheelchair = planWheelchair = false;
+    }
+};
+
+enum class Ctx : uint8_t { Root, List, ListObject, Dep, ServingLine, DateTime, Hints, Hint, Attrs, Attr, Skip };
+
+enum class Key : uint8_t {
+    None, DepartureList, Error, ServingLine, Attrs, Platform, PlatformName, Countdown, RealDateTime,
+    Hints, Number, Direction, MotType, Delay, TrainType, TrainLength, TrainComposition,
+    Hint, Content, Name, Value, DateTime, Stateless, Year, Month, Day, Hour, Minute, Other
+};
+
+struct Frame {
+    Ctx ctx;
+    Key key = Key::None;
+};
+
+bool strToBool(const std::string& v) {
+    return v == "1" || equalsIgnoreCase(v, "true") || equalsIgnoreCase(v, "yes");
+}
+
+// std::stoi with normalizeResponse's catch(...) fallbacks
+int stoiOr(const RawField& field, int fallback) {
+    if (field.state != RawField::String) return fallback;
+    try {
+        return std::stoi(field.text);
+    } catch (...) {
+        return fallback;
+    }
+}
+
+// --- SAX Handler ---
+class DepartureSax {
+public:
+    using number_integer_t = json::number_integer_t;
+    using number_unsigned_t = json::number_unsigned_t;
+    using number_float_t = json::number_float_t;
+    using string_t = json::string_t;
+    using binary_t = json::binary_t;
+
+    bool hasErrorKey = false;
+    bool listIsObject = false;
+    bool listFailed = false;
+    std::vector<Departure> list;
+    std::map<std::string, std::optional<Departure>> listObject;  // nullopt = would throw
+
+    bool null() { scalar(nullptr, true); return true; }
+    bool boolean(bool) { scalar(nullptr, false); return true; }
+    bool number_integer(number_integer_t) { scalar(nullptr, false); return true; }
+    bool number_unsigned(number_unsigned_t) { scalar(nullptr, false); return true; }
+    bool number_float(number_float_t, const string_t&) { scalar(nullptr, false); return true; }
+    bool string(string_t& value) { scalar(&value, false); return true; }
+    bool binary(binary_t&) { scalar(nullptr, false); return true; }
+
+    bool start_object(std::size_t) { enter(true); return true; }
+    bool start_array(std::size_t) { enter(false); return true; }
+    bool end_object() { leave(); return true; }
+    bool end_array() { leave(); return true; }
+
+    bool key(string_t& name) {
+        Frame& top = frames_.back();
+        switch (top.ctx) {
+            case Ctx::Root:
+                top.key = name == "departureList" ? Key::DepartureList
+                        : name == "error" ? Key::Error : Key::Other;
+                if (top.key == Key::Error) hasErrorKey = true;
+                break;
+            case Ctx::ListObject:
+                listKey_ = name;
+                top.key = Key::Other;
+                break;
+            case Ctx::Dep:
+                top.key = name == "servingLine" ? Key::ServingLine
+                        : name == "attrs" ? Key::Attrs
+                        : name == "platform" ? Key::Platform
+                        : name == "platformName" ? Key::PlatformName
+                        : name == "countdown" ? Key::Countdown
+                        : name == "realDateTime" ? Key::RealDateTime
+                        : name == "dateTime" ? Key::DateTime
+                        : name == "hints" ? Key::Hints : Key::Other;
+                if (top.key == Key::RealDateTime) cur_.hasRealDateTime = true;
+                break;
+            case Ctx::ServingLine:
+                top.key = name == "number" ? Key::Number
+                        : name == "direction" ? Key::Direction
+                        : name == "motType" ? Key::MotType
+                        : name == "delay" ? Key::Delay
+                        : name == "trainType" ? Key::TrainType
+                        : name == "trainLength" ? Key::TrainLength
+                        : name == "trainComposition" ? Key::TrainComposition
+                        : name == "stateless" ? Key::Stateless
+                        : name == "hints" ? Key::Hints : Key::Other;
+                break;
+            case Ctx::DateTime:
+                top.key = name == "year" ? Key::Year
+                        : name == "month" ? Key::Month
+                        : name == "day" ? Key::Day
+                        : name == "hour" ? Key::Hour
+                        : name == "minute" ? Key::Minute : Key::Other;
+                break;
+            case Ctx::Hint:
+                top.key = name == "hint" ? Key::Hint : name == "content" ? Key::Content : Key::Other;
+                break;
+            case Ctx::Attr:
+                top.key = name == "name" ? Key::Name : name == "value" ? Key::Value : Key::Other;
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) {
+        return false;
+    }
+
+private:
+    std::vector<Frame> frames_;
+    RawDeparture cur_;
+    RawField hintText_, hintContent_;
+    RawField attrName_, attrValue_;
+    RawHintList* hintTarget_ = nullptr;
+    std::string listKey_;
+
+    // --- Helper: Record a List Element that is not an Object ---
+    void addDefaultDeparture() {
+        if (listIsObject) {
+            listObject[listKey_] = Departure{};
+        } else {
+            list.emplace_back();
+        }
+    }
+
+    RawField* fieldFor(Ctx ctx, Key key) {
+        if (ctx == Ctx::Dep) {
+            switch (key) {
+                case Key::Platform: return &cur_.platform;
+                case Key::PlatformName: return &cur_.platformName;
+                case Key::Countdown: return &cur_.countdown;
+                default: return nullptr;
+            }
+        }
+        if (ctx == Ctx::ServingLine) {
+            switch (key) {
+                case Key::Number: return &cur_.number;
+                case Key::Direction: return &cur_.direction;
+                case Key::MotType: return &cur_.motType;
+                case Key::Delay: return &cur_.delay;
+                case Key::TrainType: return &cur_.trainType;
+                case Key::TrainLength: return &cur_.trainLength;
+                case Key::TrainComposition: return &cur_.trainComposition;
+                case Key::Stateless: return &cur_.stateless;
+                default: return nullptr;
+            }
+        }
+        if (ctx == Ctx::DateTime) {
+            switch (key) {
+                case Key::Year: return &cur_.year;
+                case Key::Month: return &cur_.month;
+                case Key::Day: return &cur_.day;
+                case Key::Hour: return &cur_.hour;
+                case Key::Minute: return &cur_.minute;
+                default: return nullptr;
+            }
+        }
+        if (ctx == Ctx::Hint) {
+            if (key == Key::Hint) return &hintText_;
+            if (key == Key::Content) return &hintContent_;
+        }
+        if (ctx == Ctx::Attr) {
+            if (key == Key::Name) return &attrName_;
+            if (key == Key::Value) return &attrValue_;
+        }
+        return nullptr;
+    }
+
+    void resetList(bool isObject) {
+        listIsObject = isObject;
+        listFailed = false;
+        list.clear();
+        listObject.clear();
+    }
+
+    // --- Scalars (value is set for strings only) ---
+    void scalar(std::string* value, bool isNull) {
+        if (frames_.empty()) return;
+        Frame& top = frames_.back();
+
+        switch (top.ctx) {
+            case Ctx::Root:
+                if (top.key == Key::DepartureList) {
+                    // null iterates as empty; other scalars iterate once as a non-object departure
+                    resetList(false);
+                    if (!isNull) addDefaultDeparture();
+                }
+                break;
+            case Ctx::List:
+            case Ctx::ListObject:
+                addDefaultDeparture();
+                break;
+            case Ctx::Dep:
+                if (top.key == Key::ServingLine) {
+                    cur_.resetServingLine(RawDeparture::SlNonObject);
+                } else if (top.key == Key::Attrs) {
+                    cur_.resetAttrs(false);
+                } else if (top.key == Key::Hints) {
+                    cur_.hints.reset(RawHintList::NonArray);
+                } else if (RawField* field = fieldFor(top.ctx, top.key)) {
+                    if (value) field->setString(*value); else field->setOther();
+                }
+                break;
+            case Ctx::ServingLine:
+                if (top.key == Key::Hints) {
+                    cur_.lineHints.reset(RawHintList::NonArray);
+                } else if (RawField* field = fieldFor(top.ctx, top.key)) {
+                    if (value) field->setString(*value); else field->setOther();
+                }
+                break;
+            case Ctx::DateTime:
+            case Ctx::Hint:
+            case Ctx::Attr:
+                if (RawField* field = fieldFor(top.ctx, top.key)) {
+                    if (value) field->setString(*value); else field->setOther();
+                }
+                break;
+            case Ctx::Hints:
+                hintTarget_->throws = true;  // value() on a non-object element
+                break;
+            case Ctx::Attrs:
+                cur_.attrsThrow = true;
+                break;
+            case Ctx::Skip:
+                break;
+        }
+    }
+
+    void enter(bool isObject) {
+        if (frames_.empty()) {
+            frames_.push_back({isObject ? Ctx::Root : Ctx::Skip});
+            return;
+        }
+        Frame& top = frames_.back();
+        Ctx next = Ctx::Skip;
+
+        switch (top.ctx) {
+            case Ctx::Root:
+                if (top.key == Key::DepartureList) {
+                    resetList(isObject);
+                    next = isObject ? Ctx::ListObject : Ctx::List;
+                }
+                break;
+            case Ctx::List:
+            case Ctx::ListObject:
+                if (isObject) {
+                    cur_ = RawDeparture();
+                    next = Ctx::Dep;
+                } else {
+                    addDefaultDeparture();
+                }
+                break;
+            case Ctx::Dep:
+                if (top.key == Key::ServingLine) {
+                    cur_.resetServingLine(isObject ? RawDeparture::SlObject : RawDeparture::SlNonObject);
+                    if (isObject) next = Ctx::ServingLine;
+                } else if (top.key == Key::Attrs) {
+                    cur_.resetAttrs(!isObject);
+                    if (!isObject) next = Ctx::Attrs;
+                } else if (top.key == Key::DateTime) {
+                    if (isObject) next = Ctx::DateTime;
+                } else if (top.key == Key::Hints) {
+                    cur_.hints.reset(isObject ? RawHintList::NonArray : RawHintList::Array);
+                    if (!isObject) {
+                        hintTarget_ = &cur_.hints;
+                        next = Ctx::Hints;
+                    }
+                } else if (RawField* field = fieldFor(top.ctx, top.key)) {
+                    field->setOther();
+                }
+                break;
+            case Ctx::ServingLine:
+                if (top.key == Key::Hints) {
+                    cur_.lineHints.reset(isObject ? RawHintList::NonArray : RawHintList::Array);
+                    if (!isObject) {
+                        hintTarget_ = &cur_.lineHints;
+                        next = Ctx::Hints;
+                    }
+                } else if (RawField* field = fieldFor(top.ctx, top.key)) {
+                    field->setOther();
+                }
+                break;
+            case Ctx::Hints:
+                if (isObject) {
+                    hintText_.reset();
+                    hintContent_.reset();
+                    next = Ctx::Hint;
+                } else {
+                    hintTarget_->throws = true;
+                }
+                break;
+            case Ctx::Attrs:
+                if (isObject) {
+                    attrName_.reset();
+                    attrValue_.reset();
+                    next = Ctx::Attr;
+                } else {
+                    cur_.attrsThrow = true;
+                }
+                break;
+            case Ctx::DateTime:
+            case Ctx::Hint:
+            case Ctx::Attr:
+                if (RawField* field = fieldFor(top.ctx, top.key)) field->setOther();
+                break;
+            case Ctx::Skip:
+                break;
+        }
+        frames_.push_back({next});
+    }
+
+    void leave() {
+        Ctx ctx = frames_.back().ctx;
+        frames_.pop_back();
+
+        switch (ctx) {
+            case Ctx::Dep: {
+                std::optional<Departure> finished = finishDeparture();
+                if (listIsObject) {
+                    listObject[listKey_] = std::move(finished);
+                } else if (finished) {
+                    list.push_back(std::move(*finished));
+                } else {
+                    listFailed = true;
+                }
+                break;
+            }
+            case Ctx::Hint: {
+                // h.value("hint", h.value("content", "")): both lookups run, either may throw
+                if (hintContent_.state == RawField::Other || hintText_.state == RawField::Other) {
+                    hintTarget_->throws = true;
+                } else if (hintText_.state == RawField::String) {
+                    hintTarget_->texts.push_back(std::move(hintText_.text));
+                } else {
+                    hintTarget_->texts.push_back(std::move(hintContent_.text));
+                }
+                break;
+            }
+            case Ctx::Attr: {
+                if (attrName_.state == RawField::Other || attrValue_.state == RawField::Other) {
+                    cur_.attrsThrow = true;
+                    break;
+                }
+                if (equalsIgnoreCase(attrName_.text, "planlowfloorvehicle")) {
+                    cur_.hasPlanLowFloor = true;
+                    cur_.planLowFloor = strToBool(attrValue_.text);
+                } else if (equalsIgnoreCase(attrName_.text, "planwheelchairaccess")) {
+                    cur_.hasPlanWheelchair = true;
+                    cur_.planWheelchair = strToBool(attrValue_.text);
+                }
+                break;
+            }
+            case Ctx::Hints:
+                // Back in the owning object; the dep-level list is the only other target
+                hintTarget_ = nullptr;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // --- Helper: Apply normalizeResponse's Rules to the Collected Fields ---
+    std::optional<Departure> finishDeparture() {
+        Departure d;
+        const RawDeparture& raw = cur_;
+
+        if (raw.servingLine == RawDeparture::SlNonObject) return std::nullopt;
+        if (raw.servingLine == RawDeparture::SlObject) {
+            d.hasServingLine = true;
+
+            if (raw.number.state == RawField::Other || raw.direction.state == RawField::Other) return std::nullopt;
+            d.line = raw.number.state == RawField::String ? raw.number.text : "?";
+            d.direction = raw.direction.state == RawField::String ? raw.direction.text : "Unknown";
+
+            d.mot = raw.motType.state == RawField::Absent ? -1 : stoiOr(raw.motType, -1);
+            if (raw.delay.state != RawField::Absent) d.delayMinutes = stoiOr(raw.delay, 0);
+
+            if (raw.attrsArray && raw.attrsThrow) return std::nullopt;
+
+            bool hintLowFloor = false;
+            bool hintWheelchair = false;
+            if (raw.lineHints.state == RawHintList::Array) {
+                if (raw.lineHints.throws) return std::nullopt;
+                for (const auto& txt : raw.lineHints.texts) {
+                    HintAccessibility found = scanAccessibilityHint(txt);
+                    hintLowFloor = hintLowFloor || found.lowFloor;
+                    hintWheelchair = hintWheelchair || found.wheelchair;
+                }
+            }
+
+            bool lowFloor = raw.hasPlanLowFloor ? raw.planLowFloor : hintLowFloor;
+            bool wheelchair = raw.hasPlanWheelchair ? raw.planWheelchair : hintWheelchair;
+            d.lowFloor = lowFloor;
+            d.wheelchairAccessible = wheelchair || lowFloor;
+
+            if (raw.trainType.state == RawField::Other) return std::nullopt;
+            if (raw.trainType.state == RawField::String) d.trainType = raw.trainType.text;
+            if (raw.trainLength.state != RawField::Absent) {
+                if (raw.trainLength.state == RawField::Other) return std::nullopt;
+                d.trainLength = raw.trainLength.text;
+            } else if (raw.trainComposition.state != RawField::Absent) {
+                if (raw.trainComposition.state == RawField::Other) return std::nullopt;
+                d.trainComposition = raw.trainComposition.text;
+            }
+        }
+
+        const RawField& platform = raw.platform.state != RawField::Absent ? raw.platform : raw.platformName;
+        if (platform.state == RawField::Other) return std::nullopt;
+        if (platform.state == RawField::String) d.platform = platform.text;
+
+        d.minutesRemaining = raw.countdown.state == RawField::Absent ? 0 : stoiOr(raw.countdown, 0);
+        d.isRealtime = raw.hasRealDateTime;
+
+        if (raw.hints.state == RawHintList::Array) {
+            if (raw.hints.throws) return std::nullopt;
+            for (const auto& txt : raw.hints.texts) {
+                if (!txt.empty()) d.hints.push_back(txt);
+            }
+        }
+
+        // Line ID and planned dateTime, e.g. "kvv:2100S1:H:j25@2026-10-14 14:30"
+        d.tripKey = raw.stateless.state == RawField::String ? raw.stateless.text : d.line + "|" + d.direction;
+        auto part = [](const RawField& field) { return field.state == RawField::String ? field.text : ""; };
+        d.tripKey += "@" + part(raw.year) + "-" + part(raw.month) + "-" + part(raw.day)
+                   + " " + part(raw.hour) + ":" + part(raw.minute);
+        return d;
+    }
+};
+
+} // namespace
+
+// --- Parse ---
+DepartureParseResult parseDepartureList(const std::string& text) {
+    DepartureParseResult result;
+    DepartureSax handler;
+
+    if (!json::sax_parse(text, &handler)) {
+        result.status = DepartureParseStatus::InvalidJson;
+        return result;
+    }
+    if (handler.hasErrorKey) {
+        result.status = DepartureParseStatus::ProviderError;
+        return result;
+    }
+
+    if (handler.listIsObject) {
+        // Object iteration visits values in key order; duplicate keys keep the last value
+        for (auto& [key, departure] : handler.listObject) {
+            if (!departure) {
+                result.status = DepartureParseStatus::NormalizeFailed;
+                result.departures.clear();
+                return result;
+            }
+            result.departures.push_back(std::move(*departure));
+        }
+    } else {
+        if (handler.listFailed) {
+            result.status = DepartureParseStatus::NormalizeFailed;
+            return result;
+        }
+        result.departures = std::move(handler.list);
+    }
+
+    // Repeated trip keys (e.g. missing dateTime) are numbered in list order
+    std::map<std::string, size_t> seen;
+    for (auto& departure : result.departures) {
+        size_t repeat = seen[departure.tripKey]++;
+        if (repeat > 0) departure.tripKey += "#" + std::to_string(repeat);
+    }
+    return result;
+}
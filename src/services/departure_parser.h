@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../config/config.h"
+#include "../models/departure.h"
+#include <string>
+#include <vector>
+
+// --- Streaming DM Response Parser ---
+// Extracts departures from the raw EFA DM payload with a SAX pass, without
+// building a DOM. The result matches normalizeResponse(json::parse(text), true,
+// true) exactly, including the cases where that path fails.
+
+enum class DepartureParseStatus {
+    Ok,
+    InvalidJson,       // json::parse would have thrown
+    ProviderError,     // Top-level "error" key; callers forward the document itself
+    NormalizeFailed    // normalizeResponse would have thrown (wrong value types)
+};
+
+struct DepartureParseResult {
+    DepartureParseStatus status = DepartureParseStatus::Ok;
+    std::vector<Departure> departures;
+};
+
+DepartureParseResult parseDepartureList(const std::string& text);
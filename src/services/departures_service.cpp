@@ -1,34 +1,185 @@
 #include "departures_service.h"
-#include <cpr/cpr.h>
+#include "departure_parser.h"
+#include "../cache/snapshot_store.h"
+#include "../http/admission.h"
+#include "../metrics/tracing.h"
+#include "../http/upstream_client.h"
+#include "../metrics/metrics.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+// --- Helper: Serialize Departures ---
+// Writes straight from the typed model into a per-thread buffer that keeps its
+// capacity between requests; only the final body is allocated.
+template <typename Filter>
+static CachedBodyPtr serializeDepartures(const std::vector<Departure>& departures, bool detailed,
+                                         bool includeDelay, Filter&& keep) {
+    static thread_local std::string buffer;
+    buffer.clear();
+    buffer += '[';
+    bool first = true;
+    for (const auto& dep : departures) {
+        if (!keep(dep)) continue;
+        if (!first) buffer += ',';
+        first = false;
+        appendDepartureJson(buffer, dep, detailed, includeDelay);
+    }
+    buffer += ']';
+    return makeCachedBody(buffer);
+}
+
+// --- Track Matcher ---
+// Built once per request: the needle is assembled up front and each platform
+// is matched in place. A platform matches on equality, on a prefix not
+// followed by a digit ("1" matches "1a", not "12"), or on the track following
+// a space ("1" matches "Gleis 1", which also covers the "Gleis <track>" case).
+class TrackMatcher {
+public:
+    explicit TrackMatcher(const std::string& track) : spaced_(" " + track) {}
+
+    bool operator()(const Departure& dep) const {
+        std::string_view platform = dep.platform;
+        std::string_view track = std::string_view(spaced_).substr(1);
+        if (platform == track) return true;
+        if (platform.size() > track.size() && platform.compare(0, track.size(), track) == 0) {
+            return !std::isdigit(static_cast<unsigned char>(platform[track.size()]));
+        }
+        return platform.find(spaced_) != std::string_view::npos;
+    }
+
+private:
+    std::string spaced_;  // " " + track; the track itself is the suffix
+};
+
+// --- Cached Departure Snapshot ---
+// The normalized superset plus its serialized variants. Each (detailed, delay)
+// body is built once, on first use, and shared by every request that needs it.
+// A version is one distinct departure list; its token is the full body's hash,
+// so it is the same on every replica that saw the same upstream answer.
+struct DepartureVersion {
+    std::string token;
+    std::vector<Departure> departures;
+};
+
+using DepartureVersionPtr = std::shared_ptr<const DepartureVersion>;
+
+struct DepartureSnapshot {
+    DepartureVersionPtr current;
+    std::vector<DepartureVersionPtr> previous;  // Newest first, at most DEPARTURE_DELTA_VERSIONS
+    mutable std::once_flag bodyOnce[4];
+    mutable CachedBodyPtr bodies[4];
+    mutable std::mutex trackMutex;
+    mutable std::unordered_map<std::string, std::array<CachedBodyPtr, 4>> trackBodies;
+
+    CachedBodyPtr body(bool detailed, bool includeDelay) const {
+        size_t index = (detailed ? 2 : 0) + (includeDelay ? 1 : 0);
+        std::call_once(bodyOnce[index], [&] {
+            bodies[index] = serializeDepartures(current->departures, detailed, includeDelay,
+                                                [](const Departure&) { return true; });
+        });
+        return bodies[index];
+    }
+
+    // Filtered bodies are kept per requested track, so a board that always
+    // asks for one platform is answered by a lookup. At most maxTracks tracks
+    // are kept per snapshot; others are serialized per request.
+    CachedBodyPtr trackBody(const std::string& track, bool detailed, bool includeDelay, size_t maxTracks) const {
+        size_t index = (detailed ? 2 : 0) + (includeDelay ? 1 : 0);
+        {
+            std::lock_guard<std::mutex> lock(trackMutex);
+            auto it = trackBodies.find(track);
+            if (it != trackBodies.end() && it->second[index]) return it->second[index];
+        }
+
+        CachedBodyPtr body = serializeDepartures(current->departures, detailed, includeDelay, TrackMatcher(track));
+        std::lock_guard<std::mutex> lock(trackMutex);
+        auto it = trackBodies.find(track);
+        if (it == trackBodies.end()) {
+            if (trackBodies.size() >= maxTracks) return body;
+            it = trackBodies.try_emplace(track).first;
+        }
+        if (!it->second[index]) it->second[index] = body;
+        return it->second[index];
+    }
+
+    const DepartureVersion* find(const std::string& token) const {
+        if (current->token == token) return current.get();
+        for (const auto& version : previous) {
+            if (version->token == token) return version.get();
+        }
+        return nullptr;
+    }
+};
+
+using SnapshotPtr = std::shared_ptr<const DepartureSnapshot>;
+using DepartureCache = ShardedCache<SnapshotPtr>;
+
+// In-flight result: a snapshot on success, otherwise the upstream error object.
+struct DepartureFetch {
+    SnapshotPtr snapshot;
+    std::shared_ptr<const json> error;
+    bool shed = false;  // Not sent: the upstream admission lane was full
+};
+
+using DepartureFetchCallback = std::function<void(const DepartureFetch&)>;
+
+// --- In-flight Upstream Fetches (one per stop ID, protected by inflight_mutex) ---
+// Each entry holds the callbacks waiting for that stop's DM response and the
+// scheduling priority of its upstream request.
+struct InflightFetch {
+    std::vector<DepartureFetchCallback> waiters;
+    UpstreamPriority priority;
+};
+
+static std::mutex inflight_mutex;
+static std::map<std::string, InflightFetch> inflight_fetches;
+static std::atomic<uint64_t> coalesced_waiters{0};
+
+// --- Background Refresh State ---
+// refresh_config is set once in main() before app.run().
+static DepartureRefreshConfig refresh_config;
+static std::set<std::string> refresh_pending;  // protected by inflight_mutex
+static std::atomic<uint64_t> stale_hits{0};
+static std::atomic<uint64_t> stale_if_error_hits{0};
+static std::atomic<uint64_t> background_refreshes{0};
+
+static std::mutex popularity_mutex;
+static std::unordered_map<std::string, uint64_t> request_counts;
+static std::unordered_map<std::string, size_t> watched_stops;  // Refcounted, protected by popularity_mutex
+
+static std::mutex refresher_mutex;
+static std::condition_variable refresher_cv;
+static std::thread refresher_thread;
+static bool refresher_stopping = false;
 
 // --- Departure Cache ---
-static std::mutex cache_mutex;
-static std::map<std::string, CacheEntry> stop_cache;
+// Entries are kept for the TTL plus the longer of the stale and stale-if-error
+// windows; freshness is decided on lookup.
+static DepartureCache& departureCache() {
+    static DepartureCache cache(MAX_CACHE_ENTRIES,
+                                std::chrono::seconds(CACHE_TTL_SECONDS + std::max(refresh_config.staleSeconds,
+                                                                                  refresh_config.staleIfErrorSeconds)));
+    return cache;
+}
 
 // --- Helper: Fetch Departures ---
-json fetchDeparturesProvider(const std::string& stopId) {
-    cpr::Response r = cpr::Get(
-        cpr::Url{Provider_DM_URL},
-        cpr::Parameters{
-            {"outputFormat", "JSON"},
-            {"depType", "stopEvents"},
-            {"mode", "direct"},
-            {"type_dm", "stop"},
-            {"name_dm", stopId},
-            {"useRealtime", "1"},
-            {"limit", "40"}
-        },
-        cpr::Timeout{UPSTREAM_TIMEOUT_SECONDS * 1000}
-    );
-
-    if (r.status_code != 200) return {{"error", "Upstream Provider error"}, {"code", r.status_code}};
-
-    try {
-        return json::parse(r.text);
-    } catch (...) {
-        return {{"error", "Invalid JSON from Provider"}};
-    }
+static cpr::Parameters departureMonitorParams(const std::string& stopId) {
+    return cpr::Parameters{
+        {"outputFormat", "JSON"},
+        {"depType", "stopEvents"},
+        {"mode", "direct"},
+        {"type_dm", "stop"},
+        {"name_dm", stopId},
+        {"useRealtime", "1"},
+        {"limit", "40"}
+    };
 }
 
 // --- Helper: Normalize Departure Data ---
@@ -37,10 +188,7 @@ json normalizeResponse(const json& ProviderData, bool detailed, bool includeDela
     if (!ProviderData.contains("departureList")) return result;
 
     auto strToBool = [](const std::string& v) {
-        std::string s = v;
-        std::transform(s.begin(), s.end(), s.begin(),
-                       [](unsigned char c){ return std::tolower(c); });
-        return (s == "1" || s == "true" || s == "yes");
+        return v == "1" || equalsIgnoreCase(v, "true") || equalsIgnoreCase(v, "yes");
     };
 
     for (const auto& dep : ProviderData["departureList"]) {
@@ -84,11 +232,10 @@ json normalizeResponse(const json& ProviderData, bool detailed, bool includeDela
                         std::string name = a.value("name", "");
                         std::string value = a.value("value", "");
 
-                        std::string lname = toLower(name);
-                        if (lname == "planlowfloorvehicle") {
+                        if (equalsIgnoreCase(name, "planlowfloorvehicle")) {
                             hasPlanLowFloor = true;
                             planLowFloor = strToBool(value);
-                        } else if (lname == "planwheelchairaccess") {
+                        } else if (equalsIgnoreCase(name, "planwheelchairaccess")) {
                             hasPlanWheelchair = true;
                             planWheelchair = strToBool(value);
                         }
@@ -101,17 +248,9 @@ json normalizeResponse(const json& ProviderData, bool detailed, bool includeDela
                 if (dep["servingLine"].contains("hints") && dep["servingLine"]["hints"].is_array()) {
                     for (const auto& h : dep["servingLine"]["hints"]) {
                         std::string txt = h.value("hint", h.value("content", ""));
-                        if (txt.find("Niederflur") != std::string::npos ||
-                            txt.find("low floor") != std::string::npos ||
-                            txt.find("lowFloor") != std::string::npos) {
-                            hintLowFloor = true;
-                        }
-                        if (txt.find("Rollstuhl") != std::string::npos ||
-                            txt.find("wheelchair") != std::string::npos ||
-                            txt.find("barrierefrei") != std::string::npos ||
-                            txt.find("barrier-free") != std::string::npos) {
-                            hintWheelchair = true;
-                        }
+                        HintAccessibility found = scanAccessibilityHint(txt);
+                        hintLowFloor = hintLowFloor || found.lowFloor;
+                        hintWheelchair = hintWheelchair || found.wheelchair;
                     }
                 }
 
@@ -164,61 +303,526 @@ json normalizeResponse(const json& ProviderData, bool detailed, bool includeDela
     return result;
 }
 
-// --- Departure Cache + Fetch + Filter ---
-json getDepartures(const std::string& stopId, bool detailed, bool includeDelay, const char* track) {
-    json allDepartures;
-    bool cacheHit = false;
-    std::string cacheKey = stopId + (detailed ? "_detailed" : "") + (includeDelay ? "_delay" : "");
+// --- Helper: Version History ---
+// The new snapshot keeps the cached one's versions for since= deltas. An
+// unchanged refresh keeps the current version and token as they are.
+static void linkPreviousVersions(DepartureSnapshot& snapshot, const SnapshotPtr& cached) {
+    if (!cached) return;
+    if (cached->current->token == snapshot.current->token) {
+        snapshot.current = cached->current;
+        snapshot.previous = cached->previous;
+        return;
+    }
+    snapshot.previous.push_back(cached->current);
+    for (const auto& version : cached->previous) {
+        if (snapshot.previous.size() >= DEPARTURE_DELTA_VERSIONS) break;
+        snapshot.previous.push_back(version);
+    }
+}
+
+// The token is the full body's ETag without its quotes.
+static SnapshotPtr buildSnapshot(std::vector<Departure> departures, const SnapshotPtr& cached) {
+    auto version = std::make_shared<DepartureVersion>();
+    version->departures = std::move(departures);
+    auto snapshot = std::make_shared<DepartureSnapshot>();
+    snapshot->current = version;
+    const std::string& etag = snapshot->body(true, true)->etag;
+    version->token = etag.substr(1, etag.size() - 2);
+    linkPreviousVersions(*snapshot, cached);
+    return snapshot;
+}
+
+// --- Helper: Extract a DM Response ---
+// The DM payload is streamed through the SAX extractor instead of being parsed
+// into a DOM; results match json::parse followed by
+// normalizeResponse(raw, true, true).
+static DepartureFetch extractDepartureSnapshot(const UpstreamResponse& r, const SnapshotPtr& cached) {
+    DepartureFetch outcome;
+    if (r.status_code != 200) {
+        outcome.error = std::make_shared<const json>(json{{"error", "Upstream Provider error"}, {"code", r.status_code}});
+        return outcome;
+    }
+
+    static const MetricHistogram parseLatency = jsonParseHistogram("departures");
+    TraceSpanTimer span("parse");
+    auto parseStart = std::chrono::steady_clock::now();
+    DepartureParseResult parsed = parseDepartureList(r.text);
+    parseLatency.observe(std::chrono::steady_clock::now() - parseStart);
+    switch (parsed.status) {
+        case DepartureParseStatus::InvalidJson:
+            outcome.error = std::make_shared<const json>(json{{"error", "Invalid JSON from Provider"}});
+            break;
+        case DepartureParseStatus::ProviderError:
+            outcome.error = std::make_shared<const json>(json::parse(r.text));
+            break;
+        case DepartureParseStatus::NormalizeFailed:
+            outcome.error = std::make_shared<const json>(json{{"error", "Upstream Provider error"}});
+            break;
+        case DepartureParseStatus::Ok:
+            outcome.snapshot = buildSnapshot(std::move(parsed.departures), cached);
+            break;
+    }
+    return outcome;
+}
 
+// --- Helper: Coalesced Fetch ---
+// The first caller for a stop ID sends the DM request; concurrent callers for
+// the same stop are queued on that entry instead of issuing their own. When the
+// response arrives (on the upstream completion pool) the full superset is
+// normalized, cached, and handed to every queued callback. A client-initiated
+// fetch (admit) needs an upstream admission slot; joining one does not, but
+// raises the request's priority if it is still waiting for the host's budget.
+// Each callback runs under the trace of the request that queued it.
+static void fetchDeparturesCoalesced(const std::string& stopId, bool admit, uint64_t priority,
+                                     DepartureFetchCallback done) {
+    TracePtr trace = currentTrace();
+    uint64_t queuedNs = trace ? monotonicNanos() : 0;
+    UpstreamPriority upstreamPriority;
     {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        auto it = stop_cache.find(cacheKey);
-        if (it != stop_cache.end()) {
-            auto now = std::chrono::steady_clock::now();
-            if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second.timestamp).count() < CACHE_TTL_SECONDS) {
-                allDepartures = it->second.data;
-                cacheHit = true;
+        std::unique_lock<std::mutex> lock(inflight_mutex);
+        auto [it, leader] = inflight_fetches.try_emplace(stopId);
+        if (!leader) {
+            if (trace) {
+                done = [trace, queuedNs, done = std::move(done)](const DepartureFetch& fetched) {
+                    TraceScope scope(trace);
+                    trace->addSpan("coalesced_wait", queuedNs, monotonicNanos());
+                    done(fetched);
+                };
             }
+            it->second.waiters.push_back(std::move(done));
+            raiseUpstreamPriority(it->second.priority, priority);
+            coalesced_waiters.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (admit && !tryAdmit(AdmissionLane::Upstream)) {
+            inflight_fetches.erase(it);
+            lock.unlock();
+            static const auto busy = std::make_shared<const json>(json{{"error", "Server busy, retry later"}});
+            DepartureFetch shed;
+            shed.error = busy;
+            shed.shed = true;
+            done(shed);
+            return;
+        }
+        it->second.waiters.push_back(std::move(done));
+        it->second.priority = makeUpstreamPriority(priority);
+        upstreamPriority = it->second.priority;
+    }
+
+    upstreamGetAsync(Provider_DM_URL, departureMonitorParams(stopId), UPSTREAM_TIMEOUT_SECONDS * 1000,
+                     [stopId, admit, trace, queuedNs](UpstreamResponse r) {
+        if (admit) releaseAdmission(AdmissionLane::Upstream);
+        TraceScope scope(trace);
+        if (trace) trace->addSpan("upstream", queuedNs, monotonicNanos());
+        DepartureFetch outcome;
+        try {
+            auto cached = departureCache().peek(stopId);
+            outcome = extractDepartureSnapshot(r, cached ? cached->value : nullptr);
+            if (outcome.snapshot) departureCache().put(stopId, outcome.snapshot);
+        } catch (...) {
+            outcome.error = std::make_shared<const json>(json{{"error", "Upstream Provider error"}});
+        }
+
+        std::vector<DepartureFetchCallback> waiters;
+        {
+            std::lock_guard<std::mutex> lock(inflight_mutex);
+            auto it = inflight_fetches.find(stopId);
+            waiters = std::move(it->second.waiters);
+            inflight_fetches.erase(it);
         }
+        for (auto& waiter : waiters) waiter(outcome);
+    }, std::move(upstreamPriority));
+}
+
+uint64_t getCoalescedDepartureWaiters() {
+    return coalesced_waiters.load(std::memory_order_relaxed);
+}
+
+// --- Helper: Upstream Priority ---
+// Popularity is the stop's request count (tracked with REFRESH_HOT_STOPS) plus
+// its stream subscribers. Client misses rank above every background refresh;
+// refreshes rank by popularity plus the seconds they are past their deadline.
+static uint64_t stopPopularity(const std::string& stopId) {
+    std::lock_guard<std::mutex> lock(popularity_mutex);
+    uint64_t popularity = 0;
+    auto requests = request_counts.find(stopId);
+    if (requests != request_counts.end()) popularity += requests->second;
+    auto watched = watched_stops.find(stopId);
+    if (watched != watched_stops.end()) popularity += watched->second;
+    return std::min(popularity, UPSTREAM_PRIORITY_CLIENT - 1);
+}
+
+// Each stop is due up to jitterSeconds before it expires, spread by stop ID so
+// entries fetched together do not all expire together.
+static int64_t refreshDeadlineSeconds(const std::string& stopId) {
+    int64_t jitter = refresh_config.jitterSeconds > 0
+        ? static_cast<int64_t>(std::hash<std::string>{}(stopId) % (refresh_config.jitterSeconds + 1)) : 0;
+    return CACHE_TTL_SECONDS - REFRESH_LEAD_SECONDS - jitter;
+}
+
+static uint64_t refreshPriority(const std::string& stopId) {
+    uint64_t overdue = 0;
+    if (auto entry = departureCache().peek(stopId)) {
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - entry->timestamp).count();
+        overdue = static_cast<uint64_t>(std::max<int64_t>(0, age - refreshDeadlineSeconds(stopId)));
     }
+    return std::min(stopPopularity(stopId) + overdue, UPSTREAM_PRIORITY_CLIENT - 1);
+}
+
+static uint64_t clientPriority(const std::string& stopId) {
+    return UPSTREAM_PRIORITY_CLIENT + stopPopularity(stopId);
+}
+
+// --- Helper: Background Refresh ---
+// Queues at most one refresh per stop and at most refresh_config.concurrency in
+// total; stale entries keep being served until the refresh lands, and skipped
+// stops are picked up again on the next stale hit or refresher pass.
+static void scheduleBackgroundRefresh(const std::string& stopId) {
+    {
+        std::lock_guard<std::mutex> lock(inflight_mutex);
+        if (inflight_fetches.count(stopId) > 0) return;
+        if (refresh_pending.size() >= refresh_config.concurrency) return;
+        if (!refresh_pending.insert(stopId).second) return;
+    }
+    background_refreshes.fetch_add(1, std::memory_order_relaxed);
+    fetchDeparturesCoalesced(stopId, false, refreshPriority(stopId), [stopId](const DepartureFetch&) {
+        std::lock_guard<std::mutex> lock(inflight_mutex);
+        refresh_pending.erase(stopId);
+    });
+}
+
+static void recordStopRequest(const std::string& stopId) {
+    std::lock_guard<std::mutex> lock(popularity_mutex);
+    ++request_counts[stopId];
+}
+
+void watchDepartureStop(const std::string& stopId) {
+    std::lock_guard<std::mutex> lock(popularity_mutex);
+    ++watched_stops[stopId];
+}
+
+void unwatchDepartureStop(const std::string& stopId) {
+    std::lock_guard<std::mutex> lock(popularity_mutex);
+    auto it = watched_stops.find(stopId);
+    if (it != watched_stops.end() && --it->second == 0) watched_stops.erase(it);
+}
+
+// --- Hot Stop Refresher ---
+// Every second, re-fetches the most requested stops and every watched stop
+// whose cache entry is about to expire (see refreshDeadlineSeconds). Request counts are halved periodically
+// so the hot set follows demand.
+static void runRefresher() {
+    auto lastDecay = std::chrono::steady_clock::now();
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(refresher_mutex);
+            refresher_cv.wait_for(lock, std::chrono::seconds(1), [] { return refresher_stopping; });
+            if (refresher_stopping) return;
+        }
+
+        std::vector<std::pair<std::string, uint64_t>> ranked;
+        std::vector<std::string> candidates;
+        {
+            std::lock_guard<std::mutex> lock(popularity_mutex);
+            ranked.assign(request_counts.begin(), request_counts.end());
+            for (const auto& watched : watched_stops) candidates.push_back(watched.first);
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastDecay >= std::chrono::seconds(REFRESH_DECAY_INTERVAL_SECONDS)) {
+                lastDecay = now;
+                for (auto it = request_counts.begin(); it != request_counts.end(); ) {
+                    it->second /= 2;
+                    if (it->second == 0) it = request_counts.erase(it);
+                    else ++it;
+                }
+            }
+        }
 
-    if (!cacheHit) {
-        json rawData = fetchDeparturesProvider(stopId);
-        if (rawData.contains("error")) {
-            return rawData;  // Caller checks for "error" key to return 502
+        size_t count = std::min(refresh_config.hotStopCount, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                          [](const auto& a, const auto& b) { return a.second > b.second; });
+        for (size_t i = 0; i < count; ++i) candidates.push_back(ranked[i].first);
+
+        auto now = std::chrono::steady_clock::now();
+        for (const std::string& stopId : candidates) {
+            bool due = true;
+            if (auto entry = departureCache().peek(stopId)) {
+                auto age = std::chrono::duration_cast<std::chrono::seconds>(now - entry->timestamp).count();
+                due = age >= refreshDeadlineSeconds(stopId);
+            }
+            if (due) scheduleBackgroundRefresh(stopId);
         }
+    }
+}
+
+void configureDepartureRefresh(const DepartureRefreshConfig& config) {
+    refresh_config = config;
+}
+
+// Runs even without hot stops so watched (streamed) stops stay fresh.
+void startDepartureRefresher() {
+    if (refresher_thread.joinable()) return;
+    refresher_thread = std::thread(runRefresher);
+    if (refresh_config.hotStopCount > 0) {
+        std::cout << "Departure refresher enabled for the " << refresh_config.hotStopCount
+                  << " most requested stops." << std::endl;
+    }
+}
 
-        allDepartures = normalizeResponse(rawData, detailed, includeDelay);
+void stopDepartureRefresher() {
+    {
+        std::lock_guard<std::mutex> lock(refresher_mutex);
+        refresher_stopping = true;
+    }
+    refresher_cv.notify_all();
+    if (refresher_thread.joinable()) refresher_thread.join();
+}
+
+uint64_t getStaleDepartureHits() {
+    return stale_hits.load(std::memory_order_relaxed);
+}
+
+uint64_t getStaleIfErrorDepartureHits() {
+    return stale_if_error_hits.load(std::memory_order_relaxed);
+}
 
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        evictExpiredCacheEntries(stop_cache);
-        if (stop_cache.size() < MAX_CACHE_ENTRIES) {
-            stop_cache[cacheKey] = {allDepartures, std::chrono::steady_clock::now()};
+uint64_t getBackgroundDepartureRefreshes() {
+    return background_refreshes.load(std::memory_order_relaxed);
+}
+
+std::vector<CacheShardStats> getDepartureCacheStats() {
+    return departureCache().stats();
+}
+
+// --- Persistent Cache Tier ---
+// Entries are exported with their original write time, and a miss that the
+// snapshot file can answer is put back with that time, so TTL, stale and
+// stale-if-error handling continue exactly where the writer left off.
+void registerDepartureCacheSnapshot() {
+    registerPersistentCache("departures", [](const SnapshotWriter& write) {
+        std::vector<std::pair<std::string, DepartureCache::Entry>> entries;
+        departureCache().forEach([&entries](const std::string& stopId, const DepartureCache::Entry& entry) {
+            entries.emplace_back(stopId, entry);
+        });
+        // Encoded outside the shard locks
+        for (const auto& [stopId, entry] : entries) {
+            write(stopId, encodeDepartures(entry.value->current->departures), toWallClock(entry.timestamp),
+                  departureCache().maxAge());
         }
+    });
+}
+
+static std::optional<DepartureCache::Entry> loadPersistedSnapshot(const std::string& stopId) {
+    auto persisted = lookupPersistent("departures", stopId);
+    if (!persisted) return std::nullopt;
+    auto departures = decodeDepartures(persisted->payload);
+    if (!departures) return std::nullopt;
+
+    DepartureCache::Entry entry{buildSnapshot(std::move(*departures), nullptr), toSteadyClock(persisted->storedAt)};
+    departureCache().put(stopId, entry.value, entry.timestamp);
+    return entry;
+}
+
+// --- Helper: Cache Lookup (schedules a refresh for stale hits) ---
+// Entries past the stale window are not served, but are handed back in
+// fallback to answer with if the upstream fetch fails.
+static SnapshotPtr lookupCachedSnapshot(const std::string& stopId, SnapshotPtr& fallback) {
+    TraceSpanTimer span("cache_lookup");
+    if (refresh_config.hotStopCount > 0) recordStopRequest(stopId);
+
+    auto entry = departureCache().get(stopId);
+    if (!entry) entry = loadPersistedSnapshot(stopId);
+    if (!entry) return nullptr;
+
+    auto now = std::chrono::steady_clock::now();
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(now - entry->timestamp).count();
+    if (age >= CACHE_TTL_SECONDS + refresh_config.staleSeconds) {
+        fallback = entry->value;
+        return nullptr;
+    }
+    if (age >= CACHE_TTL_SECONDS) {
+        stale_hits.fetch_add(1, std::memory_order_relaxed);
+        scheduleBackgroundRefresh(stopId);
     }
+    return entry->value;
+}
 
-    if (track) {
-        json filteredDepartures = json::array();
-        std::string reqTrackStr = std::string(track);
+// Current cached body without counting a hit, a request or scheduling a refresh
+CachedBodyPtr peekDepartures(const std::string& stopId, bool detailed, bool includeDelay) {
+    auto entry = departureCache().peek(stopId);
+    if (!entry) return nullptr;
+    return entry->value->body(detailed, includeDelay);
+}
 
-        for (const auto& dep : allDepartures) {
-            std::string platform = dep.value("platform", "");
-            bool match = false;
+// --- Helper: Departure Delta ---
+// Trips are matched by tripKey. Matches have to keep their order and may only
+// differ in minutes_remaining, delay or platform; anything else is sent as a
+// removal plus an addition, so applying the delta always rebuilds the list:
+// update "changed" (by index into the since list), drop "removed", then insert
+// each "added" departure at its position in ascending order.
+static bool sameTripDetails(const Departure& a, const Departure& b) {
+    return a.hasServingLine == b.hasServingLine && a.line == b.line && a.direction == b.direction &&
+           a.mot == b.mot && a.delayMinutes.has_value() == b.delayMinutes.has_value() &&
+           a.lowFloor == b.lowFloor && a.wheelchairAccessible == b.wheelchairAccessible &&
+           a.trainType == b.trainType && a.trainLength == b.trainLength &&
+           a.trainComposition == b.trainComposition && a.isRealtime == b.isRealtime && a.hints == b.hints;
+}
 
-            if (platform == reqTrackStr) {
-                match = true;
-            } else if (platform.size() > reqTrackStr.size() &&
-                       platform.substr(0, reqTrackStr.size()) == reqTrackStr) {
-                if (!std::isdigit(static_cast<unsigned char>(platform[reqTrackStr.size()]))) match = true;
-            } else if (platform.find(" " + reqTrackStr) != std::string::npos ||
-                       platform.find("Gleis " + reqTrackStr) != std::string::npos) {
-                match = true;
+static CachedBodyPtr serializeDelta(const DepartureVersion& since, const DepartureVersion& current, bool detailed,
+                                    bool includeDelay, const std::optional<std::string>& track) {
+    std::optional<TrackMatcher> matcher;
+    if (track) matcher.emplace(*track);
+    auto filtered = [&matcher](const DepartureVersion& version) {
+        std::vector<const Departure*> list;
+        for (const auto& dep : version.departures) {
+            if (!matcher || (*matcher)(dep)) list.push_back(&dep);
+        }
+        return list;
+    };
+    std::vector<const Departure*> before = filtered(since);
+    std::vector<const Departure*> after = filtered(current);
+
+    std::unordered_map<std::string, size_t> indexOf;
+    for (size_t i = 0; i < before.size(); ++i) indexOf.emplace(before[i]->tripKey, i);
+
+    std::vector<bool> kept(before.size(), false);
+    json changed = json::array();
+    std::string added;
+    size_t nextIndex = 0;  // Matches must come after the previous one
+    for (size_t position = 0; position < after.size(); ++position) {
+        const Departure& dep = *after[position];
+        auto it = indexOf.find(dep.tripKey);
+        if (it != indexOf.end() && it->second >= nextIndex && sameTripDetails(*before[it->second], dep)) {
+            const Departure& old = *before[it->second];
+            kept[it->second] = true;
+            nextIndex = it->second + 1;
+
+            json change;
+            if (dep.minutesRemaining != old.minutesRemaining) change["minutes_remaining"] = dep.minutesRemaining;
+            if (includeDelay && dep.hasServingLine && dep.delayMinutes && dep.delayMinutes != old.delayMinutes) {
+                change["delay_minutes"] = *dep.delayMinutes;
+            }
+            if (dep.platform != old.platform) change["platform"] = dep.platform;
+            if (!change.empty()) {
+                change["index"] = it->second;
+                changed.push_back(std::move(change));
             }
+            continue;
+        }
+        if (!added.empty()) added += ',';
+        added += R"({"departure":)";
+        appendDepartureJson(added, dep, detailed, includeDelay);
+        added += R"(,"position":)";
+        added += std::to_string(position);
+        added += '}';
+    }
+
+    json removed = json::array();
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (!kept[i]) removed.push_back(i);
+    }
 
-            if (match) filteredDepartures.push_back(dep);
+    std::string out = R"({"added":[)";
+    out += added;
+    out += R"(],"changed":)";
+    out += changed.dump();
+    out += R"(,"removed":)";
+    out += removed.dump();
+    out += R"(,"since":)";
+    out += json(since.token).dump();
+    out += R"(,"version":)";
+    out += json(current.token).dump();
+    out += '}';
+    return makeCachedBody(std::move(out));
+}
+
+// --- Helper: Render a Snapshot for the Requested Options ---
+static DeparturesResult renderDepartures(const DepartureSnapshot& snapshot, bool detailed, bool includeDelay,
+                                         const std::optional<std::string>& track,
+                                         const std::optional<std::string>& since) {
+    TraceSpanTimer span("render");
+    DeparturesResult result;
+    result.version = snapshot.current->token;
+    if (since) {
+        if (const DepartureVersion* base = snapshot.find(*since)) {
+            result.body = serializeDelta(*base, *snapshot.current, detailed, includeDelay, track);
+            return result;
         }
-        return filteredDepartures;
     }
 
-    return allDepartures;
+    if (!track) {
+        result.body = snapshot.body(detailed, includeDelay);
+        return result;
+    }
+
+    result.body = snapshot.trackBody(*track, detailed, includeDelay, refresh_config.trackBuckets);
+    return result;
+}
+
+// A failed or shed fetch (including a fast failure from an open circuit) is
+// answered from the expired entry when there is one.
+static DeparturesResult resultFor(const DepartureFetch& fetched, const SnapshotPtr& fallback, bool detailed,
+                                  bool includeDelay, const std::optional<std::string>& track,
+                                  const std::optional<std::string>& since) {
+    if (fetched.error && fallback) {
+        stale_if_error_hits.fetch_add(1, std::memory_order_relaxed);
+        return renderDepartures(*fallback, detailed, includeDelay, track, since);
+    }
+    if (fetched.error) return {nullptr, *fetched.error, "", fetched.shed};  // Caller returns 502 (503 when shed)
+    return renderDepartures(*fetched.snapshot, detailed, includeDelay, track, since);
+}
+
+void getDepartures(const std::string& stopId, bool detailed, bool includeDelay,
+                   std::optional<std::string> track, std::optional<std::string> since, DeparturesCallback done) {
+    SnapshotPtr fallback;
+    if (SnapshotPtr snapshot = lookupCachedSnapshot(stopId, fallback)) {
+        done(renderDepartures(*snapshot, detailed, includeDelay, track, since));
+        return;
+    }
+
+    fetchDeparturesCoalesced(stopId, true, clientPriority(stopId),
+                             [fallback, detailed, includeDelay, track = std::move(track), since = std::move(since),
+                              done = std::move(done)](const DepartureFetch& fetched) {
+        done(resultFor(fetched, fallback, detailed, includeDelay, track, since));
+    });
+}
+
+// --- Batch Departures ---
+// Cache hits are rendered inline; misses go through the same coalescing path,
+// so a stop requested by several batches (or single requests) at once is still
+// fetched only once. done runs when the last miss has been answered.
+struct BatchDepartures {
+    std::vector<DeparturesResult> results;
+    std::atomic<size_t> remaining{0};
+    BatchDeparturesCallback done;
+
+    void finishOne() {
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) done(std::move(results));
+    }
+};
+
+void getDeparturesBatch(const std::vector<std::string>& stopIds, bool detailed, bool includeDelay,
+                        std::optional<std::string> track, BatchDeparturesCallback done) {
+    auto batch = std::make_shared<BatchDepartures>();
+    batch->results.resize(stopIds.size());
+    batch->remaining.store(stopIds.size() + 1, std::memory_order_relaxed);  // +1 until every miss is queued
+    batch->done = std::move(done);
+    auto sharedTrack = std::make_shared<const std::optional<std::string>>(std::move(track));
+
+    for (size_t i = 0; i < stopIds.size(); ++i) {
+        SnapshotPtr fallback;
+        if (SnapshotPtr snapshot = lookupCachedSnapshot(stopIds[i], fallback)) {
+            batch->results[i] = renderDepartures(*snapshot, detailed, includeDelay, *sharedTrack, std::nullopt);
+            batch->finishOne();
+            continue;
+        }
+        fetchDeparturesCoalesced(stopIds[i], true, clientPriority(stopIds[i]),
+                                 [batch, i, fallback, detailed, includeDelay, sharedTrack](const DepartureFetch& fetched) {
+            batch->results[i] = resultFor(fetched, fallback, detailed, includeDelay, *sharedTrack, std::nullopt);
+            batch->finishOne();
+        });
+    }
+    batch->finishOne();
 }
@@ -1,8 +1,42 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
+#include <vector>
 #include "../config/config.h"
+#include "../cache/cached_body.h"
+#include "../cache/sharded_cache.h"
 
-json fetchDeparturesProvider(const std::string& stopId);
+struct DeparturesResult {
+    CachedBodyPtr body;         // Serialized departures (or a delta) on success
+    std::optional<json> error;  // Upstream error object, returned with 502
+    std::string version;        // Version token of the cached departures
+    bool overloaded = false;    // Shed by admission control, returned with 503
+};
+
+// Called inline on a cache hit, otherwise on the upstream completion pool.
+using DeparturesCallback = std::function<void(DeparturesResult)>;
+using BatchDeparturesCallback = std::function<void(std::vector<DeparturesResult>)>;
+
+// Reference DOM implementation of parseDepartureList; only the benchmarks call it.
 json normalizeResponse(const json& ProviderData, bool detailed = false, bool includeDelay = false);
-json getDepartures(const std::string& stopId, bool detailed, bool includeDelay, const char* track);
+// With since set to an earlier version token, body is a delta against that
+// version; an unknown token gets the full list.
+void getDepartures(const std::string& stopId, bool detailed, bool includeDelay,
+                   std::optional<std::string> track, std::optional<std::string> since, DeparturesCallback done);
+void getDeparturesBatch(const std::vector<std::string>& stopIds, bool detailed, bool includeDelay,
+                        std::optional<std::string> track, BatchDeparturesCallback done);
+CachedBodyPtr peekDepartures(const std::string& stopId, bool detailed, bool includeDelay);
+void watchDepartureStop(const std::string& stopId);
+void unwatchDepartureStop(const std::string& stopId);
+uint64_t getCoalescedDepartureWaiters();
+void configureDepartureRefresh(const DepartureRefreshConfig& config);
+void registerDepartureCacheSnapshot();
+void startDepartureRefresher();
+void stopDepartureRefresher();
+uint64_t getStaleDepartureHits();
+uint64_t getStaleIfErrorDepartureHits();
+uint64_t getBackgroundDepartureRefreshes();
+std::vector<CacheShardStats> getDepartureCacheStats();
@@ -1,7 +1,28 @@
 #include "notifications_service.h"
-#include <cpr/cpr.h>
+#include "../cache/snapshot_store.h"
+#include "../http/admission.h"
+#include "../metrics/tracing.h"
+#include "../http/upstream_client.h"
+#include "../metrics/metrics.h"
+#include "../util/thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <ctime>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
+
+// --- Notification Cache (per-stop results) ---
+using NotificationCache = ShardedCache<NotificationsResultPtr>;
+
+static NotificationCache& notificationCache() {
+    static NotificationCache cache(MAX_NOTIFICATION_CACHE_ENTRIES, std::chrono::seconds(NOTIFICATION_CACHE_TTL_SECONDS));
+    return cache;
+}
 
 // --- Helper: Parse ISO 8601 Timestamp ---
 
@@ -13,31 +34,39 @@ static std::optional<std::time_t> parseISO8601(const std::string& timestamp) {
     return timegm(&tm); // Interpret as UTC
 }
 
-// --- Helper: Validity Time Range Check ---
-static bool isCurrentlyValid(const json& validity) {
-    if (!validity.is_array() || validity.empty()) return false;
+// --- Helper: Validity Windows ---
+// Parsed once when an alert enters the index instead of on every lookup.
+using ValidityWindow = std::pair<std::time_t, std::time_t>;
 
-    auto now = std::time(nullptr);
+static std::vector<ValidityWindow> parseValidityWindows(const json& validity) {
+    std::vector<ValidityWindow> windows;
+    if (!validity.is_array()) return windows;
 
     for (const auto& range : validity) {
-        if (!range.contains("from") || !range.contains("to")) continue;
+        if (!range.is_object() || !range.contains("from") || !range.contains("to")) continue;
         if (!range["from"].is_string() || !range["to"].is_string()) continue;
 
         auto fromTime = parseISO8601(range["from"].get<std::string>());
         auto toTime = parseISO8601(range["to"].get<std::string>());
 
         if (!fromTime || !toTime) continue;
+        windows.emplace_back(*fromTime, *toTime);
+    }
+    return windows;
+}
 
-        if (now >= *fromTime && now <= *toTime) {
-            return true;
-        }
+static bool isCurrentlyValid(const std::vector<ValidityWindow>& windows, std::time_t now) {
+    // No parseable window: trust the upstream filterValid=1 of the last pull
+    if (windows.empty()) return true;
+    for (const auto& [fromTime, toTime] : windows) {
+        if (now >= fromTime && now <= toTime) return true;
     }
     return false;
 }
 
 // --- Helper: Stop Notification Matching ---
 
-static bool isStopAffected(const json& info, const std::string& stopId) {
+bool isStopAffected(const json& info, const std::string& stopId) {
     // Match against affected.stops array
     if (info.contains("affected") && info["affected"].is_object()) {
         if (info["affected"].contains("stops") && info["affected"]["stops"].is_array()) {
@@ -71,82 +100,393 @@ static bool isStopAffected(const json& info, const std::string& stopId) {
     return false;
 }
 
+// --- Helper: Affected Stop IDs (same sources as isStopAffected) ---
+static std::vector<std::string> collectAffectedStops(const json& info) {
+    std::vector<std::string> stops;
+
+    if (info.contains("affected") && info["affected"].is_object()) {
+        const auto& affected = info["affected"];
+        if (affected.contains("stops") && affected["stops"].is_array()) {
+            for (const auto& stop : affected["stops"]) {
+                if (!stop.is_object()) continue;
+                if (stop.contains("properties") && stop["properties"].is_object() &&
+                    stop["properties"].contains("stopId") && stop["properties"]["stopId"].is_string()) {
+                    stops.push_back(stop["properties"]["stopId"].get<std::string>());
+                }
+                if (stop.contains("id") && stop["id"].is_string()) {
+                    stops.push_back(stop["id"].get<std::string>());
+                }
+            }
+        }
+    }
+
+    if (info.contains("properties") && info["properties"].is_object()) {
+        const auto& props = info["properties"];
+        for (auto it = props.begin(); it != props.end(); ++it) {
+            if (it.key().rfind("concernedStop", 0) == 0 && it->is_string()) {
+                stops.push_back(it->get<std::string>());
+            }
+        }
+    }
+
+    std::sort(stops.begin(), stops.end());
+    stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+    return stops;
+}
+
+// --- Helper: Alert → Notification Objects (one per info link) ---
+static std::string alertIdOf(const json& info) {
+    return info.contains("id") && info["id"].is_string() ? info["id"].get<std::string>() : "";
+}
+
+static void appendAlertNotifications(json& notifications, const json& info, const std::string& alertId) {
+    std::string priority = info.contains("priority") && info["priority"].is_string()
+        ? info["priority"].get<std::string>() : "";
+
+    std::string providerCode;
+    if (info.contains("properties") && info["properties"].is_object() &&
+        info["properties"].contains("providerCode") && info["properties"]["providerCode"].is_string()) {
+        providerCode = info["properties"]["providerCode"].get<std::string>();
+    }
+
+    if (!info.contains("infoLinks") || !info["infoLinks"].is_array()) return;
+
+    for (const auto& link : info["infoLinks"]) {
+        json notif;
+        notif["id"] = alertId;
+        notif["urlText"] = link.contains("urlText") && link["urlText"].is_string()
+            ? link["urlText"].get<std::string>() : "";
+        notif["content"] = link.contains("content") && link["content"].is_string()
+            ? link["content"].get<std::string>() : "";
+        notif["subtitle"] = link.contains("subtitle") && link["subtitle"].is_string()
+            ? link["subtitle"].get<std::string>() : "";
+        notif["providerCode"] = providerCode;
+        notif["priority"] = priority;
+        notifications.push_back(notif);
+    }
+}
+
 // --- Helper: Fetch Notifications from Provider ---
-static json fetchNotificationsFromProvider(const std::string& baseUrl, const std::string& stopId) {
+struct ProviderResponse {
+    json body = json::object();
+    std::string status = "error";
+};
+
+// An empty stopId requests the provider's full current-alert set, a background
+// pull that yields the host's request budget to client requests.
+static ProviderResponse fetchNotificationsFromProvider(const std::string& baseUrl, const std::string& stopId) {
+    ProviderResponse result;
     std::string url = baseUrl + "XML_ADDINFO_REQUEST";
-    cpr::Response r = cpr::Get(
-        cpr::Url{url},
-        cpr::Parameters{
-            {"commonMacro", "addinfo"},
-            {"outputFormat", "rapidJSON"},
-            {"filterPublished", "1"},
-            {"filterValid", "1"},
-            {"filterShowLineList", "0"},
-            {"filterShowPlaceList", "0"},
-            {"itdLPxx_selStop", stopId}
-        },
-        cpr::Timeout{UPSTREAM_TIMEOUT_SECONDS * 1000}
-    );
+    cpr::Parameters params{
+        {"commonMacro", "addinfo"},
+        {"outputFormat", "rapidJSON"},
+        {"filterPublished", "1"},
+        {"filterValid", "1"},
+        {"filterShowLineList", "0"},
+        {"filterShowPlaceList", "0"}
+    };
+    if (!stopId.empty()) params.Add({"itdLPxx_selStop", stopId});
+
+    long timeoutMs = stopId.empty() ? UPSTREAM_TIMEOUT_SECONDS * 1000 : NOTIFICATION_DEADLINE_MS;
+    UpstreamResponse r = upstreamGet(url, params, timeoutMs, stopId.empty() ? makeUpstreamPriority(0) : nullptr);
 
     if (r.status_code != 200) {
-        return json::object();
+        if (r.timedOut()) result.status = "timeout";
+        else if (r.circuitOpen) result.status = "circuit_open";
+        else if (r.throttled) result.status = "throttled";
+        return result;
     }
 
     try {
-        return json::parse(r.text);
+        static const MetricHistogram parseLatency = jsonParseHistogram("notifications");
+        MetricTimer timer(parseLatency);
+        result.body = json::parse(r.text);
+        result.status = "ok";
     } catch (...) {
-        return json::object();
+        result.body = json::object();
     }
+    return result;
+}
+
+// --- Helper: Provider Fan-out Pool ---
+// Providers are queried concurrently; a slow one only costs its own slot.
+static ThreadPool& notificationPool() {
+    static ThreadPool pool(NOTIFICATION_FANOUT_THREADS);
+    return pool;
 }
 
 // --- Helper: Extract Valid Notifications for a Stop ---
 
-json extractValidNotifications(const std::string& stopId) {
+json extractValidNotifications(const std::string& stopId, std::vector<NotificationProviderStatus>* statuses) {
     json notifications = json::array();
     std::set<std::string> seenIds;
 
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + std::chrono::milliseconds(NOTIFICATION_DEADLINE_MS);
+
+    std::vector<std::future<ProviderResponse>> pending;
+    pending.reserve(NOTIFICATION_API_PROVIDERS.size());
     for (const auto& providerUrl : NOTIFICATION_API_PROVIDERS) {
-        json response = fetchNotificationsFromProvider(providerUrl, stopId);
+        pending.push_back(notificationPool().submit([providerUrl, stopId] {
+            return fetchNotificationsFromProvider(providerUrl, stopId);
+        }));
+    }
+
+    // Merge in provider order so the dedup keeps the same winner as before
+    for (size_t p = 0; p < pending.size(); ++p) {
+        NotificationProviderStatus providerStatus;
+        providerStatus.provider = upstreamHostOf(NOTIFICATION_API_PROVIDERS[p]);
+
+        json response = json::object();
+        if (pending[p].wait_until(deadline) == std::future_status::ready) {
+            ProviderResponse fetched = pending[p].get();
+            providerStatus.status = fetched.status;
+            response = std::move(fetched.body);
+        } else {
+            providerStatus.status = "timeout";  // Left to finish in the background
+        }
+        providerStatus.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        if (statuses) statuses->push_back(providerStatus);
 
         if (!response.contains("infos") || !response["infos"].is_object()) continue;
         if (!response["infos"].contains("current") || !response["infos"]["current"].is_array()) continue;
-
         for (const auto& info : response["infos"]["current"]) {
             if (!isStopAffected(info, stopId)) continue;
 
-            std::string alertId = info.contains("id") && info["id"].is_string()
-                ? info["id"].get<std::string>() : "";
+            std::string alertId = alertIdOf(info);
 
             // Skip duplicate alerts across providers
             if (!alertId.empty() && seenIds.find(alertId) != seenIds.end()) continue;
             if (!alertId.empty()) seenIds.insert(alertId);
 
-            std::string priority = info.contains("priority") && info["priority"].is_string()
-                ? info["priority"].get<std::string>() : "";
+            appendAlertNotifications(notifications, info, alertId);
+        }
+    }
 
-            std::string providerCode;
-            if (info.contains("properties") && info["properties"].is_object() &&
-                info["properties"].contains("providerCode") && info["properties"]["providerCode"].is_string()) {
-                providerCode = info["properties"]["providerCode"].get<std::string>();
-            }
+    return notifications;
+}
 
-            if (!info.contains("infoLinks") || !info["infoLinks"].is_array()) continue;
-
-            for (const auto& link : info["infoLinks"]) {
-                json notif;
-                notif["id"] = alertId;
-                notif["urlText"] = link.contains("urlText") && link["urlText"].is_string()
-                    ? link["urlText"].get<std::string>() : "";
-                notif["content"] = link.contains("content") && link["content"].is_string()
-                    ? link["content"].get<std::string>() : "";
-                notif["subtitle"] = link.contains("subtitle") && link["subtitle"].is_string()
-                    ? link["subtitle"].get<std::string>() : "";
-                notif["providerCode"] = providerCode;
-                notif["priority"] = priority;
-                notifications.push_back(notif);
-            }
+// --- Provider-wide Alert Index ---
+// Each pull parses the providers' full current-alert sets once into an
+// inverted index (stop ID / global ID -> alerts). Lookups then cost one hash
+// probe plus the alerts that actually concern the stop.
+struct IndexedAlert {
+    std::string id;
+    std::vector<std::string> stops;
+    std::vector<ValidityWindow> validity;
+    json notifications = json::array();  // Pre-built objects, one per info link
+};
+
+using ProviderAlerts = std::shared_ptr<const std::vector<IndexedAlert>>;
+
+struct NotificationIndex {
+    std::vector<ProviderAlerts> providerAlerts;  // Same order as NOTIFICATION_API_PROVIDERS
+    // Points into providerAlerts, in provider order, so lookups dedup like the live path
+    std::unordered_map<std::string, std::vector<const IndexedAlert*>> byStop;
+    std::vector<NotificationProviderStatus> providers;
+};
+
+static std::shared_ptr<const NotificationIndex> current_index;  // Accessed with std::atomic_load/store
+
+static std::mutex indexer_mutex;
+static std::condition_variable indexer_cv;
+static std::thread indexer_thread;
+static bool indexer_stopping = false;
+static int index_refresh_seconds = 0;
+
+static ProviderAlerts parseProviderAlerts(const json& body) {
+    auto alerts = std::make_shared<std::vector<IndexedAlert>>();
+    for (const auto& info : body["infos"]["current"]) {
+        IndexedAlert alert;
+        alert.stops = collectAffectedStops(info);
+        if (alert.stops.empty()) continue;
+        alert.id = alertIdOf(info);
+        if (info.contains("validity")) alert.validity = parseValidityWindows(info["validity"]);
+        appendAlertNotifications(alert.notifications, info, alert.id);
+        alerts->push_back(std::move(alert));
+    }
+    return alerts;
+}
+
+static std::shared_ptr<const NotificationIndex> buildNotificationIndex(
+        const std::shared_ptr<const NotificationIndex>& previous) {
+    auto index = std::make_shared<NotificationIndex>();
+    auto started = std::chrono::steady_clock::now();
+
+    std::vector<std::future<ProviderResponse>> pending;
+    for (const auto& providerUrl : NOTIFICATION_API_PROVIDERS) {
+        pending.push_back(notificationPool().submit([providerUrl] {
+            return fetchNotificationsFromProvider(providerUrl, "");
+        }));
+    }
+
+    for (size_t p = 0; p < pending.size(); ++p) {
+        ProviderResponse response = pending[p].get();
+
+        NotificationProviderStatus providerStatus;
+        providerStatus.provider = upstreamHostOf(NOTIFICATION_API_PROVIDERS[p]);
+        providerStatus.status = response.status;
+        providerStatus.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        index->providers.push_back(providerStatus);
+
+        const json& body = response.body;
+        bool hasAlerts = body.contains("infos") && body["infos"].is_object() &&
+                         body["infos"].contains("current") && body["infos"]["current"].is_array();
+
+        if (hasAlerts) {
+            index->providerAlerts.push_back(parseProviderAlerts(body));
+        } else if (previous && p < previous->providerAlerts.size()) {
+            // Keep serving this provider's alerts from the last good pull
+            index->providerAlerts.push_back(previous->providerAlerts[p]);
+        } else {
+            index->providerAlerts.push_back(std::make_shared<std::vector<IndexedAlert>>());
         }
     }
 
+    for (const auto& alerts : index->providerAlerts) {
+        for (const auto& alert : *alerts) {
+            for (const auto& stopId : alert.stops) index->byStop[stopId].push_back(&alert);
+        }
+    }
+    return index;
+}
+
+static json lookupNotifications(const NotificationIndex& index, const std::string& stopId) {
+    json notifications = json::array();
+    auto it = index.byStop.find(stopId);
+    if (it == index.byStop.end()) return notifications;
+
+    std::set<std::string> seenIds;
+    auto now = std::time(nullptr);
+    for (const IndexedAlert* alert : it->second) {
+        if (!isCurrentlyValid(alert->validity, now)) continue;
+
+        // Skip duplicate alerts across providers
+        if (!alert->id.empty() && !seenIds.insert(alert->id).second) continue;
+
+        for (const auto& notif : alert->notifications) notifications.push_back(notif);
+    }
     return notifications;
 }
+
+static void runNotificationIndexer() {
+    for (;;) {
+        // Published even when every provider failed: requests are then answered
+        // with no alerts and the failed statuses instead of falling back to
+        // blocking per-request fetches, until a later pull succeeds.
+        auto previous = std::atomic_load(&current_index);
+        std::atomic_store(&current_index, buildNotificationIndex(previous));
+        // Per-stop bodies were built from the old index
+        notificationCache().clear();
+
+        std::unique_lock<std::mutex> lock(indexer_mutex);
+        indexer_cv.wait_for(lock, std::chrono::seconds(index_refresh_seconds), [] { return indexer_stopping; });
+        if (indexer_stopping) return;
+    }
+}
+
+void startNotificationIndexer(int refreshSeconds) {
+    if (refreshSeconds <= 0 || indexer_thread.joinable()) return;
+    index_refresh_seconds = refreshSeconds;
+    indexer_thread = std::thread(runNotificationIndexer);
+    std::cout << "Notification index enabled (refresh every " << refreshSeconds << "s)." << std::endl;
+}
+
+void stopNotificationIndexer() {
+    {
+        std::lock_guard<std::mutex> lock(indexer_mutex);
+        indexer_stopping = true;
+    }
+    indexer_cv.notify_all();
+    if (indexer_thread.joinable()) indexer_thread.join();
+}
+
+size_t getIndexedNotificationStops() {
+    auto index = std::atomic_load(&current_index);
+    return index ? index->byStop.size() : 0;
+}
+
+// --- Persistent Cache Tier ---
+// Payload: {"body": "<serialized alerts>", "providers": [[provider, status, elapsedMs], ...]}
+void registerNotificationCacheSnapshot() {
+    registerPersistentCache("notifications", [](const SnapshotWriter& write) {
+        std::vector<std::pair<std::string, NotificationCache::Entry>> entries;
+        notificationCache().forEach([&entries](const std::string& stopId, const NotificationCache::Entry& entry) {
+            entries.emplace_back(stopId, entry);
+        });
+        for (const auto& [stopId, entry] : entries) {
+            json providers = json::array();
+            for (const auto& p : entry.value->providers) providers.push_back({p.provider, p.status, p.elapsedMs});
+            json payload = {{"body", entry.value->body->data}, {"providers", providers}};
+            write(stopId, payload.dump(), toWallClock(entry.timestamp), notificationCache().maxAge());
+        }
+    });
+}
+
+// --- Notification Cache + Fetch ---
+static NotificationsResultPtr loadPersistedNotifications(const std::string& stopId) {
+    auto persisted = lookupPersistent("notifications", stopId);
+    if (!persisted) return nullptr;
+    json payload = json::parse(persisted->payload, nullptr, false);
+    if (!payload.is_object()) return nullptr;
+
+    auto result = std::make_shared<NotificationsResult>();
+    try {
+        result->body = makeCachedBody(payload.at("body").get<std::string>());
+        for (const auto& p : payload.at("providers")) {
+            result->providers.push_back({p.at(0).get<std::string>(), p.at(1).get<std::string>(), p.at(2).get<long long>()});
+        }
+    } catch (const json::exception&) {
+        return nullptr;
+    }
+    notificationCache().put(stopId, result, toSteadyClock(persisted->storedAt));
+    return result;
+}
+
+NotificationsResultPtr getNotifications(const std::string& stopId) {
+    auto index = std::atomic_load(&current_index);
+    {
+        TraceSpanTimer span("cache_lookup");
+        if (auto entry = notificationCache().get(stopId)) return entry->value;
+        // Until the first index pull lands, earlier results from the snapshot file
+        if (!index) {
+            if (auto persisted = loadPersistedNotifications(stopId)) return persisted;
+        }
+    }
+
+    auto result = std::make_shared<NotificationsResult>();
+    if (index) {
+        TraceSpanTimer span("notification_index");
+        result->body = makeCachedBody(lookupNotifications(*index, stopId).dump());
+        result->providers = index->providers;
+        notificationCache().put(stopId, result);
+        return result;
+    }
+
+    // No index yet (or disabled): query the providers for this stop, on this worker
+    AdmissionSlot slot(AdmissionLane::Blocking);
+    if (!slot) return nullptr;
+    TraceSpanTimer span("upstream");
+    result->body = makeCachedBody(extractValidNotifications(stopId, &result->providers).dump());
+
+    // Don't pin an empty result for the whole TTL when every provider failed
+    bool anyProviderOk = std::any_of(result->providers.begin(), result->providers.end(),
+                                     [](const auto& p) { return p.status == "ok"; });
+    if (anyProviderOk) notificationCache().put(stopId, result);
+    return result;
+}
+
+std::string formatProviderStatus(const std::vector<NotificationProviderStatus>& providers) {
+    std::string header;
+    for (const auto& p : providers) {
+        if (!header.empty()) header += ", ";
+        header += p.provider + "=" + p.status + ";dur=" + std::to_string(p.elapsedMs);
+    }
+    return header;
+}
+
+std::vector<CacheShardStats> getNotificationCacheStats() {
+    return notificationCache().stats();
+}
@@ -1,6 +1,32 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 #include "../config/config.h"
+#include "../cache/cached_body.h"
+#include "../cache/sharded_cache.h"
 
-json extractValidNotifications(const std::string& stopId);
+struct NotificationProviderStatus {
+    std::string provider;  // Provider host, e.g. "efa.vrr.de"
+    std::string status;    // "ok", "error", "timeout" or "circuit_open"
+    long long elapsedMs = 0;
+};
+
+struct NotificationsResult {
+    CachedBodyPtr body;
+    std::vector<NotificationProviderStatus> providers;
+};
+
+using NotificationsResultPtr = std::shared_ptr<const NotificationsResult>;
+
+bool isStopAffected(const json& info, const std::string& stopId);
+json extractValidNotifications(const std::string& stopId, std::vector<NotificationProviderStatus>* statuses = nullptr);
+// nullptr when the provider query was shed by admission control (503).
+NotificationsResultPtr getNotifications(const std::string& stopId);
+std::string formatProviderStatus(const std::vector<NotificationProviderStatus>& providers);
+std::vector<CacheShardStats> getNotificationCacheStats();
+void registerNotificationCacheSnapshot();
+void startNotificationIndexer(int refreshSeconds);
+void stopNotificationIndexer();
+size_t getIndexedNotificationStops();
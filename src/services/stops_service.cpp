@@ -1,5 +1,26 @@
 #include "stops_service.h"
-#include <cpr/cpr.h>
+#include "../cache/snapshot_store.h"
+#include "../http/admission.h"
+#include "../http/upstream_client.h"
+#include "../metrics/metrics.h"
+#include "../metrics/tracing.h"
+#include "../search/spatial_index.h"
+#include "../search/stop_index.h"
+#include "../util/thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// --- Search Result Cache (serialized upstream responses keyed by query) ---
+using SearchCache = ShardedCache<CachedBodyPtr>;
+
+static SearchCache& searchCache() {
+    static SearchCache cache(MAX_SEARCH_CACHE_ENTRIES, std::chrono::seconds(SEARCH_CACHE_TTL_SECONDS));
+    return cache;
+}
 
 // --- Helper: MOT (Mode of Transport) Parsing ---
 
@@ -157,7 +178,7 @@ std::optional<StopRecord> parseStopRecord(const json& stop) {
         *stopId,
         localId,
         *stopName,
-        city.value_or(""),
+        city,
         buildMotArray(stop),
         latitude,
         longitude
@@ -202,7 +223,256 @@ std::vector<StopRecord> extractStopRecords(const json& searchResult) {
     return records;
 }
 
-// --- Helper: Database Persistence ---
+// --- Background Stop Writer ---
+// Search handlers only enqueue records; a single writer thread coalesces them
+// and upserts each batch with one multi-row statement inside one transaction.
+// Stops written recently with identical fields are skipped entirely.
+
+struct PendingStop {
+    StopRecord record;
+    std::string originalSearch;
+};
+
+struct RecentStopWrite {
+    uint64_t fingerprint;
+    std::chrono::steady_clock::time_point writtenAt;
+};
+
+static std::mutex stop_writer_mutex;
+static std::condition_variable stop_writer_cv;
+static std::vector<PendingStop> pending_stops;
+static std::unordered_map<std::string, size_t> pending_index;  // stop_id -> slot in pending_stops
+static std::unordered_map<std::string, RecentStopWrite> recent_stop_writes;
+static const Database* stop_writer_db = nullptr;
+static std::thread stop_writer_thread;
+static bool stop_writer_stop = false;
+
+static uint64_t stopFingerprint(const StopRecord& record) {
+    std::string key = record.stop_id;
+    key += '\x1f'; key += record.local_id.value_or("");
+    key += '\x1f'; key += record.stop_name;
+    key += '\x1f'; key += record.city.value_or("");
+    key += '\x1f'; key += record.mot_array.value_or("");
+    key += '\x1f'; key += formatDouble(record.latitude);
+    key += '\x1f'; key += formatDouble(record.longitude);
+    return fnv1a64(key);
+}
+
+// --- Helper: Recent-write Bookkeeping (stop_writer_mutex held) ---
+static bool writtenRecently(const StopRecord& record, std::chrono::steady_clock::time_point now) {
+    auto it = recent_stop_writes.find(record.stop_id);
+    if (it == recent_stop_writes.end()) return false;
+    if (now - it->second.writtenAt >= std::chrono::seconds(STOP_WRITE_DEDUPE_SECONDS)) return false;
+    return it->second.fingerprint == stopFingerprint(record);
+}
+
+static void rememberWrites(const std::vector<PendingStop>& batch) {
+    auto now = std::chrono::steady_clock::now();
+    if (recent_stop_writes.size() + batch.size() > MAX_RECENT_STOP_WRITES) {
+        for (auto it = recent_stop_writes.begin(); it != recent_stop_writes.end(); ) {
+            if (now - it->second.writtenAt >= std::chrono::seconds(STOP_WRITE_DEDUPE_SECONDS)) {
+                it = recent_stop_writes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (recent_stop_writes.size() + batch.size() > MAX_RECENT_STOP_WRITES) recent_stop_writes.clear();
+    }
+    for (const auto& pending : batch) {
+        recent_stop_writes[pending.record.stop_id] = {stopFingerprint(pending.record), now};
+    }
+}
+
+static bool execSimple(PGconn* conn, const char* sql) {
+    PGresult* res = PQexec(conn, sql);
+    bool ok = res && PQresultStatus(res) == PGRES_COMMAND_OK;
+    if (!ok) std::cerr << "Stop writer: " << sql << " failed: " << PQerrorMessage(conn) << std::endl;
+    if (res) PQclear(res);
+    return ok;
+}
+
+// --- Helper: Batched Upsert (one statement per STOP_WRITE_BATCH_SIZE rows, one transaction) ---
+static bool writeStopBatch(const std::vector<PendingStop>& batch, const Database& db) {
+    if (batch.empty()) return true;
+
+    PooledConnection pooled = db.acquire();
+    if (!pooled) {
+        std::cerr << "Database connection unavailable; dropping " << batch.size() << " stop writes" << std::endl;
+        return false;
+    }
+    PGconn* conn = pooled.get();
+
+    if (!execSimple(conn, "BEGIN")) return false;
+
+    constexpr int COLUMNS = 8;
+    for (size_t offset = 0; offset < batch.size(); offset += STOP_WRITE_BATCH_SIZE) {
+        size_t count = std::min(STOP_WRITE_BATCH_SIZE, batch.size() - offset);
+
+        std::string sql =
+            "INSERT INTO stops (stop_id, local_id, stop_name, city, mot, location, original_search) VALUES ";
+        std::vector<std::string> coordinates;
+        std::vector<const char*> values;
+        coordinates.reserve(count * 2);  // Never reallocates, so c_str() pointers stay valid
+        values.reserve(count * COLUMNS);
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto& record = batch[offset + i].record;
+            const auto& originalSearch = batch[offset + i].originalSearch;
+            int p = static_cast<int>(i) * COLUMNS;
+            if (i > 0) sql += ", ";
+            sql += "($" + std::to_string(p + 1) + ", $" + std::to_string(p + 2) +
+                   ", $" + std::to_string(p + 3) + ", $" + std::to_string(p + 4) +
+                   ", $" + std::to_string(p + 5) +
+                   ", ST_SetSRID(ST_MakePoint($" + std::to_string(p + 6) + "::float8, $" +
+                   std::to_string(p + 7) + "::float8), 4326)::geography, $" + std::to_string(p + 8) + ")";
+
+            coordinates.push_back(formatDouble(record.longitude));
+            coordinates.push_back(formatDouble(record.latitude));
+            values.push_back(record.stop_id.c_str());
+            values.push_back(record.local_id ? record.local_id->c_str() : nullptr);
+            values.push_back(record.stop_name.c_str());
+            values.push_back(record.city && !record.city->empty() ? record.city->c_str() : nullptr);
+            values.push_back(record.mot_array ? record.mot_array->c_str() : nullptr);
+            values.push_back(coordinates[coordinates.size() - 2].c_str());
+            values.push_back(coordinates.back().c_str());
+            values.push_back(originalSearch.empty() ? nullptr : originalSearch.c_str());
+        }
+
+        sql +=
+            " ON CONFLICT (stop_id) DO UPDATE SET "
+            "local_id = COALESCE(EXCLUDED.local_id, stops.local_id), "
+            "stop_name = EXCLUDED.stop_name, "
+            "city = COALESCE(EXCLUDED.city, stops.city), "
+            "mot = COALESCE(EXCLUDED.mot, stops.mot), "
+            "location = EXCLUDED.location, "
+            "original_search = COALESCE(EXCLUDED.original_search, stops.original_search), "
+            "last_updated = NOW();";
+
+        static const MetricHistogram upsertLatency = dbQueryHistogram("stop_upsert");
+        auto queryStart = std::chrono::steady_clock::now();
+        PGresult* res = PQexecParams(conn, sql.c_str(), static_cast<int>(values.size()), nullptr,
+                                     values.data(), nullptr, nullptr, 0);
+        upsertLatency.observe(std::chrono::steady_clock::now() - queryStart);
+        bool ok = res && PQresultStatus(res) == PGRES_COMMAND_OK;
+        if (!ok) {
+            std::cerr << "Failed to upsert " << count << " stops: " << PQerrorMessage(conn) << std::endl;
+        }
+        if (res) PQclear(res);
+        if (!ok) {
+            execSimple(conn, "ROLLBACK");
+            return false;
+        }
+    }
+
+    if (!execSimple(conn, "COMMIT")) return false;
+
+    std::vector<StopRecord> records;
+    records.reserve(batch.size());
+    for (const auto& pending : batch) records.push_back(pending.record);
+    indexStops(records);
+    indexStopLocations(records);
+    return true;
+}
+
+static void flushPendingStops(std::unique_lock<std::mutex>& lock) {
+    std::vector<PendingStop> batch;
+    batch.swap(pending_stops);
+    pending_index.clear();
+    const Database* db = stop_writer_db;
+
+    lock.unlock();
+    bool ok = db && writeStopBatch(batch, *db);
+    lock.lock();
+
+    if (ok) rememberWrites(batch);
+}
+
+static void runStopWriter() {
+    std::unique_lock<std::mutex> lock(stop_writer_mutex);
+    while (!stop_writer_stop) {
+        stop_writer_cv.wait_for(lock, std::chrono::milliseconds(STOP_WRITE_FLUSH_MS), [] {
+            return stop_writer_stop || pending_stops.size() >= STOP_WRITE_BATCH_SIZE;
+        });
+        if (!pending_stops.empty()) flushPendingStops(lock);
+    }
+    if (!pending_stops.empty()) flushPendingStops(lock);
+}
+
+void startStopWriter(const Database& db) {
+    std::lock_guard<std::mutex> lock(stop_writer_mutex);
+    if (stop_writer_thread.joinable() || !db.hasConfig()) return;
+    stop_writer_db = &db;
+    stop_writer_stop = false;
+    stop_writer_thread = std::thread(runStopWriter);
+}
+
+void stopStopWriter() {
+    {
+        std::lock_guard<std::mutex> lock(stop_writer_mutex);
+        stop_writer_stop = true;
+    }
+    stop_writer_cv.notify_all();
+    if (stop_writer_thread.joinable()) stop_writer_thread.join();
+}
+
+// --- Local Index Loading ---
+bool loadStopIndexes(const Database& db) {
+    if (!db.hasConfig()) return false;
+
+    PooledConnection pooled = db.acquire();
+    if (!pooled) {
+        std::cerr << "Database connection unavailable; local stop indexes start empty" << std::endl;
+        return false;
+    }
+    PGconn* conn = pooled.get();
+
+    const char* loadSql =
+        "SELECT stop_id, local_id, stop_name, city, mot::text, "
+        "ST_Y(location::geometry), ST_X(location::geometry), original_search "
+        "FROM stops;";
+    static const MetricHistogram loadLatency = dbQueryHistogram("stop_index_load");
+    auto queryStart = std::chrono::steady_clock::now();
+    PGresult* res = PQexec(conn, loadSql);
+    loadLatency.observe(std::chrono::steady_clock::now() - queryStart);
+    if (!res || PQresultStatus(res) != PGRES_TUPLES_OK) {
+        std::cerr << "Failed to load stops for local indexes: " << PQerrorMessage(conn) << std::endl;
+        if (res) PQclear(res);
+        return false;
+    }
+
+    std::vector<StopRecord> records;
+    std::vector<std::string> queries;
+    int rows = PQntuples(res);
+    records.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        StopRecord record;
+        record.stop_id = PQgetvalue(res, i, 0);
+        if (!PQgetisnull(res, i, 1)) record.local_id = std::string(PQgetvalue(res, i, 1));
+        record.stop_name = PQgetvalue(res, i, 2);
+        if (!PQgetisnull(res, i, 3)) record.city = std::string(PQgetvalue(res, i, 3));
+        if (!PQgetisnull(res, i, 4)) record.mot_array = std::string(PQgetvalue(res, i, 4));
+        try {
+            record.latitude = std::stod(PQgetvalue(res, i, 5));
+            record.longitude = std::stod(PQgetvalue(res, i, 6));
+        } catch (...) {
+            continue;
+        }
+        if (!PQgetisnull(res, i, 7)) queries.push_back(normalizeSearchText(PQgetvalue(res, i, 7)));
+        records.push_back(std::move(record));
+    }
+    PQclear(res);
+
+    // The text and spatial indexes are independent; build them side by side
+    std::thread spatialBuild([&records] { replaceStopLocations(records); });
+    indexStops(records);
+    for (const auto& query : queries) rememberSearchQuery(query);
+    spatialBuild.join();
+    std::cout << "Local stop indexes loaded: " << records.size() << " stops" << std::endl;
+    return true;
+}
+
+
+// --- Helper: Database Persistence (enqueue only; never blocks on PostgreSQL) ---
 
 void ensureStopsInDatabase(const json& searchResult, const std::string& originalSearch, const Database& db) {
     if (!db.hasConfig()) return;
@@ -210,98 +480,160 @@ void ensureStopsInDatabase(const json& searchResult, const std::string& original
     auto records = extractStopRecords(searchResult);
     if (records.empty()) return;
 
-    PGconn* conn = db.connect();
-    if (!conn) {
-        std::cerr << "Database connection returned null" << std::endl;
-        return;
-    }
-    if (PQstatus(conn) != CONNECTION_OK) {
-        std::cerr << "Database connection failed: " << PQerrorMessage(conn) << std::endl;
-        PQfinish(conn);
+    std::unique_lock<std::mutex> lock(stop_writer_mutex);
+    if (!stop_writer_thread.joinable()) {
+        // Writer not running (e.g. during shutdown): fall back to a direct batched write
+        std::vector<PendingStop> batch;
+        for (auto& record : records) batch.push_back({std::move(record), originalSearch});
+        lock.unlock();
+        writeStopBatch(batch, db);
         return;
     }
 
-    const char* insertSql =
-        "INSERT INTO stops (stop_id, local_id, stop_name, city, mot, location, original_search) "
-        "VALUES ($1, $2, $3, $4, $5, ST_SetSRID(ST_MakePoint($6, $7), 4326)::geography, $8) "
-        "ON CONFLICT (stop_id) DO UPDATE SET "
-        "local_id = COALESCE(EXCLUDED.local_id, stops.local_id), "
-        "stop_name = EXCLUDED.stop_name, "
-        "city = COALESCE(EXCLUDED.city, stops.city), "
-        "mot = COALESCE(EXCLUDED.mot, stops.mot), "
-        "location = EXCLUDED.location, "
-        "original_search = COALESCE(EXCLUDED.original_search, stops.original_search), "
-        "last_updated = NOW();";
-
-    for (const auto& record : records) {
-        std::string longitudeText = formatDouble(record.longitude);
-        std::string latitudeText = formatDouble(record.latitude);
-
-        const char* values[8];
-        values[0] = record.stop_id.c_str();
-        values[1] = record.local_id ? record.local_id->c_str() : nullptr;
-        values[2] = record.stop_name.c_str();
-        values[3] = record.city.empty() ? nullptr : record.city.c_str();
-        values[4] = record.mot_array ? record.mot_array->c_str() : nullptr;
-        values[5] = longitudeText.c_str();
-        values[6] = latitudeText.c_str();
-        values[7] = originalSearch.empty() ? nullptr : originalSearch.c_str();
-
-        PGresult* res = PQexecParams(conn, insertSql, 8, nullptr, values, nullptr, nullptr, 0);
-        if (!res) {
-            std::cerr << "Failed to execute insert for stop " << record.stop_id
-                      << ": PQexecParams returned null" << std::endl;
+    auto now = std::chrono::steady_clock::now();
+    size_t dropped = 0;
+    for (auto& record : records) {
+        if (writtenRecently(record, now)) continue;
+
+        // Within a batch the latest search wins; ON CONFLICT cannot touch one row twice
+        auto it = pending_index.find(record.stop_id);
+        if (it != pending_index.end()) {
+            pending_stops[it->second] = {std::move(record), originalSearch};
             continue;
         }
-        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-            std::cerr << "Failed to insert stop " << record.stop_id << ": "
-                      << PQerrorMessage(conn) << std::endl;
+        if (pending_stops.size() >= STOP_WRITE_QUEUE_LIMIT) {
+            ++dropped;
+            continue;
         }
-        PQclear(res);
+        pending_index.emplace(record.stop_id, pending_stops.size());
+        pending_stops.push_back({std::move(record), originalSearch});
     }
+    bool full = pending_stops.size() >= STOP_WRITE_BATCH_SIZE;
+    lock.unlock();
 
-    PQfinish(conn);
+    if (dropped > 0) std::cerr << "Stop write queue full; dropped " << dropped << " stops" << std::endl;
+    if (full) stop_writer_cv.notify_one();
 }
 
 // --- Helper: Search Stops ---
 
-json searchStopsProvider(const std::string& query, const std::string& /*city*/, bool /*includeLocation*/) {
-    if (query.empty()) return json::array();
-
-    cpr::Parameters params{
+static cpr::Parameters stopFinderParams(const std::string& query) {
+    return cpr::Parameters{
             {"outputFormat", "rapidJSON"},
             {"type_sf", "any"},
             {"name_sf", query},
             {"anyObjFilter_sf", "2"},                  // Stops/stations only
             {"coordOutputFormat", "WGS84[dd.ddddd]"}   // Decimal degree coordinates
     };
+}
 
-    cpr::Response r = cpr::Get(
-        cpr::Url{Provider_SEARCH_URL},
-        params,
-        cpr::Timeout{UPSTREAM_TIMEOUT_SECONDS * 1000}
-    );
-
+static json parseStopFinderResponse(const UpstreamResponse& r) {
     if (r.status_code != 200) return {{"error", "Upstream Error"}};
 
     try {
+        static const MetricHistogram parseLatency = jsonParseHistogram("stop_search");
+        MetricTimer timer(parseLatency);
         return json::parse(r.text);
     } catch (...) {
         return {{"error", "Invalid JSON from Provider Search"}};
     }
 }
 
-json getNearbyStops(double latitude, double longitude, int maxDistanceMeters, int limit, const Database& db) {
-    if (!db.hasConfig()) return {{"error", "Database not configured"}};
+// --- Search Cache + Local Index + Fetch + Persist ---
+// The cache is keyed on the normalized query so "Marktplatz", "marktplatz " and
+// "MARKTPLATZ" share one entry. Confident local answers skip the upstream call;
+// stops are only persisted on upstream answers. Cached and local answers call
+// done inline, upstream answers from the upstream completion pool.
+void searchStops(const std::string& query, const std::string& /*city*/, bool /*includeLocation*/, const Database& db,
+                 SearchCallback done) {
+    std::string normalized = normalizeSearchText(query);
+    std::string cacheKey = normalized.empty() ? query : normalized;
+
+    CachedBodyPtr cached;
+    {
+        TraceSpanTimer span("cache_lookup");
+        if (auto entry = searchCache().get(cacheKey)) {
+            cached = entry->value;
+        } else if (auto persisted = lookupPersistent("search", cacheKey)) {
+            cached = makeCachedBody(std::move(persisted->payload));
+            searchCache().put(cacheKey, cached, toSteadyClock(persisted->storedAt));
+        }
+    }
+    if (cached) {
+        done(cached);
+        return;
+    }
 
-    PGconn* conn = db.connect();
-    if (!conn) return {{"error", "Database connection returned null"}};
+    if (!normalized.empty()) {
+        TraceSpanTimer span("search_local");
+        bool fuzzy = false;
+        if (auto local = searchStopsLocally(normalized, &fuzzy)) {
+            CachedBodyPtr body = makeCachedBody(local->dump());
+            // Typo matches are not cached, so stops indexed later are considered on the next request
+            if (!fuzzy) searchCache().put(cacheKey, body);
+            done(body);
+            return;
+        }
+    }
 
-    if (PQstatus(conn) != CONNECTION_OK) {
-        std::string message = PQerrorMessage(conn);
-        PQfinish(conn);
-        return {{"error", "Database connection failed: " + message}};
+    if (query.empty()) {
+        done(makeCachedBody(json::array().dump()));
+        return;
+    }
+
+    if (!tryAdmit(AdmissionLane::Upstream)) {
+        done(nullptr);
+        return;
     }
+    TracePtr trace = currentTrace();
+    uint64_t sentNs = trace ? monotonicNanos() : 0;
+    upstreamGetAsync(Provider_SEARCH_URL, stopFinderParams(query), UPSTREAM_TIMEOUT_SECONDS * 1000,
+                     [query, normalized, cacheKey, &db, trace, sentNs, done = std::move(done)](UpstreamResponse r) {
+        releaseAdmission(AdmissionLane::Upstream);
+        TraceScope scope(trace);
+        if (trace) trace->addSpan("upstream", sentNs, monotonicNanos());
+        json searchResult;
+        {
+            TraceSpanTimer span("parse");
+            searchResult = parseStopFinderResponse(r);
+        }
+        CachedBodyPtr body;
+        {
+            TraceSpanTimer span("serialize");
+            body = makeCachedBody(searchResult.dump());
+        }
+        bool hasError = searchResult.is_object() && searchResult.contains("error");
+        if (!hasError) {
+            rememberSearchQuery(normalized);
+            ensureStopsInDatabase(searchResult, query, db);
+            searchCache().put(cacheKey, body);
+        }
+        done(body);
+    });
+}
+
+std::vector<CacheShardStats> getSearchCacheStats() {
+    return searchCache().stats();
+}
+
+void registerSearchCacheSnapshot() {
+    registerPersistentCache("search", [](const SnapshotWriter& write) {
+        std::vector<std::pair<std::string, SearchCache::Entry>> entries;
+        searchCache().forEach([&entries](const std::string& key, const SearchCache::Entry& entry) {
+            entries.emplace_back(key, entry);
+        });
+        for (const auto& [key, entry] : entries) {
+            write(key, entry.value->data, toWallClock(entry.timestamp), searchCache().maxAge());
+        }
+    });
+}
+
+// --- Helper: PostGIS Nearby Query (fallback and consistency reference) ---
+static json queryNearbyStopsPostgis(double latitude, double longitude, int maxDistanceMeters, int limit, const Database& db) {
+    TraceSpanTimer span("db_query");
+    PooledConnection pooled = db.acquire();
+    if (!pooled) return {{"error", "Database connection unavailable"}};
+    PGconn* conn = pooled.get();
 
     std::string longitudeText = formatDouble(longitude);
     std::string latitudeText = formatDouble(latitude);
@@ -325,16 +657,17 @@ json getNearbyStops(double latitude, double longitude, int maxDistanceMeters, in
         "ORDER BY distance_meters ASC "
         "LIMIT $4;";
 
+    static const MetricHistogram nearbyLatency = dbQueryHistogram("nearby_stops");
+    auto queryStart = std::chrono::steady_clock::now();
     PGresult* res = PQexecParams(conn, nearbySql, 4, nullptr, queryParams, nullptr, nullptr, 0);
+    nearbyLatency.observe(std::chrono::steady_clock::now() - queryStart);
     if (!res) {
-        PQfinish(conn);
         return {{"error", "Failed to execute nearby stops query"}};
     }
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         std::string message = PQerrorMessage(conn);
         PQclear(res);
-        PQfinish(conn);
         return {{"error", "Nearby stops query failed: " + message}};
     }
 
@@ -365,6 +698,98 @@ json getNearbyStops(double latitude, double longitude, int maxDistanceMeters, in
     }
 
     PQclear(res);
-    PQfinish(conn);
     return nearbyStops;
 }
+
+// --- Nearby Stops (spatial index first, PostGIS fallback) ---
+// A sample of index answers is re-run against PostGIS off the request path.
+// Haversine (sphere) and PostGIS geography (spheroid) differ by a fraction of a
+// percent, so stops right at the radius or the limit cut-off are not compared.
+
+static std::atomic<uint64_t> nearby_index_answers{0};
+static std::atomic<uint64_t> nearby_postgis_answers{0};
+static std::atomic<uint64_t> nearby_consistency_checks{0};
+static std::atomic<uint64_t> nearby_consistency_mismatches{0};
+
+static std::mutex consistency_mutex;
+static std::unique_ptr<ThreadPool> consistency_pool;  // Present only between start/stop
+static std::atomic<long> nearby_consistency_sample{0};
+
+void startNearbyConsistencyChecks() {
+    std::lock_guard<std::mutex> lock(consistency_mutex);
+    long sample = getEnvLong("NEARBY_CONSISTENCY_SAMPLE", 100, 0, 1000000);
+    nearby_consistency_sample.store(sample);
+    if (sample > 0 && !consistency_pool) consistency_pool = std::make_unique<ThreadPool>(1);
+}
+
+void stopNearbyConsistencyChecks() {
+    std::unique_ptr<ThreadPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(consistency_mutex);
+        pool.swap(consistency_pool);
+    }
+    pool.reset();  // Drains queued checks while the Database is still alive
+}
+
+static std::vector<std::string> comparableStopIds(const json& stops, double boundary) {
+    std::vector<std::string> ids;
+    for (const auto& stop : stops) {
+        auto distance = jsonToDouble(stop.value("distance_meters", json()));
+        if (distance && *distance < boundary) ids.push_back(stop.value("stop_id", ""));
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static void checkNearbyConsistency(double latitude, double longitude, int maxDistanceMeters, int limit,
+                                   const json& indexed, const Database& db) {
+    json reference = queryNearbyStopsPostgis(latitude, longitude, maxDistanceMeters, limit, db);
+    if (!reference.is_array()) return;
+    nearby_consistency_checks.fetch_add(1, std::memory_order_relaxed);
+
+    double boundary = maxDistanceMeters * 0.995;
+    if (static_cast<int>(reference.size()) == limit && !reference.empty()) {
+        auto last = jsonToDouble(reference.back().value("distance_meters", json()));
+        if (last) boundary = std::min(boundary, *last * 0.995);
+    }
+
+    if (comparableStopIds(indexed, boundary) != comparableStopIds(reference, boundary)) {
+        nearby_consistency_mismatches.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Nearby index mismatch at " << formatDouble(latitude) << "," << formatDouble(longitude)
+                  << " (distance=" << maxDistanceMeters << ", limit=" << limit << "): index returned "
+                  << indexed.size() << " stops, PostGIS " << reference.size() << std::endl;
+    }
+}
+
+json getNearbyStops(double latitude, double longitude, int maxDistanceMeters, int limit, const Database& db) {
+    if (!db.hasConfig()) return {{"error", "Database not configured"}};
+
+    if (auto indexed = findNearbyStops(latitude, longitude, maxDistanceMeters, limit)) {
+        uint64_t answered = nearby_index_answers.fetch_add(1, std::memory_order_relaxed) + 1;
+        long sample = nearby_consistency_sample.load(std::memory_order_relaxed);
+        if (sample > 0 && answered % static_cast<uint64_t>(sample) == 0) {
+            std::lock_guard<std::mutex> lock(consistency_mutex);
+            if (consistency_pool) {
+                json copy = *indexed;
+                const Database* dbPtr = &db;
+                consistency_pool->post([=] {
+                    checkNearbyConsistency(latitude, longitude, maxDistanceMeters, limit, copy, *dbPtr);
+                });
+            }
+        }
+        return *indexed;
+    }
+
+    nearby_postgis_answers.fetch_add(1, std::memory_order_relaxed);
+    return queryNearbyStopsPostgis(latitude, longitude, maxDistanceMeters, limit, db);
+}
+
+NearbyStats getNearbyStats() {
+    NearbyStats stats;
+    stats.indexedStops = getSpatialIndexSize();
+    stats.indexAnswers = nearby_index_answers.load(std::memory_order_relaxed);
+    stats.postgisAnswers = nearby_postgis_answers.load(std::memory_order_relaxed);
+    stats.consistencyChecks = nearby_consistency_checks.load(std::memory_order_relaxed);
+    stats.consistencyMismatches = nearby_consistency_mismatches.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -2,24 +2,38 @@
 
 #include "../config/config.h"
 #include "../db/database.h"
+#include "../cache/cached_body.h"
+#include "../cache/sharded_cache.h"
+#include "../models/stop.h"
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <optional>
 #include <vector>
 
-struct StopRecord {
-    std::string stop_id;
-    std::optional<std::string> local_id;
-    std::string stop_name;
-    std::string city;
-    std::optional<std::string> mot_array;
-    double latitude;
-    double longitude;
-};
-
 std::optional<std::string> buildMotArray(const json& stop);
 bool extractCoordinates(const json& stop, double& lat, double& lon);
 std::optional<StopRecord> parseStopRecord(const json& stop);
 std::vector<StopRecord> extractStopRecords(const json& searchResult);
+struct NearbyStats {
+    size_t indexedStops = 0;
+    uint64_t indexAnswers = 0;
+    uint64_t postgisAnswers = 0;
+    uint64_t consistencyChecks = 0;
+    uint64_t consistencyMismatches = 0;
+};
+
+bool loadStopIndexes(const Database& db);
 void ensureStopsInDatabase(const json& searchResult, const std::string& originalSearch, const Database& db);
-json searchStopsProvider(const std::string& query, const std::string& city = "", bool includeLocation = false);
+void startStopWriter(const Database& db);
+void stopStopWriter();
+// nullptr when the search was shed by admission control (503).
+using SearchCallback = std::function<void(CachedBodyPtr)>;
+void searchStops(const std::string& query, const std::string& city, bool includeLocation, const Database& db,
+                 SearchCallback done);
+std::vector<CacheShardStats> getSearchCacheStats();
+void registerSearchCacheSnapshot();
 json getNearbyStops(double latitude, double longitude, int maxDistanceMeters, int limit, const Database& db);
+NearbyStats getNearbyStats();
+void startNearbyConsistencyChecks();
+void stopNearbyConsistencyChecks();
@@ -0,0 +1,288 @@
+#include "stream_service.h"
+#include "departures_service.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// --- Stream Registry (protected by stream_mutex) ---
+// A client subscribes to stops with one set of options. lastEtags holds the
+// ETag last sent per subscribed stop ("" until the first update).
+struct StreamClient {
+    StreamSink send;
+    bool detailed = false;
+    bool includeDelay = false;
+    std::map<std::string, std::string> lastEtags;
+};
+
+static std::mutex stream_mutex;
+static std::unordered_map<uint64_t, StreamClient> stream_clients;
+static std::unordered_map<std::string, size_t> stream_stop_refs;
+static uint64_t next_client_id = 1;
+static std::atomic<uint64_t> stream_pushes{0};
+static std::atomic<uint64_t> stream_ticks{0};
+
+static std::mutex publisher_mutex;
+static std::condition_variable publisher_cv;
+static std::thread publisher_thread;
+static bool publisher_stopping = false;
+
+static size_t variantIndex(bool detailed, bool includeDelay) {
+    return (detailed ? 2 : 0) + (includeDelay ? 1 : 0);
+}
+
+// --- Helper: Messages ---
+static std::string departuresMessage(const std::string& stopId, const CachedBody& body) {
+    std::string message = R"({"type":"departures","stop":)";
+    message += json(stopId).dump();
+    message += R"(,"etag":)";
+    message += json(body.etag).dump();
+    message += R"(,"departures":)";
+    message += body.data;
+    message += '}';
+    return message;
+}
+
+static std::string errorMessage(const std::optional<std::string>& stopId, const json& error) {
+    json message = {{"type", "error"}, {"error", error}};
+    if (stopId) message["stop"] = *stopId;
+    return message.dump();
+}
+
+// Caller holds stream_mutex.
+static void pushIfChanged(StreamClient& client, const std::string& stopId, const CachedBodyPtr& body) {
+    auto it = client.lastEtags.find(stopId);
+    if (!body || it == client.lastEtags.end() || it->second == body->etag) return;
+    it->second = body->etag;
+    client.send(departuresMessage(stopId, *body));
+    stream_pushes.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Caller holds stream_mutex. Watched stops are kept fresh by the departure refresher.
+static void retainStop(const std::string& stopId) {
+    if (stream_stop_refs[stopId]++ == 0) watchDepartureStop(stopId);
+}
+
+static void releaseStop(const std::string& stopId) {
+    auto it = stream_stop_refs.find(stopId);
+    if (it == stream_stop_refs.end()) return;
+    if (--it->second == 0) {
+        stream_stop_refs.erase(it);
+        unwatchDepartureStop(stopId);
+    }
+}
+
+uint64_t openStreamClient(StreamSink send) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (stream_clients.size() >= MAX_STREAM_CLIENTS) return 0;
+    uint64_t clientId = next_client_id++;
+    stream_clients[clientId].send = std::move(send);
+    return clientId;
+}
+
+void closeStreamClient(uint64_t clientId) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    auto it = stream_clients.find(clientId);
+    if (it == stream_clients.end()) return;
+    for (const auto& subscription : it->second.lastEtags) releaseStop(subscription.first);
+    stream_clients.erase(it);
+}
+
+// --- Helper: Initial Update ---
+// Sent as soon as the departures are available, through the same cache and
+// coalesced fetch as GET /api/stops/<stopId>.
+static void sendInitialDepartures(uint64_t clientId, const std::string& stopId, bool detailed, bool includeDelay) {
+    getDepartures(stopId, detailed, includeDelay, std::nullopt, std::nullopt,
+                  [clientId, stopId, detailed, includeDelay](DeparturesResult result) {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        auto it = stream_clients.find(clientId);
+        if (it == stream_clients.end()) return;
+        StreamClient& client = it->second;
+        if (client.detailed != detailed || client.includeDelay != includeDelay) return;  // Options changed since
+        if (result.error) {
+            if (client.lastEtags.count(stopId) > 0) client.send(errorMessage(stopId, *result.error));
+            return;
+        }
+        pushIfChanged(client, stopId, result.body);
+    });
+}
+
+static bool boolOption(const json& message, const char* key, bool fallback) {
+    if (!message.contains(key)) return fallback;
+    const auto& value = message.at(key);
+    return value.is_boolean() ? value.get<bool>() : fallback;
+}
+
+// --- Client Messages ---
+// {"action":"subscribe","stops":[...],"detailed":false,"delay":false}
+// {"action":"unsubscribe","stops":[...]}
+void handleStreamMessage(uint64_t clientId, const std::string& text) {
+    json message = json::parse(text, nullptr, false);
+    std::string action = (message.is_object() && message.contains("action") && message.at("action").is_string())
+        ? message.at("action").get<std::string>() : "";
+    bool hasStops = message.is_object() && message.contains("stops") && message.at("stops").is_array();
+
+    std::vector<std::string> stops;
+    bool validStops = hasStops;
+    if (hasStops) {
+        for (const auto& item : message.at("stops")) {
+            if (!item.is_string() || !isValidStopId(item.get<std::string>())) {
+                validStops = false;
+                break;
+            }
+            stops.push_back(item.get<std::string>());
+        }
+    }
+
+    std::vector<std::string> toFetch;
+    bool detailed = false;
+    bool includeDelay = false;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        auto it = stream_clients.find(clientId);
+        if (it == stream_clients.end()) return;
+        StreamClient& client = it->second;
+
+        if (action != "subscribe" && action != "unsubscribe") {
+            client.send(errorMessage(std::nullopt, "Invalid message"));
+            return;
+        }
+        if (!validStops) {
+            client.send(errorMessage(std::nullopt, "Invalid 'stops' array"));
+            return;
+        }
+
+        if (action == "unsubscribe") {
+            for (const auto& stopId : stops) {
+                if (client.lastEtags.erase(stopId) > 0) releaseStop(stopId);
+            }
+            json reply = {{"type", "unsubscribed"}, {"stops", stops}};
+            client.send(reply.dump());
+            return;
+        }
+
+        size_t added = 0;
+        for (const auto& stopId : stops) {
+            if (client.lastEtags.count(stopId) == 0) ++added;
+        }
+        if (client.lastEtags.size() + added > MAX_STREAM_STOPS) {
+            static const std::string tooMany = "Too many stops, at most " + std::to_string(MAX_STREAM_STOPS) + " allowed";
+            client.send(errorMessage(std::nullopt, tooMany));
+            return;
+        }
+
+        // New options apply to every subscribed stop, so all of them are re-sent
+        detailed = boolOption(message, "detailed", client.detailed);
+        includeDelay = boolOption(message, "delay", client.includeDelay);
+        if (detailed != client.detailed || includeDelay != client.includeDelay) {
+            client.detailed = detailed;
+            client.includeDelay = includeDelay;
+            for (auto& subscription : client.lastEtags) {
+                subscription.second.clear();
+                toFetch.push_back(subscription.first);
+            }
+        }
+        for (const auto& stopId : stops) {
+            if (client.lastEtags.emplace(stopId, "").second) {
+                retainStop(stopId);
+                toFetch.push_back(stopId);
+            }
+        }
+
+        json reply = {{"type", "subscribed"}, {"stops", stops}, {"detailed", detailed}, {"delay", includeDelay}};
+        client.send(reply.dump());
+    }
+
+    // Outside the lock: cache hits call back inline
+    for (const auto& stopId : toFetch) sendInitialDepartures(clientId, stopId, detailed, includeDelay);
+}
+
+// --- Publisher ---
+// Every STREAM_POLL_MS, compares each subscribed stop's cached body with the
+// ETag last sent to each subscriber and pushes only the changes. Upstream load
+// stays at one refresh per distinct stop, however many clients watch it.
+// Every STREAM_TICK_SECONDS a tick lets clients count minutes_remaining down.
+static void runPublisher() {
+    auto lastTick = std::chrono::steady_clock::now();
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(publisher_mutex);
+            publisher_cv.wait_for(lock, std::chrono::milliseconds(STREAM_POLL_MS), [] { return publisher_stopping; });
+            if (publisher_stopping) return;
+        }
+
+        std::map<std::string, unsigned> variants;
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            for (const auto& entry : stream_clients) {
+                unsigned bit = 1u << variantIndex(entry.second.detailed, entry.second.includeDelay);
+                for (const auto& subscription : entry.second.lastEtags) variants[subscription.first] |= bit;
+            }
+        }
+
+        std::map<std::string, std::array<CachedBodyPtr, 4>> bodies;
+        for (const auto& [stopId, mask] : variants) {
+            auto& stopBodies = bodies[stopId];
+            for (size_t v = 0; v < 4; ++v) {
+                if (mask & (1u << v)) stopBodies[v] = peekDepartures(stopId, (v & 2) != 0, (v & 1) != 0);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool tick = now - lastTick >= std::chrono::seconds(STREAM_TICK_SECONDS);
+        std::string tickMessage;
+        if (tick) {
+            lastTick = now;
+            auto unixSeconds = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            tickMessage = R"({"type":"tick","time":)" + std::to_string(unixSeconds) + "}";
+        }
+
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        for (auto& entry : stream_clients) {
+            StreamClient& client = entry.second;
+            size_t variant = variantIndex(client.detailed, client.includeDelay);
+            for (const auto& subscription : client.lastEtags) {
+                auto it = bodies.find(subscription.first);
+                // Stops subscribed after the snapshot are handled by their initial update
+                if (it != bodies.end()) pushIfChanged(client, subscription.first, it->second[variant]);
+            }
+            if (tick) {
+                client.send(tickMessage);
+                stream_ticks.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void startStreamPublisher() {
+    if (publisher_thread.joinable()) return;
+    publisher_thread = std::thread(runPublisher);
+}
+
+void stopStreamPublisher() {
+    {
+        std::lock_guard<std::mutex> lock(publisher_mutex);
+        publisher_stopping = true;
+    }
+    publisher_cv.notify_all();
+    if (publisher_thread.joinable()) publisher_thread.join();
+}
+
+StreamStats getStreamStats() {
+    StreamStats stats;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        stats.clients = stream_clients.size();
+        stats.stops = stream_stop_refs.size();
+    }
+    stats.pushes = stream_pushes.load(std::memory_order_relaxed);
+    stats.ticks = stream_ticks.load(std::memory_order_relaxed);
+    return stats;
+}
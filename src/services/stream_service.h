@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "../config/config.h"
+
+// --- Live Departure Stream ---
+// Transport-agnostic subscriber registry behind the WebSocket route. Each
+// client gets a send sink; sinks are only called while the registry lock is
+// held, so once closeStreamClient returns the sink is never called again.
+using StreamSink = std::function<void(const std::string&)>;
+
+struct StreamStats {
+    size_t clients = 0;
+    size_t stops = 0;      // Distinct stops with at least one subscriber
+    uint64_t pushes = 0;   // Departure updates sent
+    uint64_t ticks = 0;    // Countdown ticks sent
+};
+
+// Returns 0 when MAX_STREAM_CLIENTS are already connected.
+uint64_t openStreamClient(StreamSink send);
+void closeStreamClient(uint64_t clientId);
+void handleStreamMessage(uint64_t clientId, const std::string& message);
+void startStreamPublisher();
+void stopStreamPublisher();
+StreamStats getStreamStats();
@@ -0,0 +1,202 @@
+#include "warmup_service.h"
+#include "auth_service.h"
+#include "departures_service.h"
+#include "stops_service.h"
+#include "../search/stop_index.h"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+// --- Warm-up State (protected by warmup_mutex) ---
+static std::mutex warmup_mutex;
+static std::condition_variable warmup_cv;
+static std::vector<WarmupTaskStatus> warmup_tasks;
+static std::vector<Clock::time_point> warmup_task_starts;
+static std::vector<std::thread> warmup_threads;
+static Clock::time_point warmup_started;
+static Clock::time_point warmup_deadline;
+static std::optional<Clock::time_point> warmup_finished;  // Set when the last task ends
+static bool warmup_running = false;
+static bool warmup_stopping = false;
+
+// A task returns its final state and fills in the detail.
+using WarmupTask = std::function<WarmupTaskState(std::string& detail)>;
+
+static long long millisBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+}
+
+static bool taskFinished(const WarmupTaskStatus& task) {
+    return task.state != WarmupTaskState::Pending && task.state != WarmupTaskState::Running;
+}
+
+const char* warmupTaskStateName(WarmupTaskState state) {
+    switch (state) {
+        case WarmupTaskState::Running: return "running";
+        case WarmupTaskState::Done: return "done";
+        case WarmupTaskState::Failed: return "failed";
+        case WarmupTaskState::Skipped: return "skipped";
+        default: return "pending";
+    }
+}
+
+// Waits until the deadline or shutdown; returns true if done() became true first.
+static bool waitUntilDeadline(const std::function<bool()>& done) {
+    std::unique_lock<std::mutex> lock(warmup_mutex);
+    return warmup_cv.wait_until(lock, warmup_deadline, [&done] { return warmup_stopping || done(); }) &&
+           !warmup_stopping;
+}
+
+static void runTask(size_t index, const WarmupTask& task) {
+    auto start = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(warmup_mutex);
+        warmup_tasks[index].state = WarmupTaskState::Running;
+        warmup_task_starts[index] = start;
+    }
+
+    std::string detail;
+    WarmupTaskState state = task(detail);
+
+    std::lock_guard<std::mutex> lock(warmup_mutex);
+    WarmupTaskStatus& status = warmup_tasks[index];
+    status.state = state;
+    status.elapsedMs = millisBetween(start, Clock::now());
+    status.detail = std::move(detail);
+    if (!std::all_of(warmup_tasks.begin(), warmup_tasks.end(), taskFinished)) return;
+
+    warmup_finished = Clock::now();
+    std::cout << "Warm-up finished in " << millisBetween(warmup_started, *warmup_finished) << " ms (";
+    for (size_t i = 0; i < warmup_tasks.size(); ++i) {
+        const WarmupTaskStatus& t = warmup_tasks[i];
+        std::cout << (i > 0 ? ", " : "") << t.name << ": " << warmupTaskStateName(t.state);
+        if (t.state != WarmupTaskState::Skipped) std::cout << " in " << t.elapsedMs << " ms";
+    }
+    std::cout << ")" << std::endl;
+}
+
+// --- Tasks ---
+static WarmupTaskState warmDatabasePool(const Database& db, std::string& detail) {
+    if (!db.hasConfig()) return WarmupTaskState::Skipped;
+    db.prewarmPool();
+    size_t open = db.poolStats().open;
+    detail = std::to_string(open) + " connections";
+    return open > 0 ? WarmupTaskState::Done : WarmupTaskState::Failed;
+}
+
+static WarmupTaskState warmStopIndexes(const Database& db, std::string& detail) {
+    if (!db.hasConfig()) return WarmupTaskState::Skipped;
+    if (!loadStopIndexes(db)) return WarmupTaskState::Failed;
+    detail = std::to_string(getStopIndexStats().stops) + " stops";
+    return WarmupTaskState::Done;
+}
+
+// The preload itself runs on the auth maintenance thread; this waits for it
+// in short slices so shutdown is not held up.
+static WarmupTaskState warmApiKeys(const Database& db, const WarmupConfig& config, std::string& detail) {
+    if (!config.preloadApiKeys || !db.hasConfig()) return WarmupTaskState::Skipped;
+    for (;;) {
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(warmup_mutex);
+            if (warmup_stopping || now >= warmup_deadline) return WarmupTaskState::Failed;
+        }
+        if (auto count = waitForApiKeyPreload(std::min(now + std::chrono::milliseconds(100), warmup_deadline))) {
+            detail = std::to_string(*count) + " keys";
+            return WarmupTaskState::Done;
+        }
+    }
+}
+
+// Prefetches through the regular departure path, so the entries land in the
+// cache exactly as a client request would leave them. Callbacks that arrive
+// after the budget only update the shared counters.
+static WarmupTaskState warmDepartures(const WarmupConfig& config, std::string& detail) {
+    if (config.stops.empty()) return WarmupTaskState::Skipped;
+
+    struct Progress {
+        size_t pending = 0;
+        size_t loaded = 0;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->pending = config.stops.size();
+    for (const auto& stopId : config.stops) {
+        getDepartures(stopId, false, false, std::nullopt, std::nullopt, [progress](DeparturesResult result) {
+            {
+                std::lock_guard<std::mutex> lock(warmup_mutex);
+                --progress->pending;
+                if (!result.error) ++progress->loaded;
+            }
+            warmup_cv.notify_all();
+        });
+    }
+
+    waitUntilDeadline([&progress] { return progress->pending == 0; });
+    std::lock_guard<std::mutex> lock(warmup_mutex);
+    detail = std::to_string(progress->loaded) + "/" + std::to_string(config.stops.size()) + " stops";
+    return progress->loaded > 0 ? WarmupTaskState::Done : WarmupTaskState::Failed;
+}
+
+void startWarmup(const Database& db, const WarmupConfig& config) {
+    std::vector<std::pair<std::string, WarmupTask>> tasks;
+    tasks.emplace_back("database_pool", [&db](std::string& detail) { return warmDatabasePool(db, detail); });
+    tasks.emplace_back("stop_index", [&db](std::string& detail) { return warmStopIndexes(db, detail); });
+    tasks.emplace_back("api_keys", [&db, config](std::string& detail) { return warmApiKeys(db, config, detail); });
+    tasks.emplace_back("departures", [config](std::string& detail) { return warmDepartures(config, detail); });
+
+    std::lock_guard<std::mutex> lock(warmup_mutex);
+    if (warmup_running) return;
+    warmup_running = true;
+    warmup_started = Clock::now();
+    warmup_deadline = warmup_started + std::chrono::seconds(config.budgetSeconds);
+    warmup_task_starts.assign(tasks.size(), warmup_started);
+    for (auto& task : tasks) {
+        WarmupTaskStatus status;
+        status.name = task.first;
+        warmup_tasks.push_back(status);
+    }
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        warmup_threads.emplace_back(runTask, i, std::move(tasks[i].second));
+    }
+}
+
+void stopWarmup() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(warmup_mutex);
+        warmup_stopping = true;
+        threads.swap(warmup_threads);
+    }
+    warmup_cv.notify_all();
+    for (auto& thread : threads) thread.join();
+}
+
+WarmupStatus getWarmupStatus() {
+    std::lock_guard<std::mutex> lock(warmup_mutex);
+    WarmupStatus status;
+    if (!warmup_running) return status;
+
+    auto now = Clock::now();
+    status.budgetMs = millisBetween(warmup_started, warmup_deadline);
+    status.tasks = warmup_tasks;
+    for (size_t i = 0; i < status.tasks.size(); ++i) {
+        if (status.tasks[i].state == WarmupTaskState::Running) {
+            status.tasks[i].elapsedMs = millisBetween(warmup_task_starts[i], now);
+        }
+    }
+    if (warmup_finished && *warmup_finished <= warmup_deadline) {
+        status.ready = true;
+        status.elapsedMs = millisBetween(warmup_started, *warmup_finished);
+    } else if (now >= warmup_deadline) {
+        status.ready = true;
+        status.timedOut = true;
+        status.elapsedMs = status.budgetMs;
+    } else {
+        status.elapsedMs = millisBetween(warmup_started, now);
+    }
+    return status;
+}
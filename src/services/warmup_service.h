@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../config/config.h"
+#include "../db/database.h"
+
+// --- Startup Warm-up ---
+// The cold-start work (database pool, local stop indexes, API key cache,
+// hot-stop departures) runs in parallel while the server already accepts
+// requests. The instance reports ready once every task finished or the time
+// budget ran out, whichever comes first; tasks past the budget keep running.
+enum class WarmupTaskState { Pending, Running, Done, Failed, Skipped };
+
+struct WarmupTaskStatus {
+    std::string name;
+    WarmupTaskState state = WarmupTaskState::Pending;
+    long long elapsedMs = 0;  // So far while running
+    std::string detail;       // e.g. "2140 stops"
+};
+
+struct WarmupStatus {
+    bool ready = false;
+    bool timedOut = false;    // Ready because the budget ran out
+    long long elapsedMs = 0;  // Until ready, or so far
+    long long budgetMs = 0;
+    std::vector<WarmupTaskStatus> tasks;
+};
+
+// Call after startAuthMaintenance, which performs the API key preload.
+void startWarmup(const Database& db, const WarmupConfig& config);
+void stopWarmup();
+WarmupStatus getWarmupStatus();
+const char* warmupTaskStateName(WarmupTaskState state);